@@ -121,6 +121,7 @@ function(caffe_print_configuration_summary)
   caffe_status("  ALLOW_LMDB_NOLOCK :   ${ALLOW_LMDB_NOLOCK}")
   # This code is taken from https://github.com/sh1r0/caffe-android-lib
   caffe_status("  USE_HDF5          :   ${USE_HDF5}")
+  caffe_status("  USE_NATIVE_ARCH   :   ${USE_NATIVE_ARCH}")
   caffe_status("")
   caffe_status("Dependencies:")
   caffe_status("  BLAS              : " APPLE THEN "Yes (vecLib)" ELSE "Yes (${BLAS})")
@@ -10,6 +10,8 @@
 #include "caffe/syncedmem.hpp"
 
 const int kMaxBlobAxes = 32;
+/// The channels of a block of the blocked layout; see Blob::set_blocked.
+const int kBlobChannelBlock = 8;
 
 namespace caffe {
 
@@ -24,7 +26,7 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), blocked_(false) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -73,6 +75,29 @@ class Blob {
   }
   inline int num_axes() const { return shape_.size(); }
   inline int count() const { return count_; }
+  /**
+   * @brief Returns the number of values the data holds: count(), or in the
+   *        blocked layout count() with the channels rounded up to whole
+   *        blocks.
+   */
+  inline int data_count() const {
+    return blocked_ ? shape_[0] * ((shape_[1] + kBlobChannelBlock - 1) /
+        kBlobChannelBlock) * kBlobChannelBlock * shape_[2] * shape_[3] :
+        count_;
+  }
+  /**
+   * @brief Switches the data between the NCHW layout and the channel-blocked
+   *        NCHW8c layout of the DIRECT convolution engine: per image,
+   *        C/8 x H x W x 8 values, the last block zero-filled.
+   *
+   * Only the layout changes, not the shape, and the values are not
+   * converted: the Net chooses the layout of its internal blobs before the
+   * first Forward (see NetParameter.blocked_layout), and only the layers
+   * that AllowBlockedLayout() read or write blocked blobs. A blocked blob has
+   * 4 axes, and its diff is unused.
+   */
+  void set_blocked(bool blocked);
+  inline bool blocked() const { return blocked_; }
 
   /**
    * @brief Compute the volume of a slice; i.e., the product of dimensions
@@ -263,6 +288,14 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to data, a SyncedMemory of at
+   *        least data_count() elements -- useful to let Blob%s whose
+   *        contents are never needed at the same time share one buffer.
+   *
+   * A later Reshape to a larger count allocates a buffer of this Blob's own.
+   */
+  void ShareDataMemory(const shared_ptr<SyncedMemory>& data);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -273,6 +306,7 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  bool blocked_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
@@ -269,6 +269,58 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Forward may point the top blobs at the data of the
+   *        bottom blobs instead of writing data of their own.
+   *
+   * The memory planner of Net keeps such bottoms alive as long as the tops.
+   * Layers that share data in Reshape, like Flatten, need not override this.
+   */
+  virtual inline bool SharesDataInForward() const { return false; }
+
+  /**
+   * @brief Return whether Forward writes into the bottom blob bottom_index,
+   *        which must then be computed in place of that top.
+   *
+   * Net refuses to build a net where such a bottom is also read by another
+   * layer, whose Split top would share the overwritten memory. Net asks before
+   * SetUp, so the answer may only depend on the layer parameters.
+   */
+  virtual inline bool OverwritesBottomInForward(const int bottom_index) const {
+    return false;
+  }
+
+  /**
+   * @brief Return whether Forward_cpu reads and writes blobs in the blocked
+   *        layout (see Blob::set_blocked).
+   *
+   * Unless ConvertsBlockedLayout(), the Net makes all or none of the bottoms
+   * and tops of the layer blocked.
+   */
+  virtual inline bool AllowBlockedLayout() const { return false; }
+  /**
+   * @brief Return whether Forward_cpu takes any mix of blocked and plain
+   *        bottoms and tops, converting between them, like the DIRECT
+   *        convolution engine.
+   */
+  virtual inline bool ConvertsBlockedLayout() const { return false; }
+
+  /**
+   * @brief Return an estimate of the floating point operations of Forward
+   *        with the current shapes, for profiling.
+   *
+   * One per top element unless the layer has no bottoms; layers dominated
+   * by matrix products override this.
+   */
+  virtual double ForwardFlops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    double flops = 0;
+    for (int i = 0; !bottom.empty() && i < top.size(); ++i) {
+      flops += top[i]->count();
+    }
+    return flops;
+  }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
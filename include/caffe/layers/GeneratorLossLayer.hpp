@@ -10,18 +10,28 @@
 
 namespace caffe {
 
+/**
+ * @brief Loss for the negatives generated from <N, A, P> triples.
+ *
+ * For the generated negative @f$ G @f$ of quadruplet <A, P, N1, N2>, with
+ * @f$ X @f$ the anchor (for N1) or positive (for N2) and @f$ Y @f$ the
+ * original negative: @f$ E = \sum ||G-X||^2 + ||G-Y||^2 +
+ * \max(0, (1 - Q(y_X, y_Y)) ||X-G||^2 - m) @f$.
+ *
+ * bottom[0] original <A, P, N1, N2> (N x C), bottom[1] label (N),
+ * bottom[2] generate <N1', N2'> (N/2 x C, or N/4 x 2C behind a QuadExpand
+ * VIEW).
+ */
 template <typename Dtype> class GeneratorLossLayer : public LossLayer<Dtype> {
 public:
   GeneratorLossLayer(const LayerParameter &param)
-      : LossLayer<Dtype>(param), helper_() {}
+      : LossLayer<Dtype>(param) {}
 
   virtual void LayerSetUp(const vector<Blob<Dtype> *> &bottom,
                           const vector<Blob<Dtype> *> &top);
 
   virtual void Reshape(const vector<Blob<Dtype> *> &bottom,
-                       const vector<Blob<Dtype> *> &top) {
-    LossLayer<Dtype>::Reshape(bottom, top);
-  }
+                       const vector<Blob<Dtype> *> &top);
 
   virtual inline int ExactNumBottomBlobs() const { return 3; }
 
@@ -30,14 +40,25 @@ public:
 protected:
   virtual void Forward_cpu(const vector<Blob<Dtype> *> &bottom,
                            const vector<Blob<Dtype> *> &top);
+  virtual void Forward_gpu(const vector<Blob<Dtype> *> &bottom,
+                           const vector<Blob<Dtype> *> &top);
 
   virtual void Backward_cpu(const vector<Blob<Dtype> *> &top,
                             const vector<bool> &propagate_down,
                             const vector<Blob<Dtype> *> &bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype> *> &top,
+                            const vector<bool> &propagate_down,
+                            const vector<Blob<Dtype> *> &bottom);
 
   QFunction<Dtype> qFunc_;
-  Blob<Dtype> helper_; // to help caculations
-  Blob<Dtype> diff_;
+  // per generated negative: 1 - q when its hinge is active, else 0; cached
+  // for backward pass
+  Blob<Dtype> coeff_;
+  Blob<Dtype> q_;          // tmp storage for gpu forward pass
+  Blob<Dtype> diff_sq_;    // tmp storage for gpu forward pass
+  Blob<Dtype> dist_sq_;    // tmp storage for gpu forward pass
+  Blob<Dtype> neg_loss_;   // tmp storage for gpu forward pass
+  Blob<Dtype> summer_vec_; // tmp storage for gpu forward pass
   Dtype num_constraints;
 };
 
@@ -0,0 +1,64 @@
+#ifndef CAFFE_LAYERS_QUAD_DATA_LAYER_HPP__
+#define CAFFE_LAYERS_QUAD_DATA_LAYER_HPP__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Samples <A, P, N1, N2> quadruplets from an age-labeled database in
+ *        any order, so the quadruplet layers no longer need a database
+ *        written in quadruplet order.
+ *
+ * Setup scans the data_param source once and keeps an in-memory index from
+ * age to record keys. Each quadruplet then draws, on the prefetch thread, an
+ * anchor age uniformly among the ages with at least two records, an anchor
+ * and a distinct positive of that age, a near negative N1 within the
+ * qfunction_param age_margin of the anchor and a far negative N2 beyond it.
+ * Records are read by random access (Cursor::Seek). When an age has no near
+ * or no far negative, any other age is used, keeping the four ages
+ * compatible with QuadrupletLossLayer.
+ */
+template <typename Dtype>
+class QuadDataLayer : public BasePrefetchingDataLayer<Dtype> {
+public:
+  explicit QuadDataLayer(const LayerParameter &param);
+  virtual ~QuadDataLayer();
+  virtual void DataLayerSetUp(const vector<Blob<Dtype> *> &bottom,
+                              const vector<Blob<Dtype> *> &top);
+  virtual inline const char *type() const { return "QuadData"; }
+  virtual inline int ExactNumBottomBlobs() const { return 0; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+protected:
+  virtual void load_batch(Batch<Dtype> *batch);
+  // a uniformly drawn element of v
+  int Sample(const vector<int> &v) const;
+  // a negative age for anchor_age, preferring the given ages
+  int SampleNegativeAge(const vector<int> &preferred, int anchor_age,
+                        int exclude_age) const;
+  void ReadRecord(int record, Datum *datum);
+
+  shared_ptr<db::DB> db_;
+  shared_ptr<db::Cursor> cursor_;
+  vector<string> keys_;
+  map<int, vector<int> > records_by_age_;
+  vector<int> ages_;        // every age in the database
+  vector<int> anchor_ages_; // ages with at least two records
+  map<int, vector<int> > near_ages_, far_ages_;
+  Datum datum_;
+};
+
+} // namespace caffe
+
+#endif // CAFFE_LAYERS_QUAD_DATA_LAYER_HPP__
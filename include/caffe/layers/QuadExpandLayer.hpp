@@ -9,6 +9,15 @@
 
 namespace caffe {
 
+/**
+ * @brief Expands <A, P, N1, N2> quadruplets into the <N, A, P> inputs of the
+ *        negative generator.
+ *
+ * In COPY mode (the default) every negative gets its own N/2 x 3C row. In
+ * VIEW mode the top shares the bottom memory as N/4 x 4C rows, one per
+ * quadruplet, so the generator reads its triples at fixed strides and no
+ * activation or gradient is copied.
+ */
 template <typename Dtype>
 class QuadExpandLayer : public Layer<Dtype> {
 public:
@@ -20,11 +29,17 @@ public:
   virtual inline const char* type() const { return "QuadExpand"; }
   virtual inline int         ExactNumBottomBlobs() const { return 1; }
   virtual inline int         ExactNumTopBlobs() const { return 1; }
+  virtual inline bool        SharesDataInForward() const { return view_; }
 
 protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& bottom, const vector<bool>& propagate_down,
-                            const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+                            const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+                            const vector<Blob<Dtype>*>& bottom);
+
+  bool view_;
 };
 
 }  // namespace caffe
@@ -9,6 +9,20 @@
 
 namespace caffe {
 
+/**
+ * @brief Merges the A and P rows of the original <A, P, N1, N2> blob with the
+ *        generated <N1', N2'> rows.
+ *
+ * The generated blob is N/2 x C, the layout GeneratorLoss reads, so one
+ * generated blob feeds both layers.
+ *
+ * In COPY mode (the default) the top is a separate blob and both bottoms get
+ * their own diff. In SHARE mode the top is computed in place of the original
+ * blob: forward only copies the N1 and N2 rows in, and backward moves their
+ * diff to the generated blob and zeroes it in the shared buffer, so the A and
+ * P activations and gradients are never copied. The original blob must then
+ * feed no other layer.
+ */
 template <typename Dtype>
 class QuadMergeLayer : public Layer<Dtype> {
 public:
@@ -24,13 +38,23 @@ public:
 
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  virtual inline bool OverwritesBottomInForward(const int bottom_index) const {
+    return bottom_index == 0 &&
+        this->layer_param_.quad_merge_param().mode() ==
+        QuadMergeParameter_Mode_SHARE;
+  }
+
 protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
 
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& bottom, const vector<bool>& propagate_down,
-                            const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+                            const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+                            const vector<Blob<Dtype>*>& bottom);
 
   Blob<Dtype> helper_;
+  bool share_;
 };
 
 }  // namespace caffe
@@ -4,14 +4,28 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/layers/loss_layer.hpp"
+#include <cmath>
 #include <vector>
 
 namespace caffe {
 
+/**
+ * @brief The age-gap weighting Q(y1, y2) of the quadruplet losses.
+ *
+ * Q is tabulated at setup() for every integer age gap in [0, max_age], so
+ * evaluating it for integer labels is a single load; other gaps fall back to
+ * the closed form. The table is a Blob so that GPU kernels can read it too.
+ */
 template <typename Dtype> struct QFunction {
   Dtype margin_;
   Dtype age_margin_;
   Dtype curvature_;
+  int max_age_;
+  Blob<Dtype> table_; // Q(0, d) for d = 0, ..., max_age_
+
+  QFunction()
+      : margin_(0), age_margin_(0), curvature_(1), max_age_(0),
+        norm_near_(1), norm_far_(1), table_data_(NULL) {}
 
   void setup(const LayerParameter &param) {
     margin_ = param.qfunction_param().margin();
@@ -19,14 +33,33 @@ template <typename Dtype> struct QFunction {
         param.qfunction_param().age_margin(); // age margin for function Q
     curvature_ =
         param.qfunction_param().curvature(); // curvature for function Q
+    max_age_ = param.qfunction_param().max_age();
+    CHECK_GT(max_age_, 0) << "max_age must be positive";
+
+    norm_near_ = Q_raw(Dtype(0), age_margin_);
+    norm_far_ = Q_raw(Dtype(0), Dtype(max_age_));
+    table_.Reshape(max_age_ + 1, 1, 1, 1);
+    Dtype *table = table_.mutable_cpu_data();
+    for (int d = 0; d <= max_age_; ++d) {
+      table[d] = Q(Dtype(0), Dtype(d));
+    }
+    table_data_ = table_.cpu_data();
   }
 
   inline Dtype call(const Dtype &y1, const Dtype &y2) const {
+    const Dtype abs_ = std::fabs(y1 - y2);
+    // Range-check before the cast so huge (or NaN) gaps never reach int.
+    if (table_data_ && abs_ <= Dtype(max_age_)) {
+      const int d = static_cast<int>(abs_);
+      if (d == abs_) {
+        return table_data_[d];
+      }
+    }
     return Q(y1, y2);
   }
 
   inline Dtype Q_raw(const Dtype &y1, const Dtype &y2) const {
-    Dtype abs_ = abs(y1 - y2);
+    Dtype abs_ = std::fabs(y1 - y2);
     Dtype ret1 = age_margin_ * log(1 + abs_ / curvature_);
     if (abs_ <= age_margin_) {
       return ret1;
@@ -37,17 +70,33 @@ template <typename Dtype> struct QFunction {
   }
 
   inline Dtype Q(const Dtype &y1, const Dtype &y2) const {
-    Dtype abs_ = abs(y1 - y2);
+    Dtype abs_ = std::fabs(y1 - y2);
     Dtype ret1 = age_margin_ * log(1 + abs_ / curvature_);
     if (abs_ <= age_margin_) {
-      return ret1 / Q_raw(Dtype(0), age_margin_);
+      return ret1 / norm_near_;
     } else {
       Dtype C = age_margin_ - ret1;
-      return (abs_ - C) / Q_raw(Dtype(0), Dtype(69)); // 0 min age, 69 max age
+      return (abs_ - C) / norm_far_; // 0 min age, max_age_ max age
     }
   };
+
+private:
+  Dtype norm_near_; // Q_raw(0, age_margin_)
+  Dtype norm_far_;  // Q_raw(0, max_age_)
+  const Dtype *table_data_; // points into table_, set by setup()
+
+  DISABLE_COPY_AND_ASSIGN(QFunction);
 };
 
+/**
+ * @brief Computes the age-aware quadruplet loss over groups <A, P, N1, N2>:
+ *        @f$ E = \frac{1}{N} \sum ||A-P||^2 +
+ *            \max(0, m - q_1 ||A-N_1||^2) + \max(0, m - q_2 ||P-N_2||^2) @f$
+ *        where @f$ q_1 = Q(y_A, y_{N_1}) @f$ and @f$ q_2 = Q(y_P, y_{N_2}) @f$.
+ *
+ * Forward and backward are fused: each quadruplet is read once per pass and
+ * the quadruplets are processed in parallel when Caffe is built with OpenMP.
+ */
 template <typename Dtype> class QuadrupletLossLayer : public LossLayer<Dtype> {
 public:
   explicit QuadrupletLossLayer(const LayerParameter &param)
@@ -55,6 +104,8 @@ public:
 
   virtual void LayerSetUp(const vector<Blob<Dtype> *> &bottom,
                           const vector<Blob<Dtype> *> &top);
+  virtual void Reshape(const vector<Blob<Dtype> *> &bottom,
+                       const vector<Blob<Dtype> *> &top);
 
   virtual inline int ExactNumBottomBlobs() const { return 2; }
 
@@ -65,13 +116,24 @@ public:
 protected:
   virtual void Forward_cpu(const vector<Blob<Dtype> *> &bottom,
                            const vector<Blob<Dtype> *> &top);
+  virtual void Forward_gpu(const vector<Blob<Dtype> *> &bottom,
+                           const vector<Blob<Dtype> *> &top);
 
   virtual void Backward_cpu(const vector<Blob<Dtype> *> &top,
                             const vector<bool> &propagate_down,
                             const vector<Blob<Dtype> *> &bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype> *> &top,
+                            const vector<bool> &propagate_down,
+                            const vector<Blob<Dtype> *> &bottom);
 
-  Blob<Dtype> diff_;
-  Blob<Dtype> helper_;
+  // per quadruplet: q * [hinge active] for the <A, N1> and <P, N2> terms,
+  // cached for the backward pass
+  Blob<Dtype> coeff_;
+  Blob<Dtype> q_;          // tmp storage for gpu forward pass
+  Blob<Dtype> diff_sq_;    // tmp storage for gpu forward pass
+  Blob<Dtype> dist_sq_;    // tmp storage for gpu forward pass
+  Blob<Dtype> quad_loss_;  // tmp storage for gpu forward pass
+  Blob<Dtype> summer_vec_; // tmp storage for gpu forward pass
   QFunction<Dtype> qFunc_;
 };
 
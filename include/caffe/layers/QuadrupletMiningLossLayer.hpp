@@ -0,0 +1,66 @@
+#ifndef CAFFE_LAYERS_QUADRUPLET_MINING_LOSS_LAYER_HPP__
+#define CAFFE_LAYERS_QUADRUPLET_MINING_LOSS_LAYER_HPP__
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layers/QuadrupletLossLayer.hpp"
+#include "caffe/layers/loss_layer.hpp"
+#include <vector>
+
+namespace caffe {
+
+/**
+ * @brief The QuadrupletLossLayer loss over quadruplets mined online from an
+ *        arbitrary labeled batch.
+ *
+ * One Gram matrix per batch (a single caffe_cpu_gemm) gives all pairwise
+ * squared distances. Every sample with a same-age partner becomes an anchor
+ * A with its farthest positive P; N1 is mined among the negatives of A and
+ * N2 among the negatives of P (with an age different from N1), ranking
+ * negatives by their Q-weighted distance @f$ Q(y_1, y_2) ||x_1 - x_2||^2 @f$.
+ * The loss is normalized as if the mined quadruplets were a fixed
+ * <A, P, N1, N2> batch.
+ */
+template <typename Dtype>
+class QuadrupletMiningLossLayer : public LossLayer<Dtype> {
+public:
+  explicit QuadrupletMiningLossLayer(const LayerParameter &param)
+      : LossLayer<Dtype>(param) {}
+
+  virtual void LayerSetUp(const vector<Blob<Dtype> *> &bottom,
+                          const vector<Blob<Dtype> *> &top);
+  virtual void Reshape(const vector<Blob<Dtype> *> &bottom,
+                       const vector<Blob<Dtype> *> &top);
+
+  virtual inline int ExactNumBottomBlobs() const { return 2; }
+
+  virtual inline const char *type() const { return "QuadrupletMiningLoss"; }
+
+  inline Dtype margin() const { return qFunc_.margin_; }
+
+  /// the mined quadruplets of the last forward pass, 4 batch indices each
+  inline const vector<int> &mined() const { return mined_; }
+
+protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype> *> &bottom,
+                           const vector<Blob<Dtype> *> &top);
+
+  virtual void Backward_cpu(const vector<Blob<Dtype> *> &top,
+                            const vector<bool> &propagate_down,
+                            const vector<Blob<Dtype> *> &bottom);
+
+  // index of the selected negative of sample x, or -1 when there is none
+  int SelectNegative(const int x, const int N, const Dtype *dist,
+                     const Dtype *label, const Dtype exclude_label,
+                     const Dtype positive_dist) const;
+
+  QuadrupletMiningParameter_Strategy strategy_;
+  Blob<Dtype> dist_;  // pairwise squared distances
+  Blob<Dtype> coeff_; // cached for backward pass, as in QuadrupletLossLayer
+  vector<int> mined_;
+  QFunction<Dtype> qFunc_;
+};
+
+} // namespace caffe
+
+#endif // CAFFE_LAYERS_QUADRUPLET_MINING_LOSS_LAYER_HPP__
@@ -1,12 +1,15 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/int8.hpp"
 
 namespace caffe {
 
@@ -18,7 +21,7 @@ template <typename Dtype>
 class BaseConvolutionLayer : public Layer<Dtype> {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), share_workspace_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -27,6 +30,29 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
+  // a multiply and an add per weight and output position, for each image
+  virtual double ForwardFlops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    return 2. * bottom.size() * num_ * conv_out_channels_ *
+        conv_out_spatial_dim_ * kernel_dim_;
+  }
+
+  /**
+   * @brief Borrow the scratch buffers from the calling thread's shared
+   *        workspace instead of owning them.
+   *
+   * Layers run one at a time on a thread, so every convolution of the nets
+   * that thread runs can unroll into the same memory; Net enables this with
+   * NetParameter.share_conv_workspace and reserves the largest need up front.
+   */
+  inline void set_share_workspace(bool share) { share_workspace_ = share; }
+  /// @brief The number of scratch values the layer needs at its current shape.
+  virtual int workspace_count() const {
+    return std::max(col_buffer_.count(),
+        batch_size_ > 1 ? batch_buffer_.count() : 0);
+  }
+  /// @brief The workspace shared by the layers run on the calling thread.
+  static Blob<Dtype>* SharedWorkspace();
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
@@ -35,11 +61,26 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
+  // Adds the bias, if any, and applies the fused ReLU, if set, to the output
+  // of one image.
+  void forward_cpu_epilogue(Dtype* output);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Batched versions of forward_cpu_gemm and weight_cpu_gemm over num
+  // consecutive images, at most batch_size_, with one GEMM per group.
+  void forward_cpu_gemm_batch(const Dtype* input, const Dtype* weights,
+      Dtype* output, int num, bool skip_im2col = false);
+  void weight_cpu_gemm_batch(const Dtype* input, const Dtype* output,
+      Dtype* weights, int num);
+  // forward_cpu_gemm in int8 (QuantizationParameter INT8), with the
+  // weights quantized per output channel.
+  void forward_cpu_int8(const Dtype* input, Dtype* output);
+  // forward_cpu_gemm with the weights kept in 16 bits (QuantizationParameter
+  // FP16 or BF16).
+  void forward_cpu_half(const Dtype* input, Dtype* output);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -87,13 +128,38 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int channels_;
   int group_;
   int out_spatial_dim_;
+  /// @brief The number of images unrolled together by the CPU gemm helpers.
+  int batch_size_;
+  bool share_workspace_;
   int weight_offset_;
   int num_output_;
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief Whether the CPU forward pass runs in int8.
+  bool int8_;
+  /// @brief The calibrated input scale, 0 to compute it per image.
+  float int8_input_scale_;
+  /// @brief Whether the CPU forward pass keeps the weights in half_format_.
+  bool half_;
+  HalfFormat half_format_;
+  /// @brief Whether ReLU is applied to the output (ConvolutionParameter relu).
+  bool relu_;
 
  private:
+  // the scratch buffers, owned or borrowed from the shared workspace
+  Blob<Dtype>* col_buffer() {
+    return share_workspace_ ? SharedBuffer(col_buffer_) : &col_buffer_;
+  }
+  Blob<Dtype>* batch_buffer() {
+    return share_workspace_ ? SharedBuffer(batch_buffer_) : &batch_buffer_;
+  }
+  static Blob<Dtype>* SharedBuffer(const Blob<Dtype>& like) {
+    Blob<Dtype>* workspace = SharedWorkspace();
+    workspace->Reshape(like.shape());
+    return workspace;
+  }
+
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
   inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -123,6 +189,15 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(), data);
     }
   }
+  inline void conv_im2col_batch_cpu(const Dtype* data, int num,
+      Dtype* col_buff) {
+    im2col_batch_cpu(data, num, conv_in_channels_,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1],
+        dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff);
+  }
 #ifndef CPU_ONLY
   inline void conv_im2col_gpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -164,9 +239,23 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int kernel_dim_;
   int col_offset_;
   int output_offset_;
+  int conv_input_dim_;
+  int conv_output_dim_;
 
+  // Their shapes are kept, but their memory is only allocated when the
+  // workspace is not shared.
   Blob<Dtype> col_buffer_;
+  // The columns of batch_size_ images followed by their outputs, laid out
+  // channel-major, for the batched gemm helpers.
+  Blob<Dtype> batch_buffer_;
   Blob<Dtype> bias_multiplier_;
+  // the int8 weights, transposed columns and int32 products
+  Int8Weights<Dtype> int8_weights_;
+  vector<int8_t> int8_col_;
+  vector<int32_t> int8_output_;
+  // the 16-bit weights and transposed columns
+  HalfWeights<Dtype> half_weights_;
+  vector<Dtype> half_col_;
 };
 
 }  // namespace caffe
@@ -46,7 +46,26 @@ class BaseDataLayer : public Layer<Dtype> {
 template <typename Dtype>
 class Batch {
  public:
+  Batch() : wait_ms_() {}
   Blob<Dtype> data_, label_;
+  // Time the prefetch thread was blocked waiting for this free batch, in ms.
+  float wait_ms_;
+};
+
+/**
+ * @brief Queue wait statistics of a BasePrefetchingDataLayer, to tell whether
+ *        the net (consumer) or the prefetch thread (producer) is the
+ *        bottleneck.
+ */
+struct PrefetchStats {
+  PrefetchStats()
+      : depth(), consumer_stalls(), consumer_wait_ms(), producer_stalls(),
+        producer_wait_ms() {}
+  int depth;                 // batches in circulation
+  uint64_t consumer_stalls;  // forward passes that had to wait for a batch
+  double consumer_wait_ms;
+  uint64_t producer_stalls;  // batches loaded only after waiting for a slot
+  double producer_wait_ms;
 };
 
 template <typename Dtype>
@@ -65,14 +84,28 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
+  inline const PrefetchStats& prefetch_stats() const { return stats_; }
+
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Returns the current batch to the free queue, waits for the next full one,
+  // makes it current and, in adaptive mode, resizes the queue.
+  Batch<Dtype>* NextBatch();
+  void AdaptPrefetch();
 
   vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
   Batch<Dtype>* prefetch_current_;
+  // A batch dropped from the queue, kept until the tops stop pointing to it.
+  shared_ptr<Batch<Dtype> > prefetch_retired_;
+  bool prefetch_shrink_;
+
+  PrefetchStats stats_;
+  // stats_ at the start of the current adaptation window
+  PrefetchStats window_start_;
+  int window_iter_;
 
   Blob<Dtype> transformed_data_;
 };
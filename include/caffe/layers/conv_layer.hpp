@@ -57,12 +57,19 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  2 groups separate input channels 1-2 and output channels 1-4 into the
    *  first group and input channels 3-4 and output channels 5-8 into the second
    *  group.
+   *  Depthwise convolution, where group == num_output == channels, runs
+   *  dedicated per-channel CPU kernels instead of one GEMM per group.
+   *  With quantization_param { precision: INT8 } the CPU forward pass
+   *  multiplies int8 inputs and weights instead.
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
    *    kernels + stream parallelism) engines.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
-      : BaseConvolutionLayer<Dtype>(param) {}
+      : BaseConvolutionLayer<Dtype>(param), depthwise_(false) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual int workspace_count() const;
 
   virtual inline const char* type() const { return "Convolution"; }
 
@@ -77,6 +84,9 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  /// @brief Whether the CPU passes use the depthwise kernels.
+  bool depthwise_;
 };
 
 }  // namespace caffe
@@ -10,6 +10,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -29,10 +30,25 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   void Next();
   bool Skip();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Transforms the items worker, worker + W, ... of datums_ into top_data
+  // (items of item_size values each) and top_label, with W the number of
+  // transform workers. The pointers are resolved by load_batch, so the
+  // workers never touch the batch blobs' SyncedMemory.
+  void TransformItems(Dtype* top_data, int item_size, Dtype* top_label,
+      int worker);
 
   shared_ptr<db::DB> db_;
   shared_ptr<db::Cursor> cursor_;
   uint64_t offset_;
+  // The items of the batch being loaded, read in database order.
+  vector<Datum> datums_;
+  // One transformer (and its RNG) and transformed blob per worker; worker 0
+  // is the prefetch thread itself and uses data_transformer_.
+  vector<shared_ptr<DataTransformer<Dtype> > > worker_transformers_;
+  vector<shared_ptr<Blob<Dtype> > > worker_transformed_;
+  // Runs workers 1, ..., W - 1 for the whole life of the layer; NULL with a
+  // single worker.
+  shared_ptr<ThreadPool> transform_pool_;
 };
 
 }  // namespace caffe
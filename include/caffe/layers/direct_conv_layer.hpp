@@ -0,0 +1,63 @@
+#ifndef CAFFE_DIRECT_CONV_LAYER_HPP_
+#define CAFFE_DIRECT_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Direct implementation of ConvolutionLayer for CPU inference, over a
+ *        channel-blocked (NCHW8c) layout instead of an im2col buffer.
+ *        Fallback to ConvolutionLayer for GPU mode and for the gradients.
+ *
+ * Each image is packed to the blocked layout, padding included, convolved by
+ * the direct_conv_cpu microkernel (AVX-512 or AVX2/FMA for float when the
+ * build enables them, e.g. with USE_NATIVE_ARCH, compiler-vectorized loops
+ * otherwise) and unpacked. Blocked bottoms and tops (see Blob::set_blocked)
+ * are read and written in place instead, so that with
+ * NetParameter.blocked_layout a chain of DIRECT convolutions, ReLU and
+ * pooling layers is packed once at its start and unpacked once at its end.
+ * The weights are packed once and kept until they change. It needs no memory
+ * beyond the packed image and output, against kernel_h * kernel_w times the
+ * input for im2col. Selected with engine: DIRECT; grouped convolution is not
+ * supported.
+ */
+template <typename Dtype>
+class DirectConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DirectConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), weights_valid_(false) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual int workspace_count() const;
+  virtual inline bool AllowBlockedLayout() const { return true; }
+  virtual inline bool ConvertsBlockedLayout() const { return true; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // Packs the weights unless they are unchanged since the last call.
+  void UpdateWeights();
+
+  int padded_h_, padded_w_;
+  int packed_input_count_;
+  int packed_output_count_;
+  bool weights_valid_;
+  Blob<Dtype> packed_weights_;
+  // the weights packed_weights_ was packed from
+  Blob<Dtype> source_weights_;
+  Blob<Dtype> workspace_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DIRECT_CONV_LAYER_HPP_
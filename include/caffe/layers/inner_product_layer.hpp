@@ -6,6 +6,8 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/half.hpp"
+#include "caffe/util/int8.hpp"
 
 namespace caffe {
 
@@ -28,6 +30,10 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual double ForwardFlops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    return 2. * M_ * K_ * N_;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -45,6 +51,17 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// the CPU forward pass in int8 (QuantizationParameter INT8)
+  bool int8_;
+  float int8_input_scale_;
+  Int8Weights<Dtype> int8_weights_;
+  vector<int8_t> int8_input_;
+  vector<int32_t> int8_output_;
+  /// the CPU forward pass with 16-bit weights (QuantizationParameter FP16 or
+  /// BF16)
+  bool half_;
+  HalfFormat half_format_;
+  HalfWeights<Dtype> half_weights_;
 };
 
 }  // namespace caffe
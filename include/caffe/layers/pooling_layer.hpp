@@ -33,10 +33,22 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  // Max and average pooling, without the mask top.
+  virtual inline bool AllowBlockedLayout() const {
+    const PoolingParameter_PoolMethod pool =
+        this->layer_param_.pooling_param().pool();
+    return (pool == PoolingParameter_PoolMethod_MAX ||
+        pool == PoolingParameter_PoolMethod_AVE) &&
+        this->layer_param_.top_size() == 1;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  // Forward_cpu for a blocked bottom and top: the kernel_h x kernel_w
+  // windows of all the channels of a block are reduced together.
+  void Forward_cpu_blocked(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
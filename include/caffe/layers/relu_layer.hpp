@@ -28,6 +28,8 @@ class ReLULayer : public NeuronLayer<Dtype> {
       : NeuronLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "ReLU"; }
+  // Elementwise, and zero maps to zero, so the blocked channel padding stays.
+  virtual inline bool AllowBlockedLayout() const { return true; }
 
  protected:
   /**
@@ -0,0 +1,70 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd implementation of ConvolutionLayer for 3x3, stride 1
+ *        convolution on the CPU. Fallback to ConvolutionLayer for GPU mode.
+ *
+ * F(m x m, 3 x 3) computes each m x m output tile from an (m + 2)^2 input
+ * tile with (m + 2)^2 multiplications per channel pair instead of 9 m^2,
+ * 2.25x fewer for m = 2 and 4x fewer for m = 4 (ConvolutionParameter
+ * winograd_tile). The filters are transformed once and kept until the
+ * weights change. The gradient with respect to the input is a Winograd
+ * convolution with the rotated filters; the weight gradient goes through
+ * the im2col path.
+ *
+ * The DEFAULT engine picks this layer for every undilated, ungrouped 3x3
+ * stride 1 convolution with padding at most 2; it then falls back to
+ * ConvolutionLayer if the input turns out not to be 2D.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), use_winograd_(false),
+        filters_valid_(false), flipped_filters_valid_(false) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual int workspace_count() const;
+
+  /// @brief Whether a 2D convolution of these parameters can use Winograd.
+  static bool Supports(const ConvolutionParameter& conv_param);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // Transforms the filters, or the rotated ones, unless the weights are
+  // unchanged since the last transform.
+  void UpdateFilters(bool flipped);
+  Blob<Dtype>* winograd_workspace();
+
+  bool use_winograd_;
+  int tile_;
+  int winograd_workspace_count_;
+  bool filters_valid_;
+  bool flipped_filters_valid_;
+  Blob<Dtype> filters_;
+  Blob<Dtype> flipped_filters_;
+  // the weights the filters were transformed from
+  Blob<Dtype> transformed_weights_;
+  Blob<Dtype> workspace_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
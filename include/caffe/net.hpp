@@ -14,6 +14,8 @@
 
 namespace caffe {
 
+class ThreadPool;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -266,6 +268,25 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Keep the blobs whose writers and readers all allow it in the
+  ///        blocked layout.
+  void PlanLayout();
+  /// @brief Point the convolution layers at the shared workspace of the
+  ///        calling thread and reserve their largest need.
+  void ShareConvWorkspace(bool verbose);
+  /// @brief Let the top blobs whose lifetimes in the forward pass do not
+  ///        overlap share memory buffers.
+  void PlanMemory(bool verbose);
+  /// @brief Group the blobs that share data, or that layers make share their
+  ///        data in Forward.
+  void FindMemoryGroups(vector<vector<int> >* groups) const;
+  /// @brief Find the layers each layer must wait for in Forward: the last
+  ///        writer of the memory it reads and writes, and the readers since.
+  void PlanForward();
+  /// @brief Run the layers of ForwardFromTo on the thread pool as soon as
+  ///        the layers they wait for are done.
+  Dtype ForwardParallel(int start, int end);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -330,6 +351,19 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Whether the convolution layers share a per-thread workspace.
+  bool share_conv_workspace_;
+  /// Whether top blobs with disjoint lifetimes share memory.
+  bool optimize_memory_;
+  /// Whether internal blobs may be kept in the blocked layout.
+  bool blocked_layout_;
+  /// The blob ids of each set of blobs that layers make share their data,
+  /// such as a Split bottom and its tops, planned as one.
+  vector<vector<int> > memory_groups_;
+  /// The threads running independent layers of Forward concurrently, if
+  /// forward_threads is above 1, and the layers each layer waits for.
+  shared_ptr<ThreadPool> forward_pool_;
+  vector<vector<int> > forward_deps_;
   // Callbacks
   vector<Callback*> before_forward_;
   vector<Callback*> after_forward_;
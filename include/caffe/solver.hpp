@@ -109,6 +109,9 @@ class Solver {
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
+  // Records the update and the iteration, and logs or writes the profile
+  // when due.
+  void Profile(int start_iter, int64_t iteration_start, int64_t update_start);
 
   SolverParameter param_;
   int iter_;
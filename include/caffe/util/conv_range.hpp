@@ -0,0 +1,20 @@
+#ifndef CAFFE_UTIL_CONV_RANGE_HPP_
+#define CAFFE_UTIL_CONV_RANGE_HPP_
+
+#include <algorithm>
+
+namespace caffe {
+
+// Sets [*begin, *end) to the outputs o < output_size for which the input
+// o * stride + offset lies in [0, size), so that the CPU convolution kernels
+// can split a row into a branch-free interior and its padded borders.
+inline void valid_output_range(const int offset, const int stride,
+    const int size, const int output_size, int* begin, int* end) {
+  *end = size - offset <= 0 ? 0 :
+      std::min(output_size, (size - offset + stride - 1) / stride);
+  *begin = std::min(*end, offset >= 0 ? 0 : (stride - 1 - offset) / stride);
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CONV_RANGE_HPP_
@@ -19,6 +19,36 @@ class Cursor {
   virtual string key() = 0;
   virtual string value() = 0;
   virtual bool valid() = 0;
+  // Moves to the record of the given key and returns whether it exists.
+  // Backends with random access override the default linear scan.
+  virtual bool Seek(const string& key) {
+    for (SeekToFirst(); valid(); Next()) {
+      if (this->key() == key) {
+        return true;
+      }
+    }
+    return false;
+  }
+  // Points *data at the *size bytes of the current value, valid until the
+  // cursor moves. Backends that own the value in memory return it without a
+  // copy; the default copies value() into a buffer reused across calls.
+  virtual void value_view(const char** data, size_t* size) {
+    value_buffer_ = value();
+    *data = value_buffer_.data();
+    *size = value_buffer_.size();
+  }
+  // Reads the current value into datum, parsing it in place from
+  // value_view(); backends that store Datums in another form than serialized
+  // protobuf override it to skip the parsing.
+  virtual void ReadDatum(Datum* datum) {
+    const char* data;
+    size_t size;
+    value_view(&data, &size);
+    datum->ParseFromArray(data, size);
+  }
+
+ protected:
+  string value_buffer_;
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
@@ -23,7 +23,16 @@ class LevelDBCursor : public Cursor {
   virtual void Next() { iter_->Next(); }
   virtual string key() { return iter_->key().ToString(); }
   virtual string value() { return iter_->value().ToString(); }
+  virtual void value_view(const char** data, size_t* size) {
+    const leveldb::Slice value = iter_->value();
+    *data = value.data();
+    *size = value.size();
+  }
   virtual bool valid() { return iter_->Valid(); }
+  virtual bool Seek(const string& key) {
+    iter_->Seek(key);
+    return iter_->Valid() && iter_->key() == key;
+  }
 
  private:
   leveldb::Iterator* iter_;
@@ -0,0 +1,119 @@
+#ifndef CAFFE_UTIL_DB_MMAP_HPP
+#define CAFFE_UTIL_DB_MMAP_HPP
+
+#include <stdint.h>
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+/**
+ * File layout of an MMap database: a header, then num_records fixed-size
+ * records of (int32 label, channels * height * width uint8 pixels) padded to
+ * record_size bytes, then the key index: num_records + 1 uint64 offsets into
+ * the concatenated keys that follow it.
+ */
+struct MMapHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t channels;
+  uint32_t height;
+  uint32_t width;
+  uint64_t record_size;
+  uint64_t num_records;
+  uint64_t keys_offset;
+};
+
+class MMapCursor : public Cursor {
+ public:
+  explicit MMapCursor(const char* base)
+    : base_(base), header_(reinterpret_cast<const MMapHeader*>(base)),
+      index_(0) { }
+  virtual void SeekToFirst() { index_ = 0; }
+  virtual void Next() { ++index_; }
+  virtual string key();
+  virtual string value();
+  virtual bool valid() { return index_ < header_->num_records; }
+  // Fills the datum straight from the record, without protobuf parsing.
+  virtual void ReadDatum(Datum* datum);
+
+  // Looks the key up in an index built on the first call.
+  virtual bool Seek(const string& key);
+
+  // Records have a fixed size, so any of them is reached in O(1).
+  void Seek(uint64_t index) { index_ = index; }
+  uint64_t index() const { return index_; }
+  uint64_t size() const { return header_->num_records; }
+  int label() const {
+    return *reinterpret_cast<const int32_t*>(record());
+  }
+  // channels * height * width pixels of the current record
+  const uint8_t* pixels() const {
+    return reinterpret_cast<const uint8_t*>(record() + sizeof(int32_t));
+  }
+
+ private:
+  const char* record() const;
+
+  const char* base_;
+  const MMapHeader* header_;
+  uint64_t index_;
+  map<string, uint64_t> key_index_;
+};
+
+class MMap;
+
+class MMapTransaction : public Transaction {
+ public:
+  explicit MMapTransaction(MMap* db) : db_(db) { }
+  virtual void Put(const string& key, const string& value);
+  virtual void Commit();
+
+ private:
+  MMap* db_;
+  vector<string> keys, values;
+
+  DISABLE_COPY_AND_ASSIGN(MMapTransaction);
+};
+
+/**
+ * @brief A read-only, memory-mapped database of pre-decoded uint8 Datums of
+ *        one shape, written once with mode NEW. Reading a record is a pointer
+ *        computation: there is no protobuf parsing and no copy but the one
+ *        into the Datum handed to the cursor.
+ */
+class MMap : public DB {
+ public:
+  MMap() : fd_(-1), map_(NULL), map_size_(0) { }
+  virtual ~MMap() { Close(); }
+  virtual void Open(const string& source, Mode mode);
+  virtual void Close();
+  virtual MMapCursor* NewCursor();
+  virtual MMapTransaction* NewTransaction();
+
+ private:
+  friend class MMapTransaction;
+  // Writes a record at the end of a NEW database.
+  void Append(const string& key, const Datum& datum);
+
+  string source_;
+  // reading
+  int fd_;
+  char* map_;
+  size_t map_size_;
+  // writing
+  std::ofstream out_;
+  MMapHeader header_;
+  vector<uint64_t> key_offsets_;
+  string keys_;
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_MMAP_HPP
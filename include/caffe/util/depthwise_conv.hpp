@@ -0,0 +1,45 @@
+#ifndef CAFFE_UTIL_DEPTHWISE_CONV_HPP_
+#define CAFFE_UTIL_DEPTHWISE_CONV_HPP_
+
+namespace caffe {
+
+/**
+ * Depthwise 2D convolution, where every channel of the input is convolved
+ * with its own kernel_h x kernel_w filter (group == channels == num_output).
+ * Each image is channels x height x width, each output channels x output_h x
+ * output_w and the weights channels x kernel_h x kernel_w. The kernels work
+ * row by row, restricting every filter tap to the output columns whose input
+ * lies inside the image, so that the inner loops have no bounds checks.
+ */
+
+// Computes one output image.
+template <typename Dtype>
+void depthwise_conv_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int output_h,
+    const int output_w, const Dtype* weights, Dtype* data_out);
+
+// Computes the gradient with respect to one input image, overwriting
+// im_diff.
+template <typename Dtype>
+void depthwise_conv_backward_data_cpu(const Dtype* out_diff,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int output_h, const int output_w,
+    const Dtype* weights, Dtype* im_diff);
+
+// Accumulates the gradient with respect to the weights of one image into
+// weight_diff.
+template <typename Dtype>
+void depthwise_conv_backward_weight_cpu(const Dtype* data_im,
+    const Dtype* out_diff, const int channels, const int height,
+    const int width, const int kernel_h, const int kernel_w, const int pad_h,
+    const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int output_h,
+    const int output_w, Dtype* weight_diff);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DEPTHWISE_CONV_HPP_
@@ -0,0 +1,64 @@
+#ifndef CAFFE_UTIL_DIRECT_CONV_HPP_
+#define CAFFE_UTIL_DIRECT_CONV_HPP_
+
+#include "caffe/blob.hpp"
+
+namespace caffe {
+
+/**
+ * Direct 2D convolution over a channel-blocked layout. Images are stored as
+ * C/8 x H x W x 8 (NCHW8c, the last channel block zero-filled) and filters as
+ * K/8 x C/8 x kernel_h x kernel_w x 8 (input) x 8 (output channels), so the
+ * innermost loop updates 8 output channels of a pixel with one vector
+ * multiply-add per input channel, with no im2col buffer.
+ */
+const int kDirectConvBlock = kBlobChannelBlock;
+
+inline int direct_conv_blocks(const int channels) {
+  return (channels + kDirectConvBlock - 1) / kDirectConvBlock;
+}
+
+// Packs out_channels x in_channels x kernel_h x kernel_w weights.
+template <typename Dtype>
+void direct_conv_pack_weights_cpu(const Dtype* weights,
+    const int out_channels, const int in_channels, const int kernel_h,
+    const int kernel_w, Dtype* packed);
+
+// Packs a channels x height x width image, adding pad_h and pad_w rows and
+// columns of zeros on each side so the convolution needs no bounds checks.
+template <typename Dtype>
+void direct_conv_pack_input_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    Dtype* packed);
+
+// Pads a packed channels x height x width image, as the one of a blocked
+// Blob, like direct_conv_pack_input_cpu pads an unpacked one.
+template <typename Dtype>
+void direct_conv_pad_input_cpu(const Dtype* packed_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    Dtype* packed);
+
+// Convolves a packed, padded image into a packed out_channels x output_h x
+// output_w output.
+template <typename Dtype>
+void direct_conv_cpu(const Dtype* packed_im, const int channels,
+    const int padded_h, const int padded_w, const Dtype* packed_weights,
+    const int out_channels, const int kernel_h, const int kernel_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int output_h, const int output_w,
+    Dtype* packed_out);
+
+// Adds bias, unless NULL, to a packed channels x spatial_dim output and with
+// relu clamps it at zero; the channels padding the last block stay zero.
+template <typename Dtype>
+void direct_conv_bias_cpu(const Dtype* bias, const int channels,
+    const int spatial_dim, const bool relu, Dtype* packed);
+
+// Unpacks a packed channels x height x width image.
+template <typename Dtype>
+void direct_conv_unpack_cpu(const Dtype* packed, const int channels,
+    const int height, const int width, Dtype* data_im);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DIRECT_CONV_HPP_
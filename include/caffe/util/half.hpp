@@ -0,0 +1,64 @@
+#ifndef CAFFE_UTIL_HALF_HPP_
+#define CAFFE_UTIL_HALF_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * 16-bit float storage: IEEE binary16 (FP16) or bfloat16 (BF16), converted
+ * from float with round-to-nearest-even. FP16 keeps 11 significant bits but
+ * overflows to infinity above 65504; BF16 keeps the float range with 8
+ * significant bits, flushing subnormals to zero as AVX512-BF16 does.
+ */
+typedef BlobProto_HalfFormat HalfFormat;
+
+void half_from_float_cpu(const HalfFormat format, const int n, const float* x,
+    uint16_t* y);
+
+void half_to_float_cpu(const HalfFormat format, const int n, const uint16_t* x,
+    float* y);
+
+// The largest finite magnitude of format.
+float half_max(const HalfFormat format);
+
+// C (M x N) = A (M x K) * B (N x K)^T, or with transposed_c its N x M
+// transpose, for B in format. The products convert B to float in registers,
+// 8 values at a time, instead of through a float copy.
+template <typename Dtype>
+void half_gemm_cpu(const HalfFormat format, const int M, const int N,
+    const int K, const Dtype* A, const uint16_t* B, Dtype* C,
+    const bool transposed_c);
+
+/**
+ * @brief The 16-bit copy of a weight blob, refreshed only when the weights
+ *        change, like Int8Weights.
+ */
+template <typename Dtype>
+class HalfWeights {
+ public:
+  HalfWeights() : format_(BlobProto_HalfFormat_FP16), hash_(0) {}
+  // Converts weights, read as rows x cols, or as cols x rows with
+  // transposed, into rows x cols values of format.
+  void Update(const Blob<Dtype>& weights, const HalfFormat format,
+      const int rows, const int cols, const bool transposed);
+  const uint16_t* data() const { return &data_[0]; }
+
+ private:
+  vector<uint16_t> data_;
+  HalfFormat format_;
+  uint64_t hash_;
+};
+
+// Writes blob to proto with 16-bit data, half the size of float data.
+void half_blob_to_proto(const Blob<float>& blob, const HalfFormat format,
+    BlobProto* proto);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_HPP_
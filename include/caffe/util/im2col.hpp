@@ -16,6 +16,32 @@ void im2col_cpu(const Dtype* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_col);
 
+// Unrolls num consecutive images side by side: row r of the column matrix
+// holds row r of every image's im2col_cpu result, image after image.
+template <typename Dtype>
+void im2col_batch_cpu(const Dtype* data_im, const int num,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col);
+
+// The loops im2col_cpu and col2im_cpu run for shapes without a specialized
+// kernel (see im2col.cpp), callable directly for testing and benchmarking.
+template <typename Dtype>
+void im2col_generic_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    Dtype* data_col);
+
+template <typename Dtype>
+void col2im_generic_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    Dtype* data_im);
+
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
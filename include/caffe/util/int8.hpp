@@ -0,0 +1,80 @@
+#ifndef CAFFE_UTIL_INT8_HPP_
+#define CAFFE_UTIL_INT8_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * Symmetric linear int8 quantization: x is stored as q = round(x / scale)
+ * clamped to [-kInt8Max, kInt8Max], and read back as q * scale.
+ */
+const int kInt8Max = 127;
+
+// Returns the largest |x[i]|.
+template <typename Dtype>
+Dtype int8_absmax_cpu(const int n, const Dtype* x);
+
+// Returns the scale mapping [-absmax, absmax] onto the int8 range, 1 for 0.
+inline float int8_scale(const float absmax) {
+  return absmax > 0 ? absmax / kInt8Max : 1;
+}
+
+template <typename Dtype>
+void int8_quantize_cpu(const int n, const Dtype* x, const float scale,
+    int8_t* q);
+
+// Quantizes a rows x cols matrix into its cols x rows transpose.
+template <typename Dtype>
+void int8_quantize_transposed_cpu(const int rows, const int cols,
+    const Dtype* x, const float scale, int8_t* q);
+
+// Quantizes a rows x cols matrix, or with transposed the cols x rows matrix
+// x into its transpose, with one scale per row.
+template <typename Dtype>
+void int8_quantize_rows_cpu(const int rows, const int cols, const Dtype* x,
+    const bool transposed, float* scales, int8_t* q);
+
+// C (M x N) = A (M x K) * B (N x K)^T, accumulated in int32.
+void int8_gemm_cpu(const int M, const int N, const int K, const int8_t* A,
+    const int8_t* B, int32_t* C);
+
+// A 64-bit hash over size raw bytes, to tell whether weights changed.
+uint64_t weights_hash(const void* data, const size_t size);
+
+/**
+ * @brief The per-row quantized copy of a weight blob, refreshed only when
+ *        the weights change.
+ *
+ * Changes are detected by a hash of the weights rather than a float copy,
+ * so that the quantized copy is the only extra memory.
+ */
+template <typename Dtype>
+class Int8Weights {
+ public:
+  Int8Weights() : hash_(0) {}
+  // Quantizes weights, read as rows x cols, or as cols x rows with
+  // transposed, into rows x cols.
+  void Update(const Blob<Dtype>& weights, const int rows, const int cols,
+      const bool transposed);
+  const int8_t* data() const { return &data_[0]; }
+  const float* scales() const { return &scales_[0]; }
+
+ private:
+  vector<int8_t> data_;
+  vector<float> scales_;
+  uint64_t hash_;
+};
+
+// Writes blob to proto with int8 data and one scale per slice of its first
+// axis, a quarter of the size of float data.
+void int8_blob_to_proto(const Blob<float>& blob, BlobProto* proto);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INT8_HPP_
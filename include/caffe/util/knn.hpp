@@ -0,0 +1,106 @@
+#ifndef CAFFE_UTIL_KNN_HPP_
+#define CAFFE_UTIL_KNN_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief In-memory k-nearest-neighbor index over d-dimensional float vectors
+ *        under the squared L2 distance.
+ *
+ * Vectors get consecutive ids in the order they are added. Search() fills,
+ * for each query, the ids of its k nearest vectors and their distances in
+ * increasing distance order, padding with id -1 when fewer are found.
+ */
+class KNNIndex {
+ public:
+  explicit KNNIndex(int dim) : dim_(dim), ntotal_(0) { CHECK_GT(dim, 0); }
+  virtual ~KNNIndex() {}
+
+  /// Learns the index parameters from n training vectors, if any.
+  virtual void Train(int n, const float* x) {}
+  virtual bool is_trained() const { return true; }
+  virtual void Add(int n, const float* x) = 0;
+  virtual void Search(int n, const float* x, int k, int* ids,
+                      float* dists) const = 0;
+
+  inline int dim() const { return dim_; }
+  inline int ntotal() const { return ntotal_; }
+
+ protected:
+  int dim_;
+  int ntotal_;
+
+  DISABLE_COPY_AND_ASSIGN(KNNIndex);
+};
+
+/**
+ * @brief Exact search. Queries are compared to the database in blocks with
+ *        one BLAS gemm each, using ||q - x||^2 = ||q||^2 + ||x||^2 - 2 q.x,
+ *        and the k best per query are kept in a heap, queries in parallel.
+ */
+class FlatIndex : public KNNIndex {
+ public:
+  explicit FlatIndex(int dim) : KNNIndex(dim) {}
+  virtual void Add(int n, const float* x);
+  virtual void Search(int n, const float* x, int k, int* ids,
+                      float* dists) const;
+
+  /// the stored vectors, ntotal x dim
+  inline const float* data() const { return data_.empty() ? NULL : &data_[0]; }
+
+ protected:
+  std::vector<float> data_;
+  std::vector<float> norms_;
+};
+
+/**
+ * @brief Approximate search with an inverted file of product-quantized
+ *        residuals (IVF-PQ).
+ *
+ * A k-means coarse quantizer splits the space into nlist cells; each vector
+ * is stored in the list of its cell as m one-byte codes, the indices of the
+ * nearest of 256 sub-centroids for each of the m sub-vectors of its residual
+ * to the cell centroid. A query scans the lists of its nprobe nearest cells,
+ * summing m entries of a per-cell distance table per vector.
+ */
+class IVFPQIndex : public KNNIndex {
+ public:
+  IVFPQIndex(int dim, int nlist, int m);
+  virtual void Train(int n, const float* x);
+  virtual bool is_trained() const { return trained_; }
+  virtual void Add(int n, const float* x);
+  virtual void Search(int n, const float* x, int k, int* ids,
+                      float* dists) const;
+
+  inline void set_nprobe(int nprobe) { nprobe_ = nprobe; }
+  inline int nprobe() const { return nprobe_; }
+
+ protected:
+  // the residual of x to coarse centroid list
+  void Residual(const float* x, int list, float* residual) const;
+
+  int nlist_, m_, dsub_, ksub_, nprobe_;
+  bool trained_;
+  FlatIndex coarse_;
+  // one index of ksub sub-centroids per sub-vector
+  std::vector<shared_ptr<FlatIndex> > pq_;
+  std::vector<std::vector<int> > list_ids_;
+  std::vector<std::vector<uint8_t> > list_codes_;
+};
+
+/**
+ * @brief Runs a few Lloyd iterations of k-means from k distinct random
+ *        points of x and writes the k x d centroids.
+ */
+void KMeans(int n, int d, const float* x, int k, int iterations,
+            float* centroids);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_KNN_HPP_
@@ -0,0 +1,26 @@
+#ifndef CAFFE_UTIL_OPTIMIZE_INFERENCE_HPP_
+#define CAFFE_UTIL_OPTIMIZE_INFERENCE_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * Copies param, a TEST phase net with its trained blobs as written by
+ * Net::ToProto, rewritten to compute the same outputs with fewer layers:
+ *  - BatchNorm (with global statistics), Scale and Bias layers applying a
+ *    per-channel affine map to the output of a Convolution are folded into
+ *    its weights and bias;
+ *  - a ReLU following such a Convolution becomes its fused relu epilogue;
+ *  - Dropout and Split layers, which copy or share their input at test
+ *    time, are removed and their consumers read the input directly.
+ * A layer is only folded or removed when no other layer reads the blob it
+ * consumes or produces in a way the rewrite would change. Net(param_optimized)
+ * builds the optimized net with its weights.
+ */
+void OptimizeInference(const NetParameter& param,
+    NetParameter* param_optimized);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_OPTIMIZE_INFERENCE_HPP_
@@ -0,0 +1,99 @@
+#ifndef CAFFE_UTIL_PROFILER_HPP_
+#define CAFFE_UTIL_PROFILER_HPP_
+
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Records the wall time, bytes touched and estimated FLOPs of the
+ *        layers run by Forward and Backward, the data prefetch and the
+ *        solver update, for a periodic summary log and a Chrome trace.
+ *
+ * Recording is off until Enable. The instrumented code checks enabled()
+ * before reading the clock, so that it costs a branch while off. The
+ * profiler is process-wide, so only the threads of the root solver record:
+ * with several solvers, the summary and the trace show rank 0. Times are
+ * taken on the host, so in GPU mode they cover the launches of the kernels
+ * rather than their execution.
+ */
+class Profiler {
+ public:
+  /// @brief The time, bytes and FLOPs of the events of one name.
+  struct Total {
+    Total() : count(0), microseconds(0), bytes(0), flops(0) {}
+    int count;
+    int64_t microseconds;
+    double bytes;
+    double flops;
+  };
+
+  static Profiler& Get();
+  /// @brief Whether the calling thread records: the profiler is enabled and
+  ///        the thread works for the root solver.
+  static inline bool enabled() {
+    return enabled_.load(boost::memory_order_relaxed) && Caffe::root_solver();
+  }
+  /// @brief Microseconds since the profiler was created.
+  static int64_t Now();
+
+  /// @brief Starts recording; with trace, every event is also kept for
+  ///        WriteTrace.
+  void Enable(bool trace);
+  void Disable();
+  bool tracing() const { return tracing_; }
+
+  /// @brief Records an event from start until now, on the calling thread.
+  void Record(const string& name, const char* category, int64_t start,
+      double bytes, double flops);
+  /// @brief The events of category and name recorded since the last summary.
+  Total total(const string& category, const string& name) const;
+  /// @brief Logs the totals since the last summary, longest first, and
+  ///        starts the next.
+  void LogSummary();
+  /// @brief Writes the kept events in the Chrome trace event format, for
+  ///        chrome://tracing or Perfetto, and stops keeping them.
+  void WriteTrace(const string& filename);
+
+ private:
+  Profiler();
+
+  struct Event {
+    string name;
+    const char* category;
+    int thread;
+    int64_t start;
+    int64_t duration;
+    double bytes;
+    double flops;
+  };
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp,
+   as in BlockingQueue.
+   */
+  class sync;
+
+  // read without the mutex by every instrumented thread
+  static boost::atomic<bool> enabled_;
+  bool tracing_;
+  vector<Event> events_;
+  map<pair<string, string>, Total> totals_;
+  int64_t summary_start_;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(Profiler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PROFILER_HPP_
@@ -0,0 +1,62 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include <deque>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of threads running queued tasks.
+ *
+ * The workers take Caffe's thread local state from the thread creating the
+ * pool, like InternalThread, and each is limited to its share of the OpenMP
+ * (and MKL) threads, so that tasks running math in parallel regions do not
+ * oversubscribe the cores between them.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  /// @brief Queues task; tasks may queue further tasks.
+  void Run(const boost::function<void()>& task);
+
+  /// @brief Blocks until the queued tasks, and those they queued, are done.
+  void Wait();
+
+  int num_threads() const { return threads_.size(); }
+
+ private:
+  void Work(int device, Caffe::Brew mode, int rand_seed, int solver_count,
+      int solver_rank, bool multiprocess, int inner_threads);
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp,
+   as in BlockingQueue.
+   */
+  class sync;
+
+  std::deque<boost::function<void()> > tasks_;
+  // the queued and running tasks
+  int unfinished_;
+  bool stop_;
+  shared_ptr<sync> sync_;
+  vector<shared_ptr<boost::thread> > threads_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -0,0 +1,43 @@
+#ifndef CAFFE_UTIL_WINOGRAD_HPP_
+#define CAFFE_UTIL_WINOGRAD_HPP_
+
+namespace caffe {
+
+/**
+ * Winograd minimal filtering F(m x m, 3 x 3) for stride 1 3x3 convolution,
+ * with m = 2 or 4 output values per tile side. Every (m + 2) x (m + 2) input
+ * tile and 3x3 filter is transformed so that the convolution becomes
+ * (m + 2)^2 independent matrix products, one per transformed position.
+ */
+
+/// @brief The number of values of a transformed tile, (m + 2)^2.
+inline int winograd_tile_size(const int tile) {
+  return (tile + 2) * (tile + 2);
+}
+
+// Transforms out_channels x in_channels 3x3 filters into the
+// (m + 2)^2 x out_channels x in_channels matrices multiplied by
+// winograd_conv_cpu. With flip, weights is read as in_channels x
+// out_channels rotated filters instead, the filters of the gradient
+// with respect to the input of a convolution.
+template <typename Dtype>
+void winograd_filter_transform_cpu(const Dtype* weights,
+    const int out_channels, const int in_channels, const int tile,
+    const bool flip, Dtype* filters);
+
+// Returns the number of values of scratch space winograd_conv_cpu needs.
+int winograd_workspace_count(const int channels, const int out_channels,
+    const int output_h, const int output_w, const int tile);
+
+// Convolves one channels x height x width image, zero-padded by pad_h and
+// pad_w, with transformed 3x3 filters into out_channels x output_h x
+// output_w, where output_h = height + 2 * pad_h - 2.
+template <typename Dtype>
+void winograd_conv_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const Dtype* filters, const int out_channels, const int tile,
+    Dtype* workspace, Dtype* data_out);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WINOGRAD_HPP_
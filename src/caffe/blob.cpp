@@ -1,9 +1,11 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -22,6 +24,9 @@ void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const vector<int>& shape) {
   CHECK_LE(shape.size(), kMaxBlobAxes);
+  if (blocked_) {
+    CHECK_EQ(shape.size(), 4) << "A blocked blob has 4 axes";
+  }
   count_ = 1;
   shape_.resize(shape.size());
   if (!shape_data_ || shape_data_->size() < shape.size() * sizeof(int)) {
@@ -37,8 +42,8 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     shape_[i] = shape[i];
     shape_data[i] = shape[i];
   }
-  if (count_ > capacity_) {
-    capacity_ = count_;
+  if (data_count() > capacity_) {
+    capacity_ = data_count();
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
   }
@@ -59,18 +64,24 @@ void Blob<Dtype>::ReshapeLike(const Blob<Dtype>& other) {
   Reshape(other.shape());
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_blocked(bool blocked) {
+  blocked_ = blocked;
+  Reshape(shape_);
+}
+
 template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), blocked_(false) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), blocked_(false) {
   Reshape(shape);
 }
 
@@ -164,6 +175,14 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDataMemory(const shared_ptr<SyncedMemory>& data) {
+  CHECK_GE(data->size(), data_count() * sizeof(Dtype));
+  data_ = data;
+  // data may be smaller than the old capacity
+  capacity_ = data_count();
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -487,7 +506,30 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  if (proto.has_int8_data()) {
+    CHECK_EQ(count_, proto.int8_data().size());
+    CHECK_GT(proto.int8_scale_size(), 0);
+    CHECK_EQ(count_ % proto.int8_scale_size(), 0);
+    const int8_t* int8_data =
+        reinterpret_cast<const int8_t*>(proto.int8_data().data());
+    const int slice = count_ / proto.int8_scale_size();
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = int8_data[i] * proto.int8_scale(i / slice);
+    }
+  } else if (proto.has_half_data()) {
+    CHECK_EQ(count_ * sizeof(uint16_t), proto.half_data().size());
+    const uint16_t* half_data =
+        reinterpret_cast<const uint16_t*>(proto.half_data().data());
+    // convert in chunks, so that no float copy of the blob is made
+    float chunk[1024];
+    for (int i = 0; i < count_; i += 1024) {
+      const int n = std::min(count_ - i, 1024);
+      half_to_float_cpu(proto.half_format(), n, half_data + i, chunk);
+      for (int j = 0; j < n; ++j) {
+        data_vec[i + j] = chunk[j];
+      }
+    }
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
@@ -521,6 +563,10 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_double_data();
   proto->clear_double_diff();
+  proto->clear_int8_data();
+  proto->clear_int8_scale();
+  proto->clear_half_data();
+  proto->clear_half_format();
   const double* data_vec = cpu_data();
   for (int i = 0; i < count_; ++i) {
     proto->add_double_data(data_vec[i]);
@@ -541,6 +587,10 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_data();
   proto->clear_diff();
+  proto->clear_int8_data();
+  proto->clear_int8_scale();
+  proto->clear_half_data();
+  proto->clear_half_format();
   const float* data_vec = cpu_data();
   for (int i = 0; i < count_; ++i) {
     proto->add_data(data_vec[i]);
@@ -1,4 +1,5 @@
 #include "caffe/layers/GeneratorLossLayer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include <cmath>
 
@@ -14,12 +15,33 @@ void GeneratorLossLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype> *> &bottom,
   // CHECK_EQ(bottom[2]->width(), 1);
   // CHECK_EQ(bottom[0]->channels(), bottom[1]->channels());
 
-  helper_.Reshape(1, bottom[2]->channels(), 1, 1);
-  diff_.ReshapeLike(*bottom[2]);
-
   qFunc_.setup(this->layer_param_);
 }
 
+template <typename Dtype>
+void GeneratorLossLayer<Dtype>::Reshape(const vector<Blob<Dtype> *> &bottom,
+                                        const vector<Blob<Dtype> *> &top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  CHECK_EQ(bottom[0]->num() % 4, 0);
+  // generate is either N/2 x C or, behind a QuadExpand VIEW, N/4 x 2C;
+  // both are the same <N1', N2'> rows in memory
+  CHECK_EQ(bottom[0]->count(), bottom[2]->count() * 2)
+      << "Expected one generated negative per <A, N1> and <P, N2> pair.";
+
+  const int num_neg = bottom[0]->num() / 2;
+  const int S = bottom[0]->count(1);
+  coeff_.Reshape(num_neg, 1, 1, 1);
+  // tmp storage for the gpu path; blobs only allocate memory once touched
+  q_.Reshape(num_neg, 1, 1, 1);
+  diff_sq_.Reshape(num_neg, 2, S, 1);
+  dist_sq_.Reshape(num_neg, 2, 1, 1);
+  neg_loss_.Reshape(num_neg, 1, 1, 1);
+  if (summer_vec_.count() != S) {
+    summer_vec_.Reshape(S, 1, 1, 1);
+    caffe_set(S, Dtype(1), summer_vec_.mutable_cpu_data());
+  }
+}
+
 template <typename Dtype>
 void GeneratorLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype> *> &bottom,
                                             const vector<Blob<Dtype> *> &top) {
@@ -27,68 +49,51 @@ void GeneratorLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype> *> &bottom,
   // bottom[1] label
   // bottom[2] generate
 
-  int N = bottom[0]->num(); // get the batch size
-  int S = bottom[0]->height() * bottom[0]->width() *
-          bottom[0]->channels(); // get each blob child size
+  const int num_neg = bottom[0]->num() / 2;
+  const int S = bottom[0]->count(1); // get each blob child size
   const Dtype *origin = bottom[0]->cpu_data();
   const Dtype *generate = bottom[2]->cpu_data();
   const Dtype *label = bottom[1]->cpu_data();
-  Dtype *diff = diff_.mutable_cpu_data();
-  Dtype tmp(0.0), this_loss(0.0);
+  Dtype *coeff = coeff_.mutable_cpu_data();
+  const Dtype margin = qFunc_.margin_;
   Dtype loss(0.0);
-  num_constraints = 0.0;
-
-  Dtype margin = qFunc_.margin_;
-
-  for (int i = 0, j = 0; i < N; i += 4, j += 2) {
-    const Dtype *A = &origin[(i + 0) * S];
-    const Dtype *P = &origin[i * S + 1];
-    const Dtype *N1 = &origin[i * S + 2];
-    const Dtype *N2 = &origin[i * S + 3];
-    const Dtype *N11 = &generate[(j + 0) * S];
-    const Dtype *N22 = &generate[(j + 1) * S];
-
-    Dtype *diff_N11 = &diff[(j + 0) * S];
-    Dtype *diff_N22 = &diff[(j + 1) * S];
-
-    // for negative 1
-    caffe_sub(S, N11, A, helper_.mutable_cpu_data());
-    caffe_copy(S, helper_.cpu_data(), diff_N11);
-    this_loss = caffe_cpu_dot(S, helper_.cpu_data(), helper_.cpu_data());
-
-    caffe_sub(S, N11, N1, helper_.mutable_cpu_data());
-    caffe_add(S, diff_N11, helper_.cpu_data(), diff_N11);
-    this_loss += caffe_cpu_dot(S, helper_.cpu_data(), helper_.cpu_data());
-
-    caffe_sub(S, A, N11, helper_.mutable_cpu_data());
-    tmp = caffe_cpu_dot(S, helper_.cpu_data(), helper_.cpu_data());
-    tmp = tmp * (1 - qFunc_.call(label[i + 0], label[i + 2])) - margin;
-    tmp = std::max(Dtype(0), tmp);
-    if (tmp != 0) {
-      caffe_add(S, diff_N11, helper_.cpu_data(), diff_N11);
+  Dtype constraints(0.0);
+
+  // generated negative j replaces N1 (j even) or N2 (j odd) of quadruplet
+  // j / 2, and is pulled towards A or P respectively. Each negative is
+  // independent, so they are processed in parallel with a single pass over
+  // G, X and Y each.
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+ : loss, constraints)
+#endif
+  for (int j = 0; j < num_neg; ++j) {
+    const int x = (j / 2) * 4 + j % 2; // A or P
+    const int y = x + 2;               // N1 or N2
+    const Dtype *X = &origin[x * S];
+    const Dtype *Y = &origin[y * S];
+    const Dtype *G = &generate[j * S];
+    Dtype dist_x(0.0), dist_y(0.0);
+#ifdef _OPENMP
+#pragma omp simd reduction(+ : dist_x, dist_y)
+#endif
+    for (int k = 0; k < S; ++k) {
+      const Dtype g_x = G[k] - X[k];
+      const Dtype g_y = G[k] - Y[k];
+      dist_x += g_x * g_x;
+      dist_y += g_y * g_y;
     }
-    this_loss += tmp;
-
-    loss += this_loss;
-
-    // for negative 2
-    caffe_sub(S, N22, P, helper_.mutable_cpu_data());
-    caffe_copy(S, helper_.cpu_data(), diff_N22);
-    this_loss = caffe_cpu_dot(S, helper_.cpu_data(), helper_.cpu_data());
-
-    caffe_sub(S, N22, N2, helper_.mutable_cpu_data());
-    caffe_add(S, diff_N22, helper_.cpu_data(), diff_N22);
-    this_loss += caffe_cpu_dot(S, helper_.cpu_data(), helper_.cpu_data());
-
-    caffe_sub(S, P, N22, helper_.mutable_cpu_data());
-    tmp = caffe_cpu_dot(S, helper_.cpu_data(), helper_.cpu_data());
-    tmp = tmp * (1 - qFunc_.call(label[i + 1], label[i + 3])) - margin;
-    tmp = std::max(Dtype(0), tmp);
-    if (tmp != 0) {
-      caffe_add(S, diff_N22, helper_.cpu_data(), diff_N22);
+    loss += dist_x + dist_y;
+
+    const Dtype q = qFunc_.call(label[x], label[y]);
+    const Dtype tmp = dist_x * (1 - q) - margin;
+    // for backward: the hinge adds (1 - q) (G - X) to the gradient
+    coeff[j] = tmp > 0 ? 1 - q : Dtype(0);
+    if (tmp > 0) {
+      loss += tmp;
+      constraints += 1;
     }
-    this_loss += tmp;
   }
+  num_constraints = constraints;
   top[0]->mutable_cpu_data()[0] = loss;
 }
 
@@ -98,10 +103,30 @@ void GeneratorLossLayer<Dtype>::Backward_cpu(
     const vector<Blob<Dtype> *> &bottom) {
 
   if (propagate_down[2]) { // generate
-      const Dtype alpha = 2 * top[0]->cpu_diff()[0];
-      const int N = bottom[2]->num();
-      const int S = bottom[2]->channels() * bottom[2]->width() * bottom[2]->height();
-      caffe_cpu_scale(N * S, alpha, diff_.cpu_data(), bottom[2]->mutable_cpu_diff());
+    const Dtype alpha = 2 * top[0]->cpu_diff()[0];
+    const int num_neg = bottom[0]->num() / 2;
+    const int S = bottom[0]->count(1);
+    const Dtype *origin = bottom[0]->cpu_data();
+    const Dtype *generate = bottom[2]->cpu_data();
+    const Dtype *coeff = coeff_.cpu_data();
+    Dtype *generate_diff = bottom[2]->mutable_cpu_diff();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int j = 0; j < num_neg; ++j) {
+      const int x = (j / 2) * 4 + j % 2;
+      const Dtype *X = &origin[x * S];
+      const Dtype *Y = &origin[(x + 2) * S];
+      const Dtype *G = &generate[j * S];
+      Dtype *d_G = &generate_diff[j * S];
+      const Dtype beta = alpha * (1 + coeff[j]);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for (int k = 0; k < S; ++k) {
+        d_G[k] = beta * (G[k] - X[k]) + alpha * (G[k] - Y[k]);
+      }
+    }
   }
 }
 
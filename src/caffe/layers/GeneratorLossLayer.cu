@@ -0,0 +1,98 @@
+#include <vector>
+
+#include "caffe/layers/GeneratorLossLayer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Squared differences of each generated negative G against X (A or P) and
+// Y (N1 or N2), laid out as two rows of S elements per generated negative.
+template <typename Dtype>
+__global__ void GLForwardSq(const int count, const int S, const Dtype *origin,
+                            const Dtype *generate, Dtype *diff_sq) {
+  CUDA_KERNEL_LOOP(index, count) {
+    const int k = index % S;
+    const int row = index / S;
+    const int j = row / 2;
+    const int src = (j / 2) * 4 + j % 2 + 2 * (row % 2);
+    const Dtype d = generate[j * S + k] - origin[src * S + k];
+    diff_sq[index] = d * d;
+  }
+}
+
+template <typename Dtype>
+__global__ void GLForwardHinge(const int num_neg, const Dtype margin,
+                               const Dtype *dist_sq, const Dtype *q,
+                               Dtype *coeff, Dtype *neg_loss) {
+  CUDA_KERNEL_LOOP(j, num_neg) {
+    const Dtype tmp = dist_sq[2 * j] * (1 - q[j]) - margin;
+    coeff[j] = tmp > 0 ? 1 - q[j] : Dtype(0);
+    neg_loss[j] = dist_sq[2 * j] + dist_sq[2 * j + 1] + max(tmp, Dtype(0));
+  }
+}
+
+template <typename Dtype>
+void GeneratorLossLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype> *> &bottom,
+                                            const vector<Blob<Dtype> *> &top) {
+  const int num_neg = bottom[0]->num() / 2;
+  const int S = bottom[0]->count(1);
+  const Dtype *label = bottom[1]->cpu_data();
+  Dtype *q = q_.mutable_cpu_data();
+  for (int j = 0; j < num_neg; ++j) {
+    const int x = (j / 2) * 4 + j % 2;
+    q[j] = qFunc_.call(label[x], label[x + 2]);
+  }
+
+  const int count = diff_sq_.count();
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  GLForwardSq<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, S, bottom[0]->gpu_data(), bottom[2]->gpu_data(),
+      diff_sq_.mutable_gpu_data());
+  CUDA_POST_KERNEL_CHECK;
+  caffe_gpu_gemv(CblasNoTrans, num_neg * 2, S, Dtype(1.0),
+                 diff_sq_.gpu_data(), summer_vec_.gpu_data(), Dtype(0.0),
+                 dist_sq_.mutable_gpu_data());
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  GLForwardHinge<Dtype><<<CAFFE_GET_BLOCKS(num_neg), CAFFE_CUDA_NUM_THREADS>>>(
+      num_neg, qFunc_.margin_, dist_sq_.gpu_data(), q_.gpu_data(),
+      coeff_.mutable_gpu_data(), neg_loss_.mutable_gpu_data());
+  CUDA_POST_KERNEL_CHECK;
+  // every per-negative term is non-negative, so asum is the plain sum
+  Dtype loss;
+  caffe_gpu_asum(num_neg, neg_loss_.gpu_data(), &loss);
+  top[0]->mutable_cpu_data()[0] = loss;
+}
+
+template <typename Dtype>
+__global__ void GLBackward(const int count, const int S, const Dtype alpha,
+                           const Dtype *origin, const Dtype *generate,
+                           const Dtype *coeff, Dtype *generate_diff) {
+  CUDA_KERNEL_LOOP(index, count) {
+    const int k = index % S;
+    const int j = index / S;
+    const int x = (j / 2) * 4 + j % 2;
+    const Dtype g_x = generate[index] - origin[x * S + k];
+    const Dtype g_y = generate[index] - origin[(x + 2) * S + k];
+    generate_diff[index] = alpha * ((1 + coeff[j]) * g_x + g_y);
+  }
+}
+
+template <typename Dtype>
+void GeneratorLossLayer<Dtype>::Backward_gpu(
+    const vector<Blob<Dtype> *> &top, const vector<bool> &propagate_down,
+    const vector<Blob<Dtype> *> &bottom) {
+  if (propagate_down[2]) { // generate
+    const int count = bottom[2]->count();
+    const Dtype alpha = 2 * top[0]->cpu_diff()[0];
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    GLBackward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+        count, bottom[0]->count(1), alpha, bottom[0]->gpu_data(),
+        bottom[2]->gpu_data(), coeff_.gpu_data(),
+        bottom[2]->mutable_gpu_diff());
+    CUDA_POST_KERNEL_CHECK;
+  }
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(GeneratorLossLayer);
+
+} // namespace caffe
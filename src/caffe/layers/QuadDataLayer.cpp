@@ -0,0 +1,192 @@
+#include <stdint.h>
+
+#include <cstdlib>
+#include <vector>
+
+#include "caffe/layers/QuadDataLayer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+QuadDataLayer<Dtype>::QuadDataLayer(const LayerParameter &param)
+    : BasePrefetchingDataLayer<Dtype>(param) {
+  db_.reset(db::GetDB(param.data_param().backend()));
+  db_->Open(param.data_param().source(), db::READ);
+  cursor_.reset(db_->NewCursor());
+}
+
+template <typename Dtype>
+QuadDataLayer<Dtype>::~QuadDataLayer() {
+  this->StopInternalThread();
+}
+
+template <typename Dtype>
+void QuadDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype> *> &bottom,
+                                          const vector<Blob<Dtype> *> &top) {
+  const int batch_size = this->layer_param_.data_param().batch_size();
+  CHECK_EQ(batch_size % 4, 0)
+      << "The batch must be made of <A, P, N1, N2> quadruplets.";
+  const int age_margin = this->layer_param_.qfunction_param().age_margin();
+
+  // Index the records by age.
+  CPUTimer timer;
+  timer.Start();
+  keys_.clear();
+  records_by_age_.clear();
+  for (cursor_->SeekToFirst(); cursor_->valid(); cursor_->Next()) {
+    cursor_->ReadDatum(&datum_);
+    records_by_age_[datum_.label()].push_back(keys_.size());
+    keys_.push_back(cursor_->key());
+  }
+  ages_.clear();
+  anchor_ages_.clear();
+  for (map<int, vector<int> >::const_iterator it = records_by_age_.begin();
+       it != records_by_age_.end(); ++it) {
+    ages_.push_back(it->first);
+    if (it->second.size() > 1) {
+      anchor_ages_.push_back(it->first);
+    }
+  }
+  CHECK_GT(anchor_ages_.size(), 0) << "No age has two records to serve as "
+                                      "anchor and positive.";
+  CHECK_GE(ages_.size(), 3) << "Quadruplets need at least three ages.";
+  near_ages_.clear();
+  far_ages_.clear();
+  for (int i = 0; i < anchor_ages_.size(); ++i) {
+    const int anchor = anchor_ages_[i];
+    for (int j = 0; j < ages_.size(); ++j) {
+      const int gap = std::abs(ages_[j] - anchor);
+      if (gap == 0) {
+        continue;
+      }
+      (gap <= age_margin ? near_ages_ : far_ages_)[anchor].push_back(ages_[j]);
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Indexed " << keys_.size() << " records of " << ages_.size()
+      << " ages in " << timer.MilliSeconds() << " ms.";
+
+  // Use data_transformer to infer the expected blob shape from a datum.
+  ReadRecord(0, &datum_);
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum_);
+  this->transformed_data_.Reshape(top_shape);
+  top_shape[0] = batch_size;
+  top[0]->Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "output data size: " << top[0]->num() << "," << top[0]->channels()
+      << "," << top[0]->height() << "," << top[0]->width();
+  // label
+  if (this->output_labels_) {
+    vector<int> label_shape(1, batch_size);
+    top[1]->Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
+    }
+  }
+}
+
+template <typename Dtype>
+int QuadDataLayer<Dtype>::Sample(const vector<int> &v) const {
+  return v[caffe_rng_rand() % v.size()];
+}
+
+template <typename Dtype>
+int QuadDataLayer<Dtype>::SampleNegativeAge(const vector<int> &preferred,
+                                            int anchor_age,
+                                            int exclude_age) const {
+  vector<int> candidates;
+  for (int i = 0; i < preferred.size(); ++i) {
+    if (preferred[i] != exclude_age) {
+      candidates.push_back(preferred[i]);
+    }
+  }
+  if (candidates.empty()) {
+    for (int i = 0; i < ages_.size(); ++i) {
+      if (ages_[i] != anchor_age && ages_[i] != exclude_age) {
+        candidates.push_back(ages_[i]);
+      }
+    }
+  }
+  return Sample(candidates);
+}
+
+template <typename Dtype>
+void QuadDataLayer<Dtype>::ReadRecord(int record, Datum *datum) {
+  CHECK(cursor_->Seek(keys_[record])) << "Missing record " << keys_[record];
+  cursor_->ReadDatum(datum);
+}
+
+// This function is called on prefetch thread
+template <typename Dtype>
+void QuadDataLayer<Dtype>::load_batch(Batch<Dtype> *batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
+  double read_time = 0;
+  double trans_time = 0;
+  CPUTimer timer;
+  CHECK(batch->data_.count());
+  CHECK(this->transformed_data_.count());
+  const int batch_size = this->layer_param_.data_param().batch_size();
+  static const vector<int> no_ages;
+
+  int quad[4];
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    timer.Start();
+    if (item_id % 4 == 0) {
+      const int age = Sample(anchor_ages_);
+      const vector<int> &records = records_by_age_.find(age)->second;
+      // anchor and a distinct positive of the same age
+      const int a = caffe_rng_rand() % records.size();
+      const int p = (a + 1 + caffe_rng_rand() % (records.size() - 1)) %
+                    records.size();
+      quad[0] = records[a];
+      quad[1] = records[p];
+      map<int, vector<int> >::const_iterator near = near_ages_.find(age);
+      map<int, vector<int> >::const_iterator far = far_ages_.find(age);
+      const int n1_age = SampleNegativeAge(
+          near == near_ages_.end() ? no_ages : near->second, age, age);
+      const int n2_age = SampleNegativeAge(
+          far == far_ages_.end() ? no_ages : far->second, age, n1_age);
+      quad[2] = Sample(records_by_age_.find(n1_age)->second);
+      quad[3] = Sample(records_by_age_.find(n2_age)->second);
+    }
+    ReadRecord(quad[item_id % 4], &datum_);
+    read_time += timer.MicroSeconds();
+
+    if (item_id == 0) {
+      // Reshape according to the first datum of each batch
+      vector<int> top_shape = this->data_transformer_->InferBlobShape(datum_);
+      this->transformed_data_.Reshape(top_shape);
+      top_shape[0] = batch_size;
+      batch->data_.Reshape(top_shape);
+    }
+
+    // Apply data transformations (mirror, scale, crop...)
+    timer.Start();
+    int offset = batch->data_.offset(item_id);
+    Dtype *top_data = batch->data_.mutable_cpu_data();
+    this->transformed_data_.set_cpu_data(top_data + offset);
+    this->data_transformer_->Transform(datum_, &(this->transformed_data_));
+    // Copy label.
+    if (this->output_labels_) {
+      Dtype *top_label = batch->label_.mutable_cpu_data();
+      top_label[item_id] = datum_.label();
+    }
+    trans_time += timer.MicroSeconds();
+  }
+  timer.Stop();
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+}
+
+INSTANTIATE_CLASS(QuadDataLayer);
+REGISTER_LAYER_CLASS(QuadData);
+
+} // namespace caffe
@@ -11,11 +11,19 @@ void QuadExpandLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype> *> &bottom,
   CHECK_EQ(bottom[0]->width(), 1);
   CHECK_EQ(bottom[0]->height(), 1);
   CHECK_EQ(bottom[0]->num() % 4, 0);
+  view_ = this->layer_param_.quad_expand_param().mode() ==
+          QuadExpandParameter_Mode_VIEW;
 }
 
 template <typename Dtype>
 void QuadExpandLayer<Dtype>::Reshape(const vector<Blob<Dtype> *> &bottom,
                                      const vector<Blob<Dtype> *> &top) {
+  if (view_) {
+    top[0]->Reshape(bottom[0]->num() / 4, bottom[0]->channels() * 4,
+                    bottom[0]->height(), bottom[0]->width());
+    CHECK_EQ(top[0]->count(), bottom[0]->count());
+    return;
+  }
   top[0]->Reshape(bottom[0]->num() / 2, bottom[0]->channels() * 3,
                   bottom[0]->height(), bottom[0]->width());
 
@@ -29,13 +37,16 @@ void QuadExpandLayer<Dtype>::Reshape(const vector<Blob<Dtype> *> &bottom,
 template <typename Dtype>
 void QuadExpandLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype> *> &bottom,
                                          const vector<Blob<Dtype> *> &top) {
+  if (view_) {
+    top[0]->ShareData(*bottom[0]);
+    return;
+  }
   const Dtype *bottom_data = bottom[0]->cpu_data();
   Dtype *top_data = top[0]->mutable_cpu_data();
 
   int N = bottom[0]->num();
   int S = bottom[0]->channels() * bottom[0]->width() * bottom[0]->height();
 
-  int tK = top[0]->channels();
   int tS = top[0]->channels() * top[0]->width() * top[0]->height();
 
   // A refere to anchor, P refere to positive, N1 refere to negative 1, N2
@@ -46,14 +57,14 @@ void QuadExpandLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype> *> &bottom,
 
   for (int i = 0, j = 0; i < N; i += 4, j += 2) {
     // target N1
-    caffe_copy(S, &bottom_data[(i + 2) * S], &top_data[(j + 0) * tS + tK * 0]);
-    caffe_copy(S, &bottom_data[(i + 0) * S], &top_data[(j + 0) * tS + tK * 1]);
-    caffe_copy(S, &bottom_data[(i + 1) * S], &top_data[(j + 0) * tS + tK * 2]);
+    caffe_copy(S, &bottom_data[(i + 2) * S], &top_data[(j + 0) * tS + S * 0]);
+    caffe_copy(S, &bottom_data[(i + 0) * S], &top_data[(j + 0) * tS + S * 1]);
+    caffe_copy(S, &bottom_data[(i + 1) * S], &top_data[(j + 0) * tS + S * 2]);
 
     // target N2
-    caffe_copy(S, &bottom_data[(i + 3) * S], &top_data[(j + 1) * tS + tK * 0]);
-    caffe_copy(S, &bottom_data[(i + 0) * S], &top_data[(j + 1) * tS + tK * 1]);
-    caffe_copy(S, &bottom_data[(i + 1) * S], &top_data[(j + 1) * tS + tK * 2]);
+    caffe_copy(S, &bottom_data[(i + 3) * S], &top_data[(j + 1) * tS + S * 0]);
+    caffe_copy(S, &bottom_data[(i + 0) * S], &top_data[(j + 1) * tS + S * 1]);
+    caffe_copy(S, &bottom_data[(i + 1) * S], &top_data[(j + 1) * tS + S * 2]);
   }
 }
 
@@ -61,11 +72,14 @@ template <typename Dtype>
 void QuadExpandLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype> *> &top,
                                           const vector<bool> &propagate_down,
                                           const vector<Blob<Dtype> *> &bottom) {
+  if (view_) {
+    bottom[0]->ShareDiff(*top[0]);
+    return;
+  }
   if (propagate_down[0]) {
     int N = bottom[0]->num();
     int S = bottom[0]->channels() * bottom[0]->width() * bottom[0]->height();
 
-    int tK = top[0]->channels();
     int tS = top[0]->channels() * top[0]->width() * top[0]->height();
 
     Dtype *bottom_data = bottom[0]->mutable_cpu_diff();
@@ -73,14 +87,17 @@ void QuadExpandLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype> *> &top,
 
     for (int i = 0, j = 0; i < N; i += 4, j += 2) {
       // N1
-      caffe_copy(S, &top_data[(j + 0) * tS + tK * 0],
+      caffe_copy(S, &top_data[(j + 0) * tS + S * 0],
                  &bottom_data[(i + 2) * S]);
       // N2
-      caffe_copy(S, &top_data[(j + 1) * tS + tK * 0],
+      caffe_copy(S, &top_data[(j + 1) * tS + S * 0],
                  &bottom_data[(i + 3) * S]);
       // A
-      caffe_add(S, &top_data[(j + 0) * tS + tK * 1],
-                &top_data[(j + 1) * tS + tK * 1], &bottom_data[(i + 0) * S]);
+      caffe_add(S, &top_data[(j + 0) * tS + S * 1],
+                &top_data[(j + 1) * tS + S * 1], &bottom_data[(i + 0) * S]);
+      // P
+      caffe_add(S, &top_data[(j + 0) * tS + S * 2],
+                &top_data[(j + 1) * tS + S * 2], &bottom_data[(i + 1) * S]);
     }
   }
 }
@@ -0,0 +1,79 @@
+#include <vector>
+
+#include "caffe/layers/QuadExpandLayer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// One thread per top element: top row j holds <N, A, P> for negative j % 2
+// of quadruplet j / 2.
+template <typename Dtype>
+__global__ void QuadExpandForward(const int count, const int S,
+                                  const Dtype* bottom_data, Dtype* top_data) {
+  CUDA_KERNEL_LOOP(index, count) {
+    const int k = index % S;
+    const int seg = (index / S) % 3;
+    const int j = index / (3 * S);
+    const int quad = j / 2;
+    // seg 0: N1 or N2, seg 1: A, seg 2: P
+    const int src = seg == 0 ? 2 + j % 2 : seg - 1;
+    top_data[index] = bottom_data[(quad * 4 + src) * S + k];
+  }
+}
+
+template <typename Dtype>
+void QuadExpandLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+                                         const vector<Blob<Dtype>*>& top) {
+  if (view_) {
+    top[0]->ShareData(*bottom[0]);
+    return;
+  }
+  const int count = top[0]->count();
+  const int S = bottom[0]->count(1);
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  QuadExpandForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, S, bottom[0]->gpu_data(), top[0]->mutable_gpu_data());
+  CUDA_POST_KERNEL_CHECK;
+}
+
+// One thread per bottom element: A and P gather from both top rows of their
+// quadruplet, N1 and N2 from exactly one.
+template <typename Dtype>
+__global__ void QuadExpandBackward(const int count, const int S,
+                                   const Dtype* top_diff, Dtype* bottom_diff) {
+  CUDA_KERNEL_LOOP(index, count) {
+    const int k = index % S;
+    const int n = index / S;
+    const Dtype* row0 = top_diff + (n / 4) * 2 * 3 * S + k;
+    const Dtype* row1 = row0 + 3 * S;
+    switch (n % 4) {
+    case 0: bottom_diff[index] = row0[S] + row1[S]; break;
+    case 1: bottom_diff[index] = row0[2 * S] + row1[2 * S]; break;
+    case 2: bottom_diff[index] = row0[0]; break;
+    default: bottom_diff[index] = row1[0]; break;
+    }
+  }
+}
+
+template <typename Dtype>
+void QuadExpandLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (view_) {
+    bottom[0]->ShareDiff(*top[0]);
+    return;
+  }
+  if (!propagate_down[0]) {
+    return;
+  }
+  const int count = bottom[0]->count();
+  const int S = bottom[0]->count(1);
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  QuadExpandBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
+                              CAFFE_CUDA_NUM_THREADS>>>(
+      count, S, top[0]->gpu_diff(), bottom[0]->mutable_gpu_diff());
+  CUDA_POST_KERNEL_CHECK;
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(QuadExpandLayer);
+
+}  // namespace caffe
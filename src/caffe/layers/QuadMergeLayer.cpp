@@ -4,15 +4,26 @@ namespace caffe {
 
 template <typename Dtype> 
 void QuadMergeLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-    CHECK_EQ(bottom[0]->channels(), bottom[0]->channels());
+    CHECK_EQ(bottom[0]->channels(), bottom[1]->channels());
     CHECK_EQ(bottom[0]->width(), 1);
     CHECK_EQ(bottom[0]->height(), 1);
     CHECK_EQ(bottom[1]->width(), 1);
     CHECK_EQ(bottom[1]->height(), 1);
+    CHECK_EQ(bottom[0]->num() % 4, 0);
+    share_ = this->layer_param_.quad_merge_param().mode() ==
+             QuadMergeParameter_Mode_SHARE;
+    if (share_) {
+        CHECK_EQ(top[0], bottom[0]) << "In SHARE mode the top must be "
+                                       "computed in place of the original blob.";
+    }
 }
 
 template <typename Dtype>
 void QuadMergeLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+    // generate holds only the <N1', N2'> rows of each quadruplet: N/2 x C,
+    // the layout GeneratorLoss reads too
+    CHECK_EQ(bottom[0]->num(), bottom[1]->num() * 2)
+        << "Expected one generated row per N1 and N2 row.";
     vector<int> top_shape = bottom[0]->shape();
     top[0]->Reshape(top_shape);
     // top[0]->ShareData(*bottom[0]);
@@ -21,19 +32,28 @@ void QuadMergeLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom, const ve
 
 template <typename Dtype>
 void QuadMergeLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-    // bottom[0] original
-    // bottom[1] generate
+    // bottom[0] original, <A, P, N1, N2> rows
+    // bottom[1] generate, <N1', N2'> rows
     int N = bottom[0]->num();
     int S = bottom[0]->channels();
-    const Dtype* generate = bottom[1]->mutable_cpu_data();
-    const Dtype* original = bottom[0]->mutable_cpu_data();
+    if (share_) {
+        // A and P are already in place, N1 and N2 are contiguous
+        const Dtype* generate = bottom[1]->cpu_data();
+        Dtype* top_data = top[0]->mutable_cpu_data();
+        for (int i = 0; i < N; i += 4) {
+            caffe_copy(2 * S, &generate[(i / 2) * S], &top_data[(i + 2) * S]);
+        }
+        return;
+    }
+    const Dtype* generate = bottom[1]->cpu_data();
+    const Dtype* original = bottom[0]->cpu_data();
     Dtype* top_data = top[0]->mutable_cpu_data();
 
     for (int i = 0; i < N; i += 4) {
         const Dtype*   A  = &original[(i + 0) * S];
         const Dtype*   P  = &original[(i + 1) * S];
-        const Dtype*  N1  = &generate[(i + 2) * S];
-        const Dtype*  N2  = &generate[(i + 3) * S];
+        const Dtype*  N1  = &generate[(i / 2 + 0) * S];
+        const Dtype*  N2  = &generate[(i / 2 + 1) * S];
         Dtype* tA  = &top_data[(i + 0) * S];
         Dtype* tP  = &top_data[(i + 1) * S];
         Dtype* tN1 = &top_data[(i + 2) * S];
@@ -49,11 +69,35 @@ void QuadMergeLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom, cons
 template <typename Dtype>
 void QuadMergeLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    // A/P rows go back to the original blob, N1/N2 rows to the generated one
+    int N = bottom[0]->num();
+    int S = bottom[0]->channels();
+    if (share_) {
+        // move the N1/N2 diff out of the shared buffer: those rows of the
+        // original blob were overwritten and must get no gradient
+        Dtype* top_diff = top[0]->mutable_cpu_diff();
+        Dtype* bottom_diff = propagate_down[1] ? bottom[1]->mutable_cpu_diff() : NULL;
+        for (int i = 0; i < N; i += 4) {
+            if (bottom_diff) {
+                caffe_copy(2 * S, &top_diff[(i + 2) * S], &bottom_diff[(i / 2) * S]);
+            }
+            caffe_set(2 * S, Dtype(0), &top_diff[(i + 2) * S]);
+        }
+        return;
+    }
+    const Dtype* top_diff = top[0]->cpu_diff();
     if (propagate_down[0]) {
-        caffe_copy(bottom[0]->count(), top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
+        Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+        for (int i = 0; i < N; i += 4) {
+            caffe_copy(2 * S, &top_diff[i * S], &bottom_diff[i * S]);
+            caffe_set(2 * S, Dtype(0), &bottom_diff[(i + 2) * S]);
+        }
     }
     if (propagate_down[1]) {
-        caffe_copy(bottom[0]->count(), top[0]->cpu_diff(), bottom[1]->mutable_cpu_diff());
+        Dtype* bottom_diff = bottom[1]->mutable_cpu_diff();
+        for (int i = 0; i < N; i += 4) {
+            caffe_copy(2 * S, &top_diff[(i + 2) * S], &bottom_diff[(i / 2) * S]);
+        }
     }
 }
 
@@ -0,0 +1,109 @@
+#include <vector>
+
+#include "caffe/layers/QuadMergeLayer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Rows 0 and 1 of each quadruplet come from the original blob, rows 2 and 3
+// from the two rows the generated blob holds per quadruplet.
+template <typename Dtype>
+__global__ void QuadMergeForward(const int count, const int S,
+                                 const Dtype* original, const Dtype* generate,
+                                 Dtype* top_data) {
+  CUDA_KERNEL_LOOP(index, count) {
+    const int offset = index % (4 * S);
+    top_data[index] = offset < 2 * S ? original[index] :
+        generate[(index / (4 * S)) * 2 * S + offset - 2 * S];
+  }
+}
+
+// SHARE mode: one thread per generated element, copied into the shared top.
+template <typename Dtype>
+__global__ void QuadMergeShareForward(const int count, const int S,
+                                      const Dtype* generate, Dtype* top_data) {
+  CUDA_KERNEL_LOOP(index, count) {
+    // the N1 and N2 rows are the 2 * S trailing elements of every quadruplet
+    const int offset = (index / (2 * S)) * 4 * S + 2 * S + index % (2 * S);
+    top_data[offset] = generate[index];
+  }
+}
+
+template <typename Dtype>
+void QuadMergeLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+                                        const vector<Blob<Dtype>*>& top) {
+  if (share_) {
+    const int count = top[0]->count() / 2;
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    QuadMergeShareForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+                                   CAFFE_CUDA_NUM_THREADS>>>(
+        count, bottom[0]->count(1), bottom[1]->gpu_data(),
+        top[0]->mutable_gpu_data());
+    CUDA_POST_KERNEL_CHECK;
+    return;
+  }
+  const int count = top[0]->count();
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  QuadMergeForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, bottom[0]->count(1), bottom[0]->gpu_data(), bottom[1]->gpu_data(),
+      top[0]->mutable_gpu_data());
+  CUDA_POST_KERNEL_CHECK;
+}
+
+// Routes the A/P rows of the top diff back to the original blob and zeroes
+// its N1/N2 rows.
+template <typename Dtype>
+__global__ void QuadMergeOriginalBackward(const int count, const int S,
+                                          const Dtype* top_diff,
+                                          Dtype* original_diff) {
+  CUDA_KERNEL_LOOP(index, count) {
+    original_diff[index] =
+        index % (4 * S) < 2 * S ? top_diff[index] : Dtype(0);
+  }
+}
+
+// One thread per generated element: gathers the N1/N2 rows of the top diff,
+// and in SHARE mode zeroes them in the shared buffer.
+template <typename Dtype>
+__global__ void QuadMergeGenerateBackward(const int count, const int S,
+                                          const bool share, Dtype* top_diff,
+                                          Dtype* generate_diff) {
+  CUDA_KERNEL_LOOP(index, count) {
+    const int offset = (index / (2 * S)) * 4 * S + 2 * S + index % (2 * S);
+    if (generate_diff) {
+      generate_diff[index] = top_diff[offset];
+    }
+    if (share) {
+      top_diff[offset] = Dtype(0);
+    }
+  }
+}
+
+template <typename Dtype>
+void QuadMergeLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  const int S = bottom[0]->count(1);
+  if (propagate_down[0] && !share_) {
+    const int count = top[0]->count();
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    QuadMergeOriginalBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
+                                       CAFFE_CUDA_NUM_THREADS>>>(
+        count, S, top[0]->gpu_diff(), bottom[0]->mutable_gpu_diff());
+    CUDA_POST_KERNEL_CHECK;
+  }
+  // in SHARE mode the N1/N2 rows of the shared diff are zeroed even when
+  // the generated blob takes no gradient
+  if (propagate_down[1] || share_) {
+    const int count = bottom[1]->count();
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    QuadMergeGenerateBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
+                                       CAFFE_CUDA_NUM_THREADS>>>(
+        count, S, share_, top[0]->mutable_gpu_diff(),
+        propagate_down[1] ? bottom[1]->mutable_gpu_diff() : NULL);
+    CUDA_POST_KERNEL_CHECK;
+  }
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(QuadMergeLayer);
+
+}  // namespace caffe
@@ -1,4 +1,7 @@
+#include <algorithm>
+
 #include "caffe/layers/QuadrupletLossLayer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -12,125 +15,131 @@ void QuadrupletLossLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype> *> &bottom,
   CHECK_EQ(bottom[1]->height(), 1);
   CHECK_EQ(bottom[1]->width(), 1);
 
-  int N = bottom[0]->num();
-
-  diff_.Reshape(N / 4 * 3, bottom[0]->channels(), bottom[0]->height(),
-                bottom[0]->width());
-  helper_.Reshape(1, bottom[0]->channels(), bottom[0]->height(),
-                  bottom[0]->width());
-
   qFunc_.setup(this->layer_param_);
 }
 
+template <typename Dtype>
+void QuadrupletLossLayer<Dtype>::Reshape(const vector<Blob<Dtype> *> &bottom,
+                                         const vector<Blob<Dtype> *> &top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  CHECK_EQ(bottom[0]->num() % 4, 0)
+      << "The batch must be made of <A, P, N1, N2> quadruplets.";
+  const int num_quads = bottom[0]->num() / 4;
+  const int S = bottom[0]->count(1);
+  coeff_.Reshape(num_quads, 2, 1, 1);
+  // tmp storage for the gpu path; blobs only allocate memory once touched
+  q_.Reshape(num_quads, 2, 1, 1);
+  diff_sq_.Reshape(num_quads, 3, S, 1);
+  dist_sq_.Reshape(num_quads, 3, 1, 1);
+  quad_loss_.Reshape(num_quads, 1, 1, 1);
+  if (summer_vec_.count() != S) {
+    summer_vec_.Reshape(S, 1, 1, 1);
+    caffe_set(S, Dtype(1), summer_vec_.mutable_cpu_data());
+  }
+}
+
 template <typename Dtype>
 void QuadrupletLossLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) {
   // bottom[0] input
   // bottom[1] label
 
-  int N = bottom[0]->num(); // get the batch size
-  int S = bottom[0]->height() * bottom[0]->width() *
-          bottom[0]->channels(); // get each blob child size
+  const int N = bottom[0]->num(); // get the batch size
+  const int S = bottom[0]->count(1); // get each blob child size
   const Dtype *b_data = bottom[0]->cpu_data();
   const Dtype *label = bottom[1]->cpu_data();
+  Dtype *coeff = coeff_.mutable_cpu_data();
+  const Dtype margin = this->margin();
   Dtype loss(0.0);
-  Dtype loss_a_p(0.0);
-  Dtype loss_p_n2(0.0);
-  Dtype loss_a_n1(0.0);
-  Dtype q(0.0);
 
-  for (int i = 0; i < bottom[0]->num(); i += 4) {
+  for (int i = 0; i < N; i += 4) {
     CHECK_EQ(label[i + 0], label[i + 1]);
     CHECK_NE(label[i + 0], label[i + 2]);
     CHECK_NE(label[i + 1], label[i + 3]);
     CHECK_NE(label[i + 2], label[i + 3]);
   }
 
+  // One pass over each <A, P, N1, N2> computes all three squared distances;
+  // the differences themselves are recomputed in Backward instead of cached.
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+ : loss)
+#endif
   for (int i = 0; i < N; i += 4) {
     const Dtype *_A = &b_data[(i + 0) * S];
     const Dtype *_P = &b_data[(i + 1) * S];
     const Dtype *_N1 = &b_data[(i + 2) * S];
     const Dtype *_N2 = &b_data[(i + 3) * S];
-    Dtype *diff_A_N1 = &diff_.mutable_cpu_data()[(i + 0) * S];
-    Dtype *diff_P_N2 = &diff_.mutable_cpu_data()[(i + 1) * S];
-    Dtype *diff_A_P = &diff_.mutable_cpu_data()[(i + 2) * S];
-
-    caffe_sub(S, _A, _N1, diff_A_N1);
-    caffe_sub(S, _P, _N2, diff_P_N2);
-    caffe_sub(S, _A, _P, diff_A_P);
-
-    // compute: q of A N1
-    q = qFunc_.call(label[i + 0], label[i + 2]);
-    // compute: loss of A N1
-    loss_a_n1 = margin() - caffe_cpu_dot(S, diff_A_N1, diff_A_N1) * q;
-
-    // for backward
-    if (loss_a_n1 == 0) {
-      caffe_set(S, Dtype(0), diff_A_N1);
-    } else {
-      caffe_cpu_scale(S, q, diff_A_N1, diff_A_N1);
-    }
-
-    // compute: q of P N2
-    q = qFunc_.call(label[i + 1], label[i + 3]);
-    // compute: loss of P N2
-    loss_p_n2 = margin() - caffe_cpu_dot(S, diff_P_N2, diff_P_N2) * q;
-
-    // for backward
-    if (loss_a_n1 == 0) {
-      caffe_set(S, Dtype(0), diff_P_N2);
-    } else {
-      caffe_cpu_scale(S, q, diff_P_N2, diff_P_N2);
+    Dtype dist_a_p(0.0), dist_a_n1(0.0), dist_p_n2(0.0);
+#ifdef _OPENMP
+#pragma omp simd reduction(+ : dist_a_p, dist_a_n1, dist_p_n2)
+#endif
+    for (int k = 0; k < S; ++k) {
+      const Dtype a_p = _A[k] - _P[k];
+      const Dtype a_n1 = _A[k] - _N1[k];
+      const Dtype p_n2 = _P[k] - _N2[k];
+      dist_a_p += a_p * a_p;
+      dist_a_n1 += a_n1 * a_n1;
+      dist_p_n2 += p_n2 * p_n2;
     }
 
-    // compute: loss of A P
-    loss_a_p = caffe_cpu_dot(S, diff_A_P, diff_A_P);
+    const Dtype q1 = qFunc_.call(label[i + 0], label[i + 2]);
+    const Dtype q2 = qFunc_.call(label[i + 1], label[i + 3]);
+    const Dtype loss_a_n1 = margin - q1 * dist_a_n1;
+    const Dtype loss_p_n2 = margin - q2 * dist_p_n2;
 
-    // for backward
-    if (loss_a_n1 == 0) {
-      caffe_set(S, Dtype(0), diff_A_P);
-    } else {
-      caffe_cpu_scale(S, q, diff_A_P, diff_A_P);
-    }
+    // for backward: the hinge gates the gradient of each negative term
+    coeff[i / 2 + 0] = loss_a_n1 > 0 ? q1 : Dtype(0);
+    coeff[i / 2 + 1] = loss_p_n2 > 0 ? q2 : Dtype(0);
 
-    loss += loss_a_n1 + loss_p_n2 + loss_a_p;
+    loss += dist_a_p + std::max(loss_a_n1, Dtype(0)) +
+            std::max(loss_p_n2, Dtype(0));
   }
 
-  loss = loss / N;
-  top[0]->mutable_cpu_data()[0] = loss;
+  top[0]->mutable_cpu_data()[0] = loss / N;
 }
 
 template <typename Dtype>
 void QuadrupletLossLayer<Dtype>::Backward_cpu(
     const vector<Blob<Dtype> *> &top, const vector<bool> &propagate_down,
     const vector<Blob<Dtype> *> &bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
   if (propagate_down[0]) {
-    int N = bottom[0]->num();
-    int S = bottom[0]->height() * bottom[0]->width() *
-            bottom[0]->channels(); // get each blob child size
-    Dtype *b_data = bottom[0]->mutable_cpu_diff();
-    const Dtype *diff = diff_.cpu_data();
-    Dtype *helper = helper_.mutable_cpu_data();
+    const int N = bottom[0]->num();
+    const int S = bottom[0]->count(1); // get each blob child size
+    const Dtype *b_data = bottom[0]->cpu_data();
+    Dtype *b_diff = bottom[0]->mutable_cpu_diff();
+    const Dtype *coeff = coeff_.cpu_data();
+    const Dtype alpha = 2 * top[0]->cpu_diff()[0] / N;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
     for (int i = 0; i < N; i += 4) {
-      Dtype *_A = &b_data[(i + 0) * S];
-      Dtype *_P = &b_data[(i + 1) * S];
-      Dtype *_N1 = &b_data[(i + 2) * S];
-      Dtype *_N2 = &b_data[(i + 3) * S];
-      const Dtype *diff_A_N1 = &diff[(i + 0) * S];
-      const Dtype *diff_P_N2 = &diff[(i + 1) * S];
-      const Dtype *diff_A_P = &diff[(i + 2) * S];
-
-      Dtype alpha = 2 * top[0]->cpu_diff()[0];
-
-      caffe_sub(S, diff_A_P, diff_A_N1, helper);
-      caffe_cpu_scale(S, alpha, helper, _A);
-
-      caffe_sub(S, diff_A_P, diff_P_N2, helper);
-      caffe_cpu_scale(S, -alpha, helper, _P);
-
-      caffe_cpu_scale(S, alpha, diff_A_N1, _N1);
-
-      caffe_cpu_scale(S, alpha, diff_P_N2, _N2);
+      const Dtype *_A = &b_data[(i + 0) * S];
+      const Dtype *_P = &b_data[(i + 1) * S];
+      const Dtype *_N1 = &b_data[(i + 2) * S];
+      const Dtype *_N2 = &b_data[(i + 3) * S];
+      Dtype *d_A = &b_diff[(i + 0) * S];
+      Dtype *d_P = &b_diff[(i + 1) * S];
+      Dtype *d_N1 = &b_diff[(i + 2) * S];
+      Dtype *d_N2 = &b_diff[(i + 3) * S];
+      const Dtype c1 = alpha * coeff[i / 2 + 0];
+      const Dtype c2 = alpha * coeff[i / 2 + 1];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for (int k = 0; k < S; ++k) {
+        const Dtype a_p = _A[k] - _P[k];
+        const Dtype a_n1 = _A[k] - _N1[k];
+        const Dtype p_n2 = _P[k] - _N2[k];
+        d_A[k] = alpha * a_p - c1 * a_n1;
+        d_P[k] = -alpha * a_p - c2 * p_n2;
+        d_N1[k] = c1 * a_n1;
+        d_N2[k] = c2 * p_n2;
+      }
     }
   }
 }
@@ -142,4 +151,4 @@ STUB_GPU(QuadrupletLossLayer);
 INSTANTIATE_CLASS(QuadrupletLossLayer);
 REGISTER_LAYER_CLASS(QuadrupletLoss);
 
-} // namespace caffe
\ No newline at end of file
+} // namespace caffe
@@ -0,0 +1,119 @@
+#include <vector>
+
+#include "caffe/layers/QuadrupletLossLayer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Squared differences of the <A, P>, <A, N1> and <P, N2> pairs, laid out as
+// three rows of S elements per quadruplet.
+template <typename Dtype>
+__global__ void QLForwardSq(const int count, const int S, const Dtype *data,
+                            Dtype *diff_sq) {
+  CUDA_KERNEL_LOOP(index, count) {
+    const int k = index % S;
+    const int row = index / S;
+    const int pair = row % 3;
+    const Dtype *quad = data + (row / 3) * 4 * S;
+    // pair 0: A - P, pair 1: A - N1, pair 2: P - N2
+    const Dtype d = quad[(pair / 2) * S + k] - quad[(pair + 1) * S + k];
+    diff_sq[index] = d * d;
+  }
+}
+
+template <typename Dtype>
+__global__ void QLForwardHinge(const int num_quads, const Dtype margin,
+                               const Dtype *dist_sq, const Dtype *q,
+                               Dtype *coeff, Dtype *quad_loss) {
+  CUDA_KERNEL_LOOP(i, num_quads) {
+    const Dtype loss_a_n1 = margin - q[2 * i + 0] * dist_sq[3 * i + 1];
+    const Dtype loss_p_n2 = margin - q[2 * i + 1] * dist_sq[3 * i + 2];
+    coeff[2 * i + 0] = loss_a_n1 > 0 ? q[2 * i + 0] : Dtype(0);
+    coeff[2 * i + 1] = loss_p_n2 > 0 ? q[2 * i + 1] : Dtype(0);
+    quad_loss[i] = dist_sq[3 * i] + max(loss_a_n1, Dtype(0)) +
+                   max(loss_p_n2, Dtype(0));
+  }
+}
+
+template <typename Dtype>
+void QuadrupletLossLayer<Dtype>::Forward_gpu(
+    const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) {
+  const int N = bottom[0]->num();
+  const int S = bottom[0]->count(1);
+  const int num_quads = N / 4;
+  const Dtype *label = bottom[1]->cpu_data();
+  Dtype *q = q_.mutable_cpu_data();
+  for (int i = 0; i < N; i += 4) {
+    CHECK_EQ(label[i + 0], label[i + 1]);
+    CHECK_NE(label[i + 0], label[i + 2]);
+    CHECK_NE(label[i + 1], label[i + 3]);
+    CHECK_NE(label[i + 2], label[i + 3]);
+    q[i / 2 + 0] = qFunc_.call(label[i + 0], label[i + 2]);
+    q[i / 2 + 1] = qFunc_.call(label[i + 1], label[i + 3]);
+  }
+
+  const int count = diff_sq_.count();
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  QLForwardSq<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+      count, S, bottom[0]->gpu_data(), diff_sq_.mutable_gpu_data());
+  CUDA_POST_KERNEL_CHECK;
+  caffe_gpu_gemv(CblasNoTrans, num_quads * 3, S, Dtype(1.0),
+                 diff_sq_.gpu_data(), summer_vec_.gpu_data(), Dtype(0.0),
+                 dist_sq_.mutable_gpu_data());
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  QLForwardHinge<Dtype><<<CAFFE_GET_BLOCKS(num_quads),
+                          CAFFE_CUDA_NUM_THREADS>>>(
+      num_quads, margin(), dist_sq_.gpu_data(), q_.gpu_data(),
+      coeff_.mutable_gpu_data(), quad_loss_.mutable_gpu_data());
+  CUDA_POST_KERNEL_CHECK;
+  // every per-quadruplet term is non-negative, so asum is the plain sum
+  Dtype loss;
+  caffe_gpu_asum(num_quads, quad_loss_.gpu_data(), &loss);
+  top[0]->mutable_cpu_data()[0] = loss / N;
+}
+
+template <typename Dtype>
+__global__ void QLBackward(const int count, const int S, const Dtype alpha,
+                           const Dtype *data, const Dtype *coeff,
+                           Dtype *bottom_diff) {
+  CUDA_KERNEL_LOOP(index, count) {
+    const int k = index % S;
+    const int n = index / S;
+    const int quad = n / 4;
+    const Dtype *base = data + quad * 4 * S + k;
+    const Dtype a_p = base[0] - base[S];
+    const Dtype a_n1 = base[0] - base[2 * S];
+    const Dtype p_n2 = base[S] - base[3 * S];
+    const Dtype c1 = alpha * coeff[2 * quad + 0];
+    const Dtype c2 = alpha * coeff[2 * quad + 1];
+    switch (n % 4) {
+    case 0: bottom_diff[index] = alpha * a_p - c1 * a_n1; break;
+    case 1: bottom_diff[index] = -alpha * a_p - c2 * p_n2; break;
+    case 2: bottom_diff[index] = c1 * a_n1; break;
+    default: bottom_diff[index] = c2 * p_n2; break;
+    }
+  }
+}
+
+template <typename Dtype>
+void QuadrupletLossLayer<Dtype>::Backward_gpu(
+    const vector<Blob<Dtype> *> &top, const vector<bool> &propagate_down,
+    const vector<Blob<Dtype> *> &bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  if (propagate_down[0]) {
+    const int count = bottom[0]->count();
+    const Dtype alpha = 2 * top[0]->cpu_diff()[0] / bottom[0]->num();
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    QLBackward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+        count, bottom[0]->count(1), alpha, bottom[0]->gpu_data(),
+        coeff_.gpu_data(), bottom[0]->mutable_gpu_diff());
+    CUDA_POST_KERNEL_CHECK;
+  }
+}
+
+INSTANTIATE_LAYER_GPU_FUNCS(QuadrupletLossLayer);
+
+} // namespace caffe
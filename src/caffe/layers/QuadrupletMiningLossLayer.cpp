@@ -0,0 +1,210 @@
+#include <algorithm>
+
+#include "caffe/layers/QuadrupletMiningLossLayer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void QuadrupletMiningLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  CHECK_EQ(bottom[1]->count(), bottom[1]->num())
+      << "Expected one age label per sample.";
+
+  qFunc_.setup(this->layer_param_);
+  strategy_ = this->layer_param_.quadruplet_mining_param().strategy();
+}
+
+template <typename Dtype>
+void QuadrupletMiningLossLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  const int N = bottom[0]->num();
+  dist_.Reshape(N, N, 1, 1);
+  coeff_.Reshape(N, 2, 1, 1); // at most one quadruplet per anchor
+}
+
+template <typename Dtype>
+int QuadrupletMiningLossLayer<Dtype>::SelectNegative(
+    const int x, const int N, const Dtype *dist, const Dtype *label,
+    const Dtype exclude_label, const Dtype positive_dist) const {
+  int hard = -1, semi_hard = -1;
+  Dtype hard_dist(0), semi_hard_dist(0);
+  for (int j = 0; j < N; ++j) {
+    if (label[j] == label[x] || label[j] == exclude_label) {
+      continue;
+    }
+    const Dtype weighted = qFunc_.call(label[x], label[j]) * dist[x * N + j];
+    if (hard < 0 || weighted < hard_dist) {
+      hard = j;
+      hard_dist = weighted;
+    }
+    if (weighted > positive_dist &&
+        (semi_hard < 0 || weighted < semi_hard_dist)) {
+      semi_hard = j;
+      semi_hard_dist = weighted;
+    }
+  }
+  if (strategy_ == QuadrupletMiningParameter_Strategy_SEMI_HARD &&
+      semi_hard >= 0) {
+    return semi_hard;
+  }
+  return hard;
+}
+
+template <typename Dtype>
+void QuadrupletMiningLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top) {
+  // bottom[0] input
+  // bottom[1] label
+
+  const int N = bottom[0]->num();
+  const int S = bottom[0]->count(1);
+  const Dtype *b_data = bottom[0]->cpu_data();
+  const Dtype *label = bottom[1]->cpu_data();
+  Dtype *dist = dist_.mutable_cpu_data();
+
+  // ||x_i - x_j||^2 = <x_i, x_i> + <x_j, x_j> - 2 <x_i, x_j> from one Gram
+  // matrix
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, N, S, Dtype(1), b_data,
+                        b_data, Dtype(0), dist);
+  vector<Dtype> sq_norm(N);
+  for (int i = 0; i < N; ++i) {
+    sq_norm[i] = dist[i * N + i];
+  }
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < N; ++j) {
+      dist[i * N + j] =
+          std::max(sq_norm[i] + sq_norm[j] - 2 * dist[i * N + j], Dtype(0));
+    }
+  }
+
+  // one candidate quadruplet per anchor, compacted below so the mined order
+  // does not depend on the thread schedule
+  vector<int> candidates(4 * N, -1);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int a = 0; a < N; ++a) {
+    int p = -1;
+    for (int j = 0; j < N; ++j) {
+      if (j != a && label[j] == label[a] &&
+          (p < 0 || dist[a * N + j] > dist[a * N + p])) {
+        p = j;
+      }
+    }
+    if (p < 0) {
+      continue;
+    }
+    const Dtype positive_dist = dist[a * N + p];
+    const int n1 = SelectNegative(a, N, dist, label, label[a], positive_dist);
+    if (n1 < 0) {
+      continue;
+    }
+    const int n2 = SelectNegative(p, N, dist, label, label[n1], positive_dist);
+    if (n2 < 0) {
+      continue;
+    }
+    candidates[4 * a + 0] = a;
+    candidates[4 * a + 1] = p;
+    candidates[4 * a + 2] = n1;
+    candidates[4 * a + 3] = n2;
+  }
+  mined_.clear();
+  for (int a = 0; a < N; ++a) {
+    if (candidates[4 * a] >= 0) {
+      mined_.insert(mined_.end(), candidates.begin() + 4 * a,
+                    candidates.begin() + 4 * a + 4);
+    }
+  }
+
+  const int num_quads = mined_.size() / 4;
+  const int *mined = mined_.data();
+  Dtype *coeff = coeff_.mutable_cpu_data();
+  const Dtype margin = this->margin();
+  Dtype loss(0.0);
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+ : loss)
+#endif
+  for (int i = 0; i < num_quads; ++i) {
+    const int *quad = &mined[4 * i];
+    const Dtype *_A = &b_data[quad[0] * S];
+    const Dtype *_P = &b_data[quad[1] * S];
+    const Dtype *_N1 = &b_data[quad[2] * S];
+    const Dtype *_N2 = &b_data[quad[3] * S];
+    Dtype dist_a_p(0.0), dist_a_n1(0.0), dist_p_n2(0.0);
+    for (int k = 0; k < S; ++k) {
+      const Dtype a_p = _A[k] - _P[k];
+      const Dtype a_n1 = _A[k] - _N1[k];
+      const Dtype p_n2 = _P[k] - _N2[k];
+      dist_a_p += a_p * a_p;
+      dist_a_n1 += a_n1 * a_n1;
+      dist_p_n2 += p_n2 * p_n2;
+    }
+
+    const Dtype q1 = qFunc_.call(label[quad[0]], label[quad[2]]);
+    const Dtype q2 = qFunc_.call(label[quad[1]], label[quad[3]]);
+    const Dtype loss_a_n1 = margin - q1 * dist_a_n1;
+    const Dtype loss_p_n2 = margin - q2 * dist_p_n2;
+    coeff[2 * i + 0] = loss_a_n1 > 0 ? q1 : Dtype(0);
+    coeff[2 * i + 1] = loss_p_n2 > 0 ? q2 : Dtype(0);
+    loss += dist_a_p + std::max(loss_a_n1, Dtype(0)) +
+            std::max(loss_p_n2, Dtype(0));
+  }
+
+  top[0]->mutable_cpu_data()[0] =
+      num_quads > 0 ? loss / (4 * num_quads) : Dtype(0);
+}
+
+template <typename Dtype>
+void QuadrupletMiningLossLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype> *> &top, const vector<bool> &propagate_down,
+    const vector<Blob<Dtype> *> &bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  if (propagate_down[0]) {
+    const int S = bottom[0]->count(1);
+    const Dtype *b_data = bottom[0]->cpu_data();
+    Dtype *b_diff = bottom[0]->mutable_cpu_diff();
+    caffe_set(bottom[0]->count(), Dtype(0), b_diff);
+    const int num_quads = mined_.size() / 4;
+    if (num_quads == 0) {
+      return;
+    }
+    const Dtype *coeff = coeff_.cpu_data();
+    const Dtype alpha = 2 * top[0]->cpu_diff()[0] / (4 * num_quads);
+
+    // a sample can take part in several quadruplets, so the gradients are
+    // accumulated serially
+    for (int i = 0; i < num_quads; ++i) {
+      const int *quad = &mined_[4 * i];
+      const Dtype *_A = &b_data[quad[0] * S];
+      const Dtype *_P = &b_data[quad[1] * S];
+      const Dtype *_N1 = &b_data[quad[2] * S];
+      const Dtype *_N2 = &b_data[quad[3] * S];
+      Dtype *d_A = &b_diff[quad[0] * S];
+      Dtype *d_P = &b_diff[quad[1] * S];
+      Dtype *d_N1 = &b_diff[quad[2] * S];
+      Dtype *d_N2 = &b_diff[quad[3] * S];
+      const Dtype c1 = alpha * coeff[2 * i + 0];
+      const Dtype c2 = alpha * coeff[2 * i + 1];
+      for (int k = 0; k < S; ++k) {
+        const Dtype a_p = _A[k] - _P[k];
+        const Dtype a_n1 = _A[k] - _N1[k];
+        const Dtype p_n2 = _P[k] - _N2[k];
+        d_A[k] += alpha * a_p - c1 * a_n1;
+        d_P[k] += -alpha * a_p - c2 * p_n2;
+        d_N1[k] += c1 * a_n1;
+        d_N2[k] += c2 * p_n2;
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(QuadrupletMiningLossLayer);
+REGISTER_LAYER_CLASS(QuadrupletMiningLoss);
+
+} // namespace caffe
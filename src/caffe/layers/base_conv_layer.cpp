@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <vector>
 
+#include "boost/thread/tss.hpp"
+
 #include "caffe/filler.hpp"
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/util/im2col.hpp"
@@ -14,6 +16,26 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Configure the kernel size, padding, stride, and inputs.
   ConvolutionParameter conv_param = this->layer_param_.convolution_param();
   force_nd_im2col_ = conv_param.force_nd_im2col();
+  const QuantizationParameter& quantization_param =
+      this->layer_param_.quantization_param();
+  const QuantizationParameter_Precision precision =
+      quantization_param.precision();
+  int8_ = precision == QuantizationParameter_Precision_INT8;
+  int8_input_scale_ = quantization_param.input_scale();
+  half_ = precision == QuantizationParameter_Precision_FP16 ||
+      precision == QuantizationParameter_Precision_BF16;
+  half_format_ = precision == QuantizationParameter_Precision_BF16 ?
+      BlobProto_HalfFormat_BF16 : BlobProto_HalfFormat_FP16;
+  if (int8_ || half_) {
+    CHECK(!reverse_dimensions())
+        << QuantizationParameter_Precision_Name(precision)
+        << " precision is not supported by deconvolution.";
+  }
+  relu_ = conv_param.relu();
+  if (relu_) {
+    CHECK(!reverse_dimensions())
+        << "The fused ReLU is not supported by deconvolution.";
+  }
   channel_axis_ = bottom[0]->CanonicalAxisIndex(conv_param.axis());
   const int first_spatial_axis = channel_axis_ + 1;
   const int num_axes = bottom[0]->num_axes();
@@ -244,6 +266,23 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
   num_kernels_col2im_ = reverse_dimensions() ? top_dim_ : bottom_dim_;
+  conv_input_dim_ = reverse_dimensions() ? top_dim_ : bottom_dim_;
+  conv_output_dim_ = conv_out_channels_ * conv_out_spatial_dim_;
+  // Unroll as many images together as fit in the CPU workspace limit.
+  batch_size_ = 1;
+  const uint64_t workspace_limit =
+      this->layer_param_.convolution_param().cpu_workspace_limit();
+  if (workspace_limit > 0 && !force_nd_im2col_ && num_spatial_axes_ == 2) {
+    const uint64_t image_bytes = sizeof(Dtype) *
+        (static_cast<uint64_t>(col_offset_) * group_ + conv_output_dim_);
+    batch_size_ = std::max<uint64_t>(1,
+        std::min<uint64_t>(num_, workspace_limit / image_bytes));
+  }
+  if (batch_size_ > 1) {
+    vector<int> batch_buffer_shape(1, batch_size_);
+    batch_buffer_shape.push_back(col_offset_ * group_ + conv_output_dim_);
+    batch_buffer_.Reshape(batch_buffer_shape);
+  }
   // Set up the all ones "bias multiplier" for adding biases by BLAS
   out_spatial_dim_ = top[0]->count(first_spatial_axis);
   if (bias_term_) {
@@ -254,15 +293,26 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+Blob<Dtype>* BaseConvolutionLayer<Dtype>::SharedWorkspace() {
+  static boost::thread_specific_ptr<Blob<Dtype> > workspace;
+  if (!workspace.get()) {
+    workspace.reset(new Blob<Dtype>());
+  }
+  return workspace.get();
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    // col_buffer() may reshape the shared workspace: look it up once
+    Blob<Dtype>* col_blob = col_buffer();
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_blob->mutable_cpu_data());
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = col_blob->cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -272,6 +322,72 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_int8(const Dtype* input,
+    Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    Dtype* col_data = col_buffer()->mutable_cpu_data();
+    conv_im2col_cpu(input, col_data);
+    col_buff = col_data;
+  }
+  int8_weights_.Update(*this->blobs_[0], conv_out_channels_, kernel_dim_,
+      false);
+  const float scale = int8_input_scale_ > 0 ? int8_input_scale_ :
+      int8_scale(int8_absmax_cpu(conv_input_dim_, input));
+  // each group's columns become conv_out_spatial_dim_ rows of kernel_dim_
+  // values, so that the products run over contiguous int8 rows
+  int8_col_.resize(col_offset_ * group_);
+  int8_output_.resize(conv_output_dim_);
+  const int group_out_channels = conv_out_channels_ / group_;
+  for (int g = 0; g < group_; ++g) {
+    int8_quantize_transposed_cpu(kernel_dim_, conv_out_spatial_dim_,
+        col_buff + col_offset_ * g, scale, &int8_col_[col_offset_ * g]);
+    int8_gemm_cpu(group_out_channels, conv_out_spatial_dim_, kernel_dim_,
+        int8_weights_.data() + weight_offset_ * g, &int8_col_[col_offset_ * g],
+        &int8_output_[output_offset_ * g]);
+  }
+  const float* weight_scales = int8_weights_.scales();
+  for (int c = 0; c < conv_out_channels_; ++c) {
+    const Dtype output_scale = scale * weight_scales[c];
+    const int32_t* products = &int8_output_[c * conv_out_spatial_dim_];
+    Dtype* channel = output + c * conv_out_spatial_dim_;
+    for (int i = 0; i < conv_out_spatial_dim_; ++i) {
+      channel[i] = products[i] * output_scale;
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_half(const Dtype* input,
+    Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    Dtype* col_data = col_buffer()->mutable_cpu_data();
+    conv_im2col_cpu(input, col_data);
+    col_buff = col_data;
+  }
+  half_weights_.Update(*this->blobs_[0], half_format_, conv_out_channels_,
+      kernel_dim_, false);
+  // each group's columns become conv_out_spatial_dim_ rows of kernel_dim_
+  // values, so that the products run over contiguous rows, and the products
+  // are written transposed back to channels x pixels
+  half_col_.resize(col_offset_ * group_);
+  const int group_out_channels = conv_out_channels_ / group_;
+  for (int g = 0; g < group_; ++g) {
+    const Dtype* col = col_buff + col_offset_ * g;
+    Dtype* col_t = &half_col_[col_offset_ * g];
+    for (int k = 0; k < kernel_dim_; ++k) {
+      for (int i = 0; i < conv_out_spatial_dim_; ++i) {
+        col_t[i * kernel_dim_ + k] = col[k * conv_out_spatial_dim_ + i];
+      }
+    }
+    half_gemm_cpu(half_format_, conv_out_spatial_dim_, group_out_channels,
+        kernel_dim_, col_t, half_weights_.data() + weight_offset_ * g,
+        output + output_offset_ * g, true);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -280,10 +396,29 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
       (Dtype)1., output);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_epilogue(Dtype* output) {
+  if (!relu_) {
+    if (bias_term_) {
+      forward_cpu_bias(output, this->blobs_[1]->cpu_data());
+    }
+    return;
+  }
+  // One sweep over the output instead of a bias GEMM and a ReLU layer.
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int c = 0; c < num_output_; ++c) {
+    const Dtype b = bias ? bias[c] : Dtype(0);
+    Dtype* out = output + c * out_spatial_dim_;
+    for (int i = 0; i < out_spatial_dim_; ++i) {
+      out[i] = std::max(out[i] + b, Dtype(0));
+    }
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  Dtype* col_buff = col_buffer()->mutable_cpu_data();
   if (is_1x1_) {
     col_buff = input;
   }
@@ -303,8 +438,9 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    Dtype* col_data = col_buffer()->mutable_cpu_data();
+    conv_im2col_cpu(input, col_data);
+    col_buff = col_data;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -314,6 +450,66 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batch(const Dtype* input,
+    const Dtype* weights, Dtype* output, int num, bool skip_im2col) {
+  if (num == 1) {
+    forward_cpu_gemm(input, weights, output, skip_im2col);
+    return;
+  }
+  CHECK_LE(num, batch_size_);
+  // The columns of the num images are side by side, so each group takes one
+  // GEMM whose output holds the images side by side as well.
+  const int batch_spatial_dim = num * conv_out_spatial_dim_;
+  Dtype* col_buff = batch_buffer()->mutable_cpu_data();
+  Dtype* batch_output = col_buff + num * col_offset_ * group_;
+  if (!skip_im2col) {
+    conv_im2col_batch_cpu(input, num, col_buff);
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+        group_, batch_spatial_dim, kernel_dim_,
+        (Dtype)1., weights + weight_offset_ * g,
+        col_buff + col_offset_ * num * g,
+        (Dtype)0., batch_output + output_offset_ * num * g);
+  }
+  for (int c = 0; c < conv_out_channels_; ++c) {
+    for (int n = 0; n < num; ++n) {
+      caffe_copy(conv_out_spatial_dim_,
+          batch_output + (c * num + n) * conv_out_spatial_dim_,
+          output + n * conv_output_dim_ + c * conv_out_spatial_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm_batch(const Dtype* input,
+    const Dtype* output, Dtype* weights, int num) {
+  if (num == 1) {
+    weight_cpu_gemm(input, output, weights);
+    return;
+  }
+  CHECK_LE(num, batch_size_);
+  const int batch_spatial_dim = num * conv_out_spatial_dim_;
+  Dtype* col_buff = batch_buffer()->mutable_cpu_data();
+  Dtype* batch_output = col_buff + num * col_offset_ * group_;
+  conv_im2col_batch_cpu(input, num, col_buff);
+  for (int c = 0; c < conv_out_channels_; ++c) {
+    for (int n = 0; n < num; ++n) {
+      caffe_copy(conv_out_spatial_dim_,
+          output + n * conv_output_dim_ + c * conv_out_spatial_dim_,
+          batch_output + (c * num + n) * conv_out_spatial_dim_);
+    }
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
+        kernel_dim_, batch_spatial_dim,
+        (Dtype)1., batch_output + output_offset_ * num * g,
+        col_buff + col_offset_ * num * g,
+        (Dtype)1., weights + weight_offset_ * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
     const Dtype* input) {
@@ -328,10 +524,12 @@ void BaseConvolutionLayer<Dtype>::forward_gpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    // col_buffer() may reshape the shared workspace: look it up once
+    Blob<Dtype>* col_blob = col_buffer();
     if (!skip_im2col) {
-      conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
+      conv_im2col_gpu(input, col_blob->mutable_gpu_data());
     }
-    col_buff = col_buffer_.gpu_data();
+    col_buff = col_blob->gpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -352,7 +550,7 @@ void BaseConvolutionLayer<Dtype>::forward_gpu_bias(Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_gpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_gpu_data();
+  Dtype* col_buff = col_buffer()->mutable_gpu_data();
   if (is_1x1_) {
     col_buff = input;
   }
@@ -372,8 +570,9 @@ void BaseConvolutionLayer<Dtype>::weight_gpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
-    col_buff = col_buffer_.gpu_data();
+    Dtype* col_data = col_buffer()->mutable_gpu_data();
+    conv_im2col_gpu(input, col_data);
+    col_buff = col_data;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
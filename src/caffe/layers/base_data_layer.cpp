@@ -7,7 +7,9 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -37,11 +39,14 @@ BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
       prefetch_(param.data_param().prefetch()),
-      prefetch_free_(), prefetch_full_(), prefetch_current_() {
+      prefetch_free_(), prefetch_full_(), prefetch_current_(),
+      prefetch_shrink_(false), window_iter_() {
   for (int i = 0; i < prefetch_.size(); ++i) {
     prefetch_[i].reset(new Batch<Dtype>());
     prefetch_free_.push(prefetch_[i].get());
   }
+  stats_.depth = prefetch_.size();
+  window_start_ = stats_;
 }
 
 template <typename Dtype>
@@ -85,8 +90,17 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 
   try {
+    CPUTimer timer;
     while (!must_stop()) {
-      Batch<Dtype>* batch = prefetch_free_.pop();
+      Batch<Dtype>* batch;
+      if (prefetch_free_.try_pop(&batch)) {
+        batch->wait_ms_ = 0;
+      } else {
+        timer.Start();
+        batch = prefetch_free_.pop();
+        batch->wait_ms_ = timer.MilliSeconds();
+      }
+      const int64_t profile_start = Profiler::enabled() ? Profiler::Now() : 0;
       load_batch(batch);
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
@@ -97,6 +111,12 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
 #endif
+      if (Profiler::enabled()) {
+        const int count = batch->data_.count() +
+            (this->output_labels_ ? batch->label_.count() : 0);
+        Profiler::Get().Record(this->layer_param_.name(), "prefetch",
+            profile_start, static_cast<double>(count) * sizeof(Dtype), 0);
+      }
       prefetch_full_.push(batch);
     }
   } catch (boost::thread_interrupted&) {
@@ -110,12 +130,98 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 }
 
 template <typename Dtype>
-void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
-    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  if (prefetch_current_) {
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::NextBatch() {
+  prefetch_retired_.reset();
+  if (prefetch_current_ && prefetch_shrink_) {
+    // Take the batch out of circulation; it is freed once the tops have
+    // moved on to the next one.
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      if (prefetch_[i].get() == prefetch_current_) {
+        prefetch_retired_ = prefetch_[i];
+        prefetch_.erase(prefetch_.begin() + i);
+        break;
+      }
+    }
+    prefetch_shrink_ = false;
+    stats_.depth = prefetch_.size();
+  } else if (prefetch_current_) {
     prefetch_free_.push(prefetch_current_);
   }
-  prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  Batch<Dtype>* batch;
+  if (!prefetch_full_.try_pop(&batch)) {
+    CPUTimer timer;
+    timer.Start();
+    batch = prefetch_full_.pop("Waiting for data");
+    ++stats_.consumer_stalls;
+    stats_.consumer_wait_ms += timer.MilliSeconds();
+  }
+  if (batch->wait_ms_ > 0) {
+    ++stats_.producer_stalls;
+    stats_.producer_wait_ms += batch->wait_ms_;
+  }
+  // The previous batch may already be in load_batch again: from here on,
+  // only the new current batch is safe to read on this thread.
+  prefetch_current_ = batch;
+  AdaptPrefetch();
+  return batch;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::AdaptPrefetch() {
+  const DataParameter& param = this->layer_param_.data_param();
+  const int min_depth = param.prefetch();
+  const int max_depth = param.max_prefetch();
+  if (max_depth <= min_depth ||
+      ++window_iter_ < param.prefetch_adapt_interval()) {
+    return;
+  }
+  const int depth = stats_.depth;
+  const uint64_t consumer_stalls =
+      stats_.consumer_stalls - window_start_.consumer_stalls;
+  const uint64_t producer_stalls =
+      stats_.producer_stalls - window_start_.producer_stalls;
+  if (consumer_stalls > 0 && stats_.depth < max_depth) {
+    // The net waited for data: buffer one more batch to absorb the
+    // variations of the loading time.
+    shared_ptr<Batch<Dtype> > batch(new Batch<Dtype>());
+    batch->data_.ReshapeLike(prefetch_current_->data_);
+    batch->data_.mutable_cpu_data();
+    if (this->output_labels_) {
+      batch->label_.ReshapeLike(prefetch_current_->label_);
+      batch->label_.mutable_cpu_data();
+    }
+#ifndef CPU_ONLY
+    if (Caffe::mode() == Caffe::GPU) {
+      batch->data_.mutable_gpu_data();
+      if (this->output_labels_) {
+        batch->label_.mutable_gpu_data();
+      }
+    }
+#endif
+    prefetch_.push_back(batch);
+    prefetch_free_.push(batch.get());
+    stats_.depth = prefetch_.size();
+  } else if (consumer_stalls == 0 && producer_stalls > window_iter_ / 2 &&
+             stats_.depth > min_depth) {
+    // The prefetch thread is mostly idle: give a batch back at the next
+    // forward pass.
+    prefetch_shrink_ = true;
+  }
+  if (stats_.depth != depth || prefetch_shrink_) {
+    LOG_IF(INFO, Caffe::root_solver())
+        << this->layer_param_.name() << " prefetch depth " << depth << " -> "
+        << (prefetch_shrink_ ? stats_.depth - 1 : stats_.depth)
+        << " (net waited " << consumer_stalls << " times, prefetch thread "
+        << producer_stalls << " times in " << window_iter_ << " iterations)";
+  }
+  window_iter_ = 0;
+  window_start_ = stats_;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  prefetch_current_ = NextBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
   top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
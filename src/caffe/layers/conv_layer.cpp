@@ -1,9 +1,25 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/depthwise_conv.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  BaseConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  depthwise_ = this->num_spatial_axes_ == 2 && !this->force_nd_im2col_ &&
+      this->group_ > 1 && this->group_ == this->channels_ &&
+      this->group_ == this->num_output_;
+}
+
+template <typename Dtype>
+int ConvolutionLayer<Dtype>::workspace_count() const {
+  return depthwise_ ? 0 : BaseConvolutionLayer<Dtype>::workspace_count();
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::compute_output_shape() {
   const int* kernel_shape_data = this->kernel_shape_.cpu_data();
@@ -25,15 +41,42 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+    if (this->int8_) {
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_int8(bottom_data + n * this->bottom_dim_,
+            top_data + n * this->top_dim_);
+      }
+    } else if (this->half_) {
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_half(bottom_data + n * this->bottom_dim_,
+            top_data + n * this->top_dim_);
+      }
+    } else if (depthwise_) {
+      for (int n = 0; n < this->num_; ++n) {
+        depthwise_conv_cpu(bottom_data + n * this->bottom_dim_,
+            this->channels_, this->input_shape(1), this->input_shape(2),
+            kernel_shape_data[0], kernel_shape_data[1], pad_data[0],
+            pad_data[1], stride_data[0], stride_data[1], dilation_data[0],
+            dilation_data[1], this->output_shape_[0], this->output_shape_[1],
+            weight, top_data + n * this->top_dim_);
+      }
+    } else {
+      for (int n = 0; n < this->num_; n += this->batch_size_) {
+        const int batch = std::min(this->batch_size_, this->num_ - n);
+        this->forward_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+            weight, top_data + n * this->top_dim_, batch);
+      }
+    }
+    if (this->bias_term_ || this->relu_) {
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_epilogue(top_data + n * this->top_dim_);
       }
     }
   }
@@ -42,8 +85,13 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!this->relu_) << "Backward of the fused ReLU is not implemented.";
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
@@ -55,19 +103,44 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
       }
     }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
+    if (depthwise_) {
       for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
         if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
+          depthwise_conv_backward_weight_cpu(
+              bottom_data + n * this->bottom_dim_,
+              top_diff + n * this->top_dim_, this->channels_,
+              this->input_shape(1), this->input_shape(2),
+              kernel_shape_data[0], kernel_shape_data[1], pad_data[0],
+              pad_data[1], stride_data[0], stride_data[1], dilation_data[0],
+              dilation_data[1], this->output_shape_[0],
+              this->output_shape_[1], weight_diff);
         }
-        // gradient w.r.t. bottom data, if necessary.
         if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+          depthwise_conv_backward_data_cpu(top_diff + n * this->top_dim_,
+              this->channels_, this->input_shape(1), this->input_shape(2),
+              kernel_shape_data[0], kernel_shape_data[1], pad_data[0],
+              pad_data[1], stride_data[0], stride_data[1], dilation_data[0],
+              dilation_data[1], this->output_shape_[0],
+              this->output_shape_[1], weight,
               bottom_diff + n * this->bottom_dim_);
         }
       }
+      continue;
+    }
+    // gradient w.r.t. weight. Note that we will accumulate diffs.
+    if (this->param_propagate_down_[0]) {
+      for (int n = 0; n < this->num_; n += this->batch_size_) {
+        const int batch = std::min(this->batch_size_, this->num_ - n);
+        this->weight_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_, weight_diff, batch);
+      }
+    }
+    // gradient w.r.t. bottom data, if necessary.
+    if (propagate_down[i]) {
+      for (int n = 0; n < this->num_; ++n) {
+        this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+            bottom_diff + n * this->bottom_dim_);
+      }
     }
   }
 }
@@ -3,6 +3,9 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
@@ -31,7 +34,7 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int batch_size = this->layer_param_.data_param().batch_size();
   // Read a data point, and use it to initialize the top blob.
   Datum datum;
-  datum.ParseFromString(cursor_->value());
+  cursor_->ReadDatum(&datum);
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
@@ -46,6 +49,25 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
       << top[0]->width();
+  // transform workers
+  const int threads = this->layer_param_.data_param().transform_threads();
+  CHECK_GT(threads, 0) << "transform_threads must be positive.";
+  datums_.resize(batch_size);
+  worker_transformers_.clear();
+  worker_transformed_.clear();
+  worker_transformers_.push_back(this->data_transformer_);
+  for (int i = 1; i < threads; ++i) {
+    worker_transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+    worker_transformers_.back()->InitRand();
+  }
+  for (int i = 0; i < threads; ++i) {
+    worker_transformed_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  transform_pool_.reset();
+  if (threads > 1) {
+    transform_pool_.reset(new ThreadPool(threads - 1));
+  }
   // label
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
@@ -77,6 +99,26 @@ void DataLayer<Dtype>::Next() {
   offset_++;
 }
 
+template<typename Dtype>
+void DataLayer<Dtype>::TransformItems(Dtype* top_data, int item_size,
+    Dtype* top_label, int worker) {
+  const int batch_size = datums_.size();
+  const int threads = worker_transformers_.size();
+  Blob<Dtype>* transformed = worker_transformed_[worker].get();
+  DataTransformer<Dtype>* transformer = worker_transformers_[worker].get();
+  // A fixed item to worker assignment keeps the random crops and mirrors
+  // reproducible for a given seed and worker count.
+  for (int item_id = worker; item_id < batch_size; item_id += threads) {
+    // Apply data transformations (mirror, scale, crop...)
+    transformed->set_cpu_data(top_data + item_id * item_size);
+    transformer->Transform(datums_[item_id], transformed);
+    // Copy label.
+    if (top_label) {
+      top_label[item_id] = datums_[item_id].label();
+    }
+  }
+}
+
 // This function is called on prefetch thread
 template<typename Dtype>
 void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
@@ -89,40 +131,52 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(this->transformed_data_.count());
   const int batch_size = this->layer_param_.data_param().batch_size();
 
-  Datum datum;
+  // Read the batch serially, so the cursor, and with it the item order and
+  // the Skip() sharding, is the same for any number of workers.
+  timer.Start();
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
     while (Skip()) {
       Next();
     }
-    datum.ParseFromString(cursor_->value());
-    read_time += timer.MicroSeconds();
-
-    if (item_id == 0) {
-      // Reshape according to the first datum of each batch
-      // on single input batches allows for inputs of varying dimension.
-      // Use data_transformer to infer the expected blob shape from datum.
-      vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-      this->transformed_data_.Reshape(top_shape);
-      // Reshape batch according to the batch_size.
-      top_shape[0] = batch_size;
-      batch->data_.Reshape(top_shape);
-    }
+    cursor_->ReadDatum(&datums_[item_id]);
+    Next();
+  }
+  // Reshape according to the first datum of each batch
+  // on single input batches allows for inputs of varying dimension.
+  // Use data_transformer to infer the expected blob shape from datum.
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(datums_[0]);
+  this->transformed_data_.Reshape(top_shape);
+  for (int i = 0; i < worker_transformed_.size(); ++i) {
+    worker_transformed_[i]->Reshape(top_shape);
+  }
+  // Reshape batch according to the batch_size.
+  top_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+  read_time += timer.MicroSeconds();
 
-    // Apply data transformations (mirror, scale, crop...)
-    timer.Start();
-    int offset = batch->data_.offset(item_id);
-    Dtype* top_data = batch->data_.mutable_cpu_data();
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      Dtype* top_label = batch->label_.mutable_cpu_data();
-      top_label[item_id] = datum.label();
+  // Decode and transform the items into their slots of the batch.
+  timer.Start();
+  // Resolve the batch memory here, on the prefetch thread: the first call
+  // after a Reshape allocates it, and in GPU mode moves the head to the CPU.
+  Dtype* top_data = batch->data_.mutable_cpu_data();
+  Dtype* top_label = this->output_labels_ ?
+      batch->label_.mutable_cpu_data() : NULL;
+  const int item_size = batch->data_.count(1);
+  const int threads = std::min<int>(worker_transformers_.size(), batch_size);
+  if (threads == 1) {
+    TransformItems(top_data, item_size, top_label, 0);
+  } else {
+    // The workers write into the batch, so they are always waited for, even
+    // if the prefetch thread is asked to stop in the meantime.
+    boost::this_thread::disable_interruption no_interruption;
+    for (int i = 1; i < threads; ++i) {
+      transform_pool_->Run(boost::bind(&DataLayer<Dtype>::TransformItems,
+          this, top_data, item_size, top_label, i));
     }
-    trans_time += timer.MicroSeconds();
-    Next();
+    TransformItems(top_data, item_size, top_label, 0);
+    transform_pool_->Wait();
   }
+  trans_time += timer.MicroSeconds();
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
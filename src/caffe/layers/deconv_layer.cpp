@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/deconv_layer.hpp"
@@ -56,17 +57,18 @@ void DeconvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       }
     }
     if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
+      for (int n = 0; n < this->num_; n += this->batch_size_) {
+        const int batch = std::min(this->batch_size_, this->num_ - n);
         // Gradient w.r.t. weight. Note that we will accumulate diffs.
         if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(top_diff + n * this->top_dim_,
-              bottom_data + n * this->bottom_dim_, weight_diff);
+          this->weight_cpu_gemm_batch(top_diff + n * this->top_dim_,
+              bottom_data + n * this->bottom_dim_, weight_diff, batch);
         }
         // Gradient w.r.t. bottom data, if necessary, reusing the column buffer
         // we might have just computed above.
         if (propagate_down[i]) {
-          this->forward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_,
+          this->forward_cpu_gemm_batch(top_diff + n * this->top_dim_, weight,
+              bottom_diff + n * this->bottom_dim_, batch,
               this->param_propagate_down_[0]);
         }
       }
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/util/direct_conv.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  CHECK_EQ(this->num_spatial_axes_, 2)
+      << "The DIRECT engine supports 2D convolution only.";
+  CHECK_EQ(this->group_, 1)
+      << "The DIRECT engine does not support grouped convolution.";
+  CHECK(!this->int8_ && !this->half_)
+      << QuantizationParameter_Precision_Name(
+      this->layer_param_.quantization_param().precision())
+      << " precision is not supported by the DIRECT engine.";
+  weights_valid_ = false;
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  const int* pad_data = this->pad_.cpu_data();
+  padded_h_ = this->input_shape(1) + 2 * pad_data[0];
+  padded_w_ = this->input_shape(2) + 2 * pad_data[1];
+  // A blocked bottom is read in place unless it needs padding, and a
+  // blocked top is written in place.
+  bool pack_input = false;
+  bool unpack_output = false;
+  for (int i = 0; i < bottom.size(); ++i) {
+    pack_input = pack_input || !bottom[i]->blocked() || pad_data[0] > 0 ||
+        pad_data[1] > 0;
+    unpack_output = unpack_output || !top[i]->blocked();
+  }
+  packed_input_count_ = !pack_input ? 0 : direct_conv_blocks(this->channels_)
+      * padded_h_ * padded_w_ * kDirectConvBlock;
+  packed_output_count_ = !unpack_output ? 0 :
+      direct_conv_blocks(this->num_output_) * this->output_shape_[0] *
+      this->output_shape_[1] * kDirectConvBlock;
+}
+
+template <typename Dtype>
+int DirectConvolutionLayer<Dtype>::workspace_count() const {
+  return std::max(ConvolutionLayer<Dtype>::workspace_count(),
+      packed_input_count_ + packed_output_count_);
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::UpdateWeights() {
+  const Blob<Dtype>& weights = *this->blobs_[0];
+  if (weights_valid_ && memcmp(source_weights_.cpu_data(), weights.cpu_data(),
+      weights.count() * sizeof(Dtype)) == 0) {
+    return;
+  }
+  source_weights_.CopyFrom(weights, false, true);
+  vector<int> packed_shape(1, direct_conv_blocks(this->num_output_));
+  packed_shape.push_back(direct_conv_blocks(this->channels_));
+  packed_shape.push_back(weights.count(2) * kDirectConvBlock *
+      kDirectConvBlock);
+  packed_weights_.Reshape(packed_shape);
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  direct_conv_pack_weights_cpu(weights.cpu_data(), this->num_output_,
+      this->channels_, kernel_shape_data[0], kernel_shape_data[1],
+      packed_weights_.mutable_cpu_data());
+  weights_valid_ = true;
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  UpdateWeights();
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  Blob<Dtype>* workspace = this->share_workspace_ ?
+      BaseConvolutionLayer<Dtype>::SharedWorkspace() : &workspace_;
+  workspace->Reshape(vector<int>(1,
+      packed_input_count_ + packed_output_count_));
+  Dtype* packed_input = workspace->mutable_cpu_data();
+  Dtype* packed_output = packed_input + packed_input_count_;
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    const bool blocked_bottom = bottom[i]->blocked();
+    const bool blocked_top = top[i]->blocked();
+    const int bottom_dim = blocked_bottom ?
+        bottom[i]->data_count() / this->num_ : this->bottom_dim_;
+    const int top_dim = blocked_top ?
+        top[i]->data_count() / this->num_ : this->top_dim_;
+    for (int n = 0; n < this->num_; ++n) {
+      const Dtype* input = bottom_data + n * bottom_dim;
+      if (!blocked_bottom) {
+        direct_conv_pack_input_cpu(input, this->channels_,
+            this->input_shape(1), this->input_shape(2), pad_data[0],
+            pad_data[1], packed_input);
+        input = packed_input;
+      } else if (pad_data[0] > 0 || pad_data[1] > 0) {
+        direct_conv_pad_input_cpu(input, this->channels_,
+            this->input_shape(1), this->input_shape(2), pad_data[0],
+            pad_data[1], packed_input);
+        input = packed_input;
+      }
+      Dtype* output = blocked_top ? top_data + n * top_dim : packed_output;
+      direct_conv_cpu(input, this->channels_, padded_h_, padded_w_,
+          packed_weights_.cpu_data(), this->num_output_,
+          kernel_shape_data[0], kernel_shape_data[1], stride_data[0],
+          stride_data[1], dilation_data[0], dilation_data[1],
+          this->output_shape_[0], this->output_shape_[1], output);
+      if (blocked_top) {
+        direct_conv_bias_cpu(bias, this->num_output_, this->out_spatial_dim_,
+            this->relu_, output);
+      } else {
+        direct_conv_unpack_cpu(packed_output, this->num_output_,
+            this->output_shape_[0], this->output_shape_[1],
+            top_data + n * top_dim);
+        this->forward_cpu_epilogue(top_data + n * top_dim);
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DirectConvolutionLayer);
+
+}  // namespace caffe
@@ -12,6 +12,14 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
   transpose_ = this->layer_param_.inner_product_param().transpose();
+  const QuantizationParameter_Precision precision =
+      this->layer_param_.quantization_param().precision();
+  int8_ = precision == QuantizationParameter_Precision_INT8;
+  int8_input_scale_ = this->layer_param_.quantization_param().input_scale();
+  half_ = precision == QuantizationParameter_Precision_FP16 ||
+      precision == QuantizationParameter_Precision_BF16;
+  half_format_ = precision == QuantizationParameter_Precision_BF16 ?
+      BlobProto_HalfFormat_BF16 : BlobProto_HalfFormat_FP16;
   N_ = num_output;
   const int axis = bottom[0]->CanonicalAxisIndex(
       this->layer_param_.inner_product_param().axis());
@@ -86,9 +94,31 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  if (int8_) {
+    int8_weights_.Update(*this->blobs_[0], N_, K_, transpose_);
+    const float scale = int8_input_scale_ > 0 ? int8_input_scale_ :
+        int8_scale(int8_absmax_cpu(M_ * K_, bottom_data));
+    int8_input_.resize(M_ * K_);
+    int8_output_.resize(M_ * N_);
+    int8_quantize_cpu(M_ * K_, bottom_data, scale, &int8_input_[0]);
+    int8_gemm_cpu(M_, N_, K_, &int8_input_[0], int8_weights_.data(),
+        &int8_output_[0]);
+    const float* weight_scales = int8_weights_.scales();
+    for (int m = 0; m < M_; ++m) {
+      for (int n = 0; n < N_; ++n) {
+        top_data[m * N_ + n] = int8_output_[m * N_ + n] * scale *
+            weight_scales[n];
+      }
+    }
+  } else if (half_) {
+    half_weights_.Update(*this->blobs_[0], half_format_, N_, K_, transpose_);
+    half_gemm_cpu(half_format_, M_, N_, K_, bottom_data,
+        half_weights_.data(), top_data, false);
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
@@ -140,6 +140,10 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (bottom[0]->blocked()) {
+    Forward_cpu_blocked(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int top_count = top[0]->count();
@@ -239,6 +243,54 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void PoolingLayer<Dtype>::Forward_cpu_blocked(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  CHECK(top[0]->blocked());
+  const int B = kBlobChannelBlock;
+  const bool max_pool = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  const int blocks = bottom[0]->num() * ((channels_ + B - 1) / B);
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  // The windows and pool sizes are those of the NCHW loops above; the zero
+  // channels padding the last block pool to zero.
+  for (int b = 0; b < blocks; ++b) {
+    const Dtype* plane = bottom_data + b * height_ * width_ * B;
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        const int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        Dtype* out = top_data +
+            ((b * pooled_height_ + ph) * pooled_width_ + pw) * B;
+        for (int k = 0; k < B; ++k) {
+          out[k] = max_pool ? Dtype(-FLT_MAX) : Dtype(0);
+        }
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const Dtype* in = plane + (h * width_ + w) * B;
+            for (int k = 0; k < B; ++k) {
+              out[k] = max_pool ? max(out[k], in[k]) : out[k] + in[k];
+            }
+          }
+        }
+        if (!max_pool) {
+          for (int k = 0; k < B; ++k) {
+            out[k] /= pool_size;
+          }
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
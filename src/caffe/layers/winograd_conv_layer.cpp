@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+bool WinogradConvolutionLayer<Dtype>::Supports(
+    const ConvolutionParameter& conv_param) {
+  if (conv_param.group() != 1 || conv_param.force_nd_im2col()) {
+    return false;
+  }
+  if (conv_param.has_kernel_h() || conv_param.has_kernel_w()) {
+    if (conv_param.kernel_h() != 3 || conv_param.kernel_w() != 3) {
+      return false;
+    }
+  } else {
+    if (conv_param.kernel_size_size() == 0) {
+      return false;
+    }
+    for (int i = 0; i < conv_param.kernel_size_size(); ++i) {
+      if (conv_param.kernel_size(i) != 3) { return false; }
+    }
+  }
+  if (conv_param.has_stride_h() || conv_param.has_stride_w()) {
+    if (conv_param.stride_h() != 1 || conv_param.stride_w() != 1) {
+      return false;
+    }
+  }
+  for (int i = 0; i < conv_param.stride_size(); ++i) {
+    if (conv_param.stride(i) != 1) { return false; }
+  }
+  for (int i = 0; i < conv_param.dilation_size(); ++i) {
+    if (conv_param.dilation(i) != 1) { return false; }
+  }
+  // padding beyond 2 would need a larger tile for the input gradient
+  if (conv_param.pad_h() > 2 || conv_param.pad_w() > 2) {
+    return false;
+  }
+  for (int i = 0; i < conv_param.pad_size(); ++i) {
+    if (conv_param.pad(i) > 2) { return false; }
+  }
+  return true;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  CHECK(!this->int8_ && !this->half_)
+      << QuantizationParameter_Precision_Name(
+      this->layer_param_.quantization_param().precision())
+      << " precision is not supported by the WINOGRAD engine.";
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  use_winograd_ = this->num_spatial_axes_ == 2 && Supports(conv_param);
+  if (conv_param.engine() == ConvolutionParameter_Engine_WINOGRAD) {
+    CHECK(use_winograd_) << "Layer " << this->layer_param_.name() << ": "
+        << "the WINOGRAD engine needs an undilated, ungrouped 2D 3x3 "
+        << "convolution of stride 1 and padding at most 2.";
+  }
+  tile_ = conv_param.winograd_tile();
+  CHECK(tile_ == 2 || tile_ == 4) << "winograd_tile must be 2 or 4.";
+  filters_valid_ = false;
+  flipped_filters_valid_ = false;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!use_winograd_) {
+    winograd_workspace_count_ = 0;
+    return;
+  }
+  // the forward pass and the input gradient reuse the same scratch space
+  winograd_workspace_count_ = std::max(
+      winograd_workspace_count(this->channels_, this->num_output_,
+          this->output_shape_[0], this->output_shape_[1], tile_),
+      winograd_workspace_count(this->num_output_, this->channels_,
+          this->input_shape(1), this->input_shape(2), tile_));
+}
+
+template <typename Dtype>
+int WinogradConvolutionLayer<Dtype>::workspace_count() const {
+  return std::max(ConvolutionLayer<Dtype>::workspace_count(),
+      winograd_workspace_count_);
+}
+
+template <typename Dtype>
+Blob<Dtype>* WinogradConvolutionLayer<Dtype>::winograd_workspace() {
+  Blob<Dtype>* workspace = this->share_workspace_ ?
+      BaseConvolutionLayer<Dtype>::SharedWorkspace() : &workspace_;
+  workspace->Reshape(vector<int>(1, winograd_workspace_count_));
+  return workspace;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::UpdateFilters(bool flipped) {
+  const Blob<Dtype>& weights = *this->blobs_[0];
+  if (transformed_weights_.count() != weights.count() ||
+      memcmp(transformed_weights_.cpu_data(), weights.cpu_data(),
+          weights.count() * sizeof(Dtype)) != 0) {
+    transformed_weights_.CopyFrom(weights, false, true);
+    filters_valid_ = false;
+    flipped_filters_valid_ = false;
+  }
+  vector<int> filters_shape(1, winograd_tile_size(tile_));
+  if (!flipped && !filters_valid_) {
+    filters_shape.push_back(this->num_output_);
+    filters_shape.push_back(this->channels_);
+    filters_.Reshape(filters_shape);
+    winograd_filter_transform_cpu(weights.cpu_data(), this->num_output_,
+        this->channels_, tile_, false, filters_.mutable_cpu_data());
+    filters_valid_ = true;
+  } else if (flipped && !flipped_filters_valid_) {
+    filters_shape.push_back(this->channels_);
+    filters_shape.push_back(this->num_output_);
+    flipped_filters_.Reshape(filters_shape);
+    winograd_filter_transform_cpu(weights.cpu_data(), this->channels_,
+        this->num_output_, tile_, true, flipped_filters_.mutable_cpu_data());
+    flipped_filters_valid_ = true;
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_winograd_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  UpdateFilters(false);
+  const Dtype* filters = filters_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  Dtype* workspace = winograd_workspace()->mutable_cpu_data();
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      winograd_conv_cpu(bottom_data + n * this->bottom_dim_, this->channels_,
+          this->input_shape(1), this->input_shape(2), pad_data[0],
+          pad_data[1], filters, this->num_output_, tile_, workspace,
+          top_data + n * this->top_dim_);
+      this->forward_cpu_epilogue(top_data + n * this->top_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (!use_winograd_) {
+    ConvolutionLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
+  // The bias and weight gradients.
+  ConvolutionLayer<Dtype>::Backward_cpu(top,
+      vector<bool>(propagate_down.size(), false), bottom);
+  // The input gradient: the top diff, padded so that the 3x3 window covers
+  // every input it came from, convolved with the rotated filters.
+  const int* pad_data = this->pad_.cpu_data();
+  for (int i = 0; i < top.size(); ++i) {
+    if (!propagate_down[i]) { continue; }
+    UpdateFilters(true);
+    const Dtype* filters = flipped_filters_.cpu_data();
+    Dtype* workspace = winograd_workspace()->mutable_cpu_data();
+    const Dtype* top_diff = top[i]->cpu_diff();
+    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+    for (int n = 0; n < this->num_; ++n) {
+      winograd_conv_cpu(top_diff + n * this->top_dim_, this->num_output_,
+          this->output_shape_[0], this->output_shape_[1], 2 - pad_data[0],
+          2 - pad_data[1], filters, this->channels_, tile_, workspace,
+          bottom_diff + n * this->bottom_dim_);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
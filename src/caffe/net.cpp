@@ -1,3 +1,6 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 #include <algorithm>
 #include <map>
 #include <set>
@@ -11,16 +14,90 @@
 
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
 
+namespace {
+
+// Records a pass of a layer from start with the bytes of its blobs, their
+// data and in Backward also their diffs, and its estimated FLOPs, taking
+// Backward of a layer with parameters as twice Forward.
+template <typename Dtype>
+void ProfileLayer(const Net<Dtype>& net, const int layer_id,
+    const bool backward, const int64_t start) {
+  Layer<Dtype>* layer = net.layers()[layer_id].get();
+  const vector<Blob<Dtype>*>& bottom = net.bottom_vecs()[layer_id];
+  const vector<Blob<Dtype>*>& top = net.top_vecs()[layer_id];
+  double count = 0;
+  for (int i = 0; i < bottom.size(); ++i) { count += bottom[i]->count(); }
+  for (int i = 0; i < top.size(); ++i) { count += top[i]->count(); }
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    count += layer->blobs()[i]->count();
+  }
+  double flops = layer->ForwardFlops(bottom, top);
+  if (backward) {
+    count *= 2;
+    flops *= layer->blobs().empty() ? 1 : 2;
+  }
+  const char* category = backward ? "backward" :
+      net.phase() == TRAIN ? "forward" : "test";
+  Profiler::Get().Record(net.layer_names()[layer_id], category, start,
+      count * sizeof(Dtype), flops);
+}
+
+// The state of one ForwardFromTo run on the thread pool.
+template <typename Dtype>
+struct ForwardSchedule {
+  Net<Dtype>* net;
+  ThreadPool* pool;
+  int start;
+  // per layer from start, the number of layers it still waits for, the
+  // layers waiting for it, and its loss
+  vector<int> waiting;
+  vector<vector<int> > waiters;
+  vector<Dtype> losses;
+  boost::mutex mutex;
+};
+
+template <typename Dtype>
+void ForwardLayer(ForwardSchedule<Dtype>* schedule, int layer_id) {
+  // the workers may have been started in GPU mode
+  Caffe::set_mode(Caffe::CPU);
+  Net<Dtype>* net = schedule->net;
+  const int i = layer_id - schedule->start;
+  const int64_t start = Profiler::enabled() ? Profiler::Now() : 0;
+  schedule->losses[i] = net->layers()[layer_id]->Forward(
+      net->bottom_vecs()[layer_id], net->top_vecs()[layer_id]);
+  if (Profiler::enabled()) { ProfileLayer(*net, layer_id, false, start); }
+  vector<int> ready;
+  {
+    boost::mutex::scoped_lock lock(schedule->mutex);
+    for (int j = 0; j < schedule->waiters[i].size(); ++j) {
+      const int waiter = schedule->waiters[i][j];
+      if (--schedule->waiting[waiter - schedule->start] == 0) {
+        ready.push_back(waiter);
+      }
+    }
+  }
+  for (int j = 0; j < ready.size(); ++j) {
+    schedule->pool->Run(
+        boost::bind(&ForwardLayer<Dtype>, schedule, ready[j]));
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 Net<Dtype>::Net(const NetParameter& param) {
   Init(param);
@@ -95,6 +172,25 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       // If a blob needs backward, this layer should provide it.
       need_backward |= blob_need_backward_[blob_id];
     }
+    // A layer that overwrites a bottom must be its only reader: a blob with
+    // several readers is split into tops that share its memory.
+    for (int bottom_id = 0; bottom_id < layer_param.bottom_size();
+         ++bottom_id) {
+      if (!layers_[layer_id]->OverwritesBottomInForward(bottom_id)) {
+        continue;
+      }
+      const int blob_id = bottom_id_vecs_[layer_id][bottom_id];
+      for (int i = 0; i < layer_id; ++i) {
+        for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+          if (top_id_vecs_[i][j] == blob_id &&
+              string(layers_[i]->type()) == "Split") {
+            LOG(FATAL) << layer_param.type() << " layer " << layer_param.name()
+                << " overwrites its bottom " << param.layer(i).bottom(0)
+                << ", which is also read by other layers.";
+          }
+        }
+      }
+    }
     int num_top = layer_param.top_size();
     for (int top_id = 0; top_id < num_top; ++top_id) {
       AppendTop(param, layer_id, top_id, &available_blobs, &blob_name_to_idx);
@@ -253,6 +349,36 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  blocked_layout_ = param.blocked_layout();
+  if (blocked_layout_ && phase_ != TEST) {
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Ignoring blocked_layout outside the TEST phase";
+    blocked_layout_ = false;
+  }
+  if (blocked_layout_) {
+    PlanLayout();
+  }
+  if (param.forward_threads() > 1) {
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Running Forward on " << param.forward_threads() << " threads";
+    forward_pool_.reset(new ThreadPool(param.forward_threads()));
+  }
+  share_conv_workspace_ = param.share_conv_workspace();
+  if (share_conv_workspace_) {
+    ShareConvWorkspace(true);
+  }
+  optimize_memory_ = param.optimize_memory();
+  if (optimize_memory_ && phase_ != TEST) {
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Ignoring optimize_memory outside the TEST phase";
+    optimize_memory_ = false;
+  }
+  if (optimize_memory_) {
+    PlanMemory(true);
+  }
+  if (forward_pool_) {
+    PlanForward();
+  }
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
@@ -518,12 +644,20 @@ template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  CHECK(!blocked_layout_ || Caffe::mode() == Caffe::CPU)
+      << "Only the CPU implementations read blocked_layout blobs";
+  if (forward_pool_ && Caffe::mode() == Caffe::CPU && !debug_info_ &&
+      before_forward_.empty() && after_forward_.empty()) {
+    return ForwardParallel(start, end);
+  }
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
     for (int c = 0; c < before_forward_.size(); ++c) {
       before_forward_[c]->run(i);
     }
+    const int64_t profile_start = Profiler::enabled() ? Profiler::Now() : 0;
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    if (Profiler::enabled()) { ProfileLayer(*this, i, false, profile_start); }
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
     for (int c = 0; c < after_forward_.size(); ++c) {
@@ -533,6 +667,43 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   return loss;
 }
 
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardParallel(int start, int end) {
+  ForwardSchedule<Dtype> schedule;
+  schedule.net = this;
+  schedule.pool = forward_pool_.get();
+  schedule.start = start;
+  schedule.waiting.resize(end - start + 1, 0);
+  schedule.waiters.resize(end - start + 1);
+  schedule.losses.resize(end - start + 1, 0);
+  // the layers before start are done
+  for (int i = start; i <= end; ++i) {
+    for (int j = 0; j < forward_deps_[i].size(); ++j) {
+      const int dep = forward_deps_[i][j];
+      if (dep >= start) {
+        ++schedule.waiting[i - start];
+        schedule.waiters[dep - start].push_back(i);
+      }
+    }
+  }
+  // found before running any, as the layers run count down the others
+  vector<int> ready;
+  for (int i = start; i <= end; ++i) {
+    if (schedule.waiting[i - start] == 0) { ready.push_back(i); }
+  }
+  for (int i = 0; i < ready.size(); ++i) {
+    forward_pool_->Run(boost::bind(&ForwardLayer<Dtype>, &schedule,
+        ready[i]));
+  }
+  forward_pool_->Wait();
+  // summed in layer order, as in the serial pass
+  Dtype loss = 0;
+  for (int i = start; i <= end; ++i) {
+    loss += schedule.losses[i - start];
+  }
+  return loss;
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFrom(int start) {
   return ForwardFromTo(start, layers_.size() - 1);
@@ -569,13 +740,19 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  CHECK(!optimize_memory_)
+      << "Backward needs the top blobs that optimize_memory reuses";
+  CHECK(!blocked_layout_) << "Backward does not support blocked_layout";
   for (int i = start; i >= end; --i) {
     for (int c = 0; c < before_backward_.size(); ++c) {
       before_backward_[c]->run(i);
     }
     if (layer_need_backward_[i]) {
+      const int64_t profile_start =
+          Profiler::enabled() ? Profiler::Now() : 0;
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (Profiler::enabled()) { ProfileLayer(*this, i, true, profile_start); }
       if (debug_info_) { BackwardDebugInfo(i); }
     }
     for (int c = 0; c < after_backward_.size(); ++c) {
@@ -729,6 +906,294 @@ void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  if (share_conv_workspace_) {
+    ShareConvWorkspace(false);
+  }
+  if (optimize_memory_) {
+    PlanMemory(false);
+  }
+  if (forward_pool_) {
+    PlanForward();
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanLayout() {
+  // A blob may be blocked if layers write it, it is not a net output, and
+  // all the layers writing or reading it allow the blocked layout.
+  vector<bool> blocked(blobs_.size(), false);
+  vector<bool> allowed(blobs_.size(), true);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const bool allow = layers_[layer_id]->AllowBlockedLayout();
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      blocked[top_id_vecs_[layer_id][top_id]] = true;
+      allowed[top_id_vecs_[layer_id][top_id]] =
+          allowed[top_id_vecs_[layer_id][top_id]] && allow;
+    }
+    for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+         ++bottom_id) {
+      allowed[bottom_id_vecs_[layer_id][bottom_id]] =
+          allowed[bottom_id_vecs_[layer_id][bottom_id]] && allow;
+    }
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    blocked[blob_id] = blocked[blob_id] && allowed[blob_id] &&
+        blobs_[blob_id]->num_axes() == 4;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    blocked[net_output_blob_indices_[i]] = false;
+  }
+  // Only the layers converting between the layouts take a mix: unblock all
+  // the blobs of any other layer with a plain one, until none is left.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      if (layers_[layer_id]->ConvertsBlockedLayout()) { continue; }
+      vector<int> blob_ids(bottom_id_vecs_[layer_id]);
+      blob_ids.insert(blob_ids.end(), top_id_vecs_[layer_id].begin(),
+          top_id_vecs_[layer_id].end());
+      bool all_blocked = true;
+      for (int i = 0; i < blob_ids.size(); ++i) {
+        all_blocked = all_blocked && blocked[blob_ids[i]];
+      }
+      for (int i = 0; !all_blocked && i < blob_ids.size(); ++i) {
+        changed = changed || blocked[blob_ids[i]];
+        blocked[blob_ids[i]] = false;
+      }
+    }
+  }
+  int num_blocked = 0;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (!blocked[blob_id]) { continue; }
+    blobs_[blob_id]->set_blocked(true);
+    ++num_blocked;
+  }
+  // The layers size their buffers for the layouts of their blobs.
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    layers_[layer_id]->Reshape(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Keeping " << num_blocked << " blobs in the blocked layout";
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareConvWorkspace(bool verbose) {
+  int num_layers = 0;
+  int max_count = 0;
+  size_t total_count = 0;
+  for (int i = 0; i < layers_.size(); ++i) {
+    BaseConvolutionLayer<Dtype>* conv_layer =
+        dynamic_cast<BaseConvolutionLayer<Dtype>*>(layers_[i].get());
+    if (!conv_layer) { continue; }
+    conv_layer->set_share_workspace(true);
+    max_count = std::max(max_count, conv_layer->workspace_count());
+    total_count += conv_layer->workspace_count();
+    ++num_layers;
+  }
+  if (num_layers == 0) { return; }
+  // Reserve the largest need so the layers never grow the workspace.
+  Blob<Dtype>* workspace = BaseConvolutionLayer<Dtype>::SharedWorkspace();
+  if (workspace->count() < max_count) {
+    workspace->Reshape(vector<int>(1, max_count));
+  }
+  LOG_IF(INFO, Caffe::root_solver() && verbose)
+      << "Memory required for the convolution workspace: "
+      << max_count * sizeof(Dtype) << " shared by " << num_layers
+      << " layers instead of " << total_count * sizeof(Dtype);
+  // The workspace is per thread: each Forward pool thread grows its own the
+  // first time it runs a convolution, up to the same size.
+  LOG_IF(INFO, Caffe::root_solver() && verbose && forward_pool_)
+      << "Each of the " << forward_pool_->num_threads() << " Forward threads "
+      << "holds another convolution workspace of up to "
+      << max_count * sizeof(Dtype) << ", "
+      << forward_pool_->num_threads() * max_count * sizeof(Dtype)
+      << " in all";
+}
+
+template <typename Dtype>
+void Net<Dtype>::FindMemoryGroups(vector<vector<int> >* groups) const {
+  groups->clear();
+  vector<int> root(blobs_.size());
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    root[blob_id] = blob_id;
+  }
+  map<const SyncedMemory*, int> blob_of_memory;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() == 0) { continue; }
+    const SyncedMemory* data = blobs_[blob_id]->data().get();
+    if (blob_of_memory.count(data)) {
+      root[blob_id] = root[blob_of_memory[data]];
+    } else {
+      blob_of_memory[data] = blob_id;
+    }
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (!layers_[layer_id]->SharesDataInForward()) { continue; }
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    for (int i = 1; i < bottom_ids.size() + top_ids.size(); ++i) {
+      const int blob_id = i < bottom_ids.size() ? bottom_ids[i] :
+          top_ids[i - bottom_ids.size()];
+      const int old_root = root[blob_id];
+      const int new_root = root[bottom_ids[0]];
+      for (int j = 0; j < blobs_.size(); ++j) {
+        if (root[j] == old_root) { root[j] = new_root; }
+      }
+    }
+  }
+  map<int, int> group_of_root;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (!group_of_root.count(root[blob_id])) {
+      group_of_root[root[blob_id]] = groups->size();
+      groups->push_back(vector<int>());
+    }
+    (*groups)[group_of_root[root[blob_id]]].push_back(blob_id);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanMemory(bool verbose) {
+  // Blobs sharing data are planned as one group: the tops of layers that
+  // share in Forward, and the blobs already holding the same memory, such as
+  // those that Flatten shares in Reshape.
+  if (memory_groups_.empty()) {
+    FindMemoryGroups(&memory_groups_);
+  }
+  const int num_groups = memory_groups_.size();
+  vector<int> group_of_blob(blobs_.size());
+  vector<int> count(num_groups, 0);
+  for (int g = 0; g < num_groups; ++g) {
+    for (int i = 0; i < memory_groups_[g].size(); ++i) {
+      const int blob_id = memory_groups_[g][i];
+      group_of_blob[blob_id] = g;
+      count[g] = std::max(count[g], blobs_[blob_id]->data_count());
+    }
+  }
+  // The lifetime of a group runs from the first layer writing it to the last
+  // layer reading or writing it. The net outputs must outlive Forward, and
+  // data and input layers fill or point their tops at memory of their own.
+  vector<int> first(num_groups, layers_.size());
+  vector<int> last(num_groups, -1);
+  vector<bool> fixed(num_groups, false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int g = group_of_blob[top_id_vecs_[layer_id][top_id]];
+      first[g] = std::min(first[g], layer_id);
+      last[g] = layer_id;
+      fixed[g] = fixed[g] || bottom_id_vecs_[layer_id].empty();
+    }
+    for (int bottom_id = 0; bottom_id < bottom_id_vecs_[layer_id].size();
+         ++bottom_id) {
+      last[group_of_blob[bottom_id_vecs_[layer_id][bottom_id]]] = layer_id;
+    }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    fixed[group_of_blob[net_output_blob_indices_[i]]] = true;
+  }
+  // Assign the groups in order of first use to the smallest free buffer that
+  // fits, or else grow the largest free one.
+  vector<pair<int, int> > order;
+  for (int g = 0; g < num_groups; ++g) {
+    if (!fixed[g] && count[g] > 0) {
+      order.push_back(make_pair(first[g], g));
+    }
+  }
+  std::sort(order.begin(), order.end());
+  vector<int> buffer_count;
+  vector<int> buffer_last;
+  vector<int> buffer_of_group(num_groups, -1);
+  for (int i = 0; i < order.size(); ++i) {
+    const int g = order[i].second;
+    int best = -1;
+    for (int b = 0; b < buffer_count.size(); ++b) {
+      if (buffer_last[b] >= first[g]) { continue; }
+      if (best < 0) {
+        best = b;
+        continue;
+      }
+      const bool fits = buffer_count[b] >= count[g];
+      const bool best_fits = buffer_count[best] >= count[g];
+      if (fits ? !best_fits || buffer_count[b] < buffer_count[best] :
+          !best_fits && buffer_count[b] > buffer_count[best]) {
+        best = b;
+      }
+    }
+    if (best < 0) {
+      best = buffer_count.size();
+      buffer_count.push_back(0);
+      buffer_last.push_back(-1);
+    }
+    buffer_count[best] = std::max(buffer_count[best], count[g]);
+    buffer_last[best] = last[g];
+    buffer_of_group[g] = best;
+  }
+  vector<shared_ptr<SyncedMemory> > buffers(buffer_count.size());
+  for (int b = 0; b < buffers.size(); ++b) {
+    buffers[b].reset(new SyncedMemory(buffer_count[b] * sizeof(Dtype)));
+  }
+  size_t unplanned_count = 0;
+  size_t planned_count = 0;
+  for (int g = 0; g < num_groups; ++g) {
+    unplanned_count += count[g];
+    if (buffer_of_group[g] < 0) {
+      planned_count += count[g];
+      continue;
+    }
+    for (int i = 0; i < memory_groups_[g].size(); ++i) {
+      blobs_[memory_groups_[g][i]]->ShareDataMemory(
+          buffers[buffer_of_group[g]]);
+    }
+  }
+  for (int b = 0; b < buffers.size(); ++b) {
+    planned_count += buffer_count[b];
+  }
+  LOG_IF(INFO, Caffe::root_solver() && verbose)
+      << "Memory required for data: " << planned_count * sizeof(Dtype)
+      << " with " << order.size() << " top blobs in " << buffers.size()
+      << " shared buffers, instead of " << unplanned_count * sizeof(Dtype);
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanForward() {
+  // After PlanMemory, the blobs sharing a buffer are grouped as well.
+  vector<vector<int> > groups;
+  FindMemoryGroups(&groups);
+  vector<int> group_of_blob(blobs_.size());
+  for (int g = 0; g < groups.size(); ++g) {
+    for (int i = 0; i < groups[g].size(); ++i) {
+      group_of_blob[groups[g][i]] = g;
+    }
+  }
+  // A layer reads a group after its last writer, and writes it after the
+  // readers since, so that the layers see the memory as they would in order.
+  vector<int> writer(groups.size(), -1);
+  vector<vector<int> > readers(groups.size());
+  forward_deps_.assign(layers_.size(), vector<int>());
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    set<int> deps;
+    for (int i = 0; i < bottom_ids.size(); ++i) {
+      const int g = group_of_blob[bottom_ids[i]];
+      if (writer[g] >= 0) { deps.insert(writer[g]); }
+    }
+    for (int i = 0; i < top_ids.size(); ++i) {
+      const int g = group_of_blob[top_ids[i]];
+      if (writer[g] >= 0) { deps.insert(writer[g]); }
+      deps.insert(readers[g].begin(), readers[g].end());
+    }
+    deps.erase(layer_id);
+    forward_deps_[layer_id].assign(deps.begin(), deps.end());
+    for (int i = 0; i < bottom_ids.size(); ++i) {
+      readers[group_of_blob[bottom_ids[i]]].push_back(layer_id);
+    }
+    for (int i = 0; i < top_ids.size(); ++i) {
+      const int g = group_of_blob[top_ids[i]];
+      writer[g] = layer_id;
+      readers[g].clear();
+    }
+  }
 }
 
 template <typename Dtype>
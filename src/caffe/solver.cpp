@@ -8,6 +8,7 @@
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -56,6 +57,11 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   if (Caffe::root_solver()) {
     LOG(INFO) << "Solver scaffolding done.";
   }
+  CHECK_GT(param_.profile_trace_iterations(), 0);
+  if (Caffe::root_solver() &&
+      (param_.profile_interval() > 0 || param_.has_profile_trace())) {
+    Profiler::Get().Enable(param_.has_profile_trace());
+  }
   iter_ = 0;
   current_step_ = 0;
 }
@@ -207,6 +213,7 @@ void Solver<Dtype>::Step(int iters) {
   iteration_timer_.Start();
 
   while (iter_ < stop_iter) {
+    const int64_t profile_start = Profiler::enabled() ? Profiler::Now() : 0;
     // zero-init the params
     net_->ClearParamDiffs();
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
@@ -264,7 +271,11 @@ void Solver<Dtype>::Step(int iters) {
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_gradients_ready();
     }
+    const int64_t update_start = Profiler::enabled() ? Profiler::Now() : 0;
     ApplyUpdate();
+    if (Profiler::enabled()) {
+      Profile(start_iter, profile_start, update_start);
+    }
 
     SolverAction::Enum request = GetRequestedAction();
 
@@ -281,6 +292,35 @@ void Solver<Dtype>::Step(int iters) {
       break;
     }
   }
+  if (Caffe::root_solver() && param_.has_profile_trace() &&
+      Profiler::Get().tracing()) {
+    Profiler::Get().WriteTrace(param_.profile_trace());
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::Profile(int start_iter, int64_t iteration_start,
+    int64_t update_start) {
+  // the update reads at least the data and diff of each parameter, and
+  // writes the data
+  const vector<Blob<Dtype>*>& params = net_->learnable_params();
+  double count = 0;
+  for (int i = 0; i < params.size(); ++i) {
+    count += params[i]->count();
+  }
+  Profiler& profiler = Profiler::Get();
+  profiler.Record("ApplyUpdate", "update", update_start,
+      3 * count * sizeof(Dtype), 0);
+  profiler.Record("Iteration", "solver", iteration_start, 0, 0);
+  if (!Caffe::root_solver()) { return; }
+  if (param_.profile_interval() &&
+      iter_ % param_.profile_interval() == 0) {
+    profiler.LogSummary();
+  }
+  if (param_.has_profile_trace() && profiler.tracing() &&
+      iter_ - start_iter >= param_.profile_trace_iterations()) {
+    profiler.WriteTrace(param_.profile_trace());
+  }
 }
 
 template <typename Dtype>
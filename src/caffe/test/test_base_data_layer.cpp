@@ -0,0 +1,141 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Numbers its batches and can be slowed down to emulate a costly input
+// pipeline.
+template <typename Dtype>
+class CountingDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  explicit CountingDataLayer(const LayerParameter& param)
+      : BasePrefetchingDataLayer<Dtype>(param), delay_ms_(), count_() {}
+  virtual ~CountingDataLayer() { this->StopInternalThread(); }
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    top[0]->Reshape(2, 3, 1, 1);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->data_.Reshape(2, 3, 1, 1);
+    }
+  }
+  virtual inline const char* type() const { return "CountingData"; }
+
+  // applies from the next batch the prefetch thread loads
+  void set_delay_ms(int delay_ms) {
+    boost::mutex::scoped_lock lock(mutex_);
+    delay_ms_ = delay_ms;
+  }
+
+  // Blocks until every batch but the current one is loaded, so that the next
+  // Forward does not wait for data and the prefetch thread waits for a slot.
+  void WaitForFullQueue() {
+    while (this->prefetch_full_.size() + 1 < this->prefetch_.size()) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+  }
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch) {
+    int delay_ms;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      delay_ms = delay_ms_;
+    }
+    if (delay_ms > 0) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(delay_ms));
+    }
+    batch->data_.Reshape(2, 3, 1, 1);
+    caffe_set(batch->data_.count(), Dtype(count_++),
+              batch->data_.mutable_cpu_data());
+  }
+
+  boost::mutex mutex_;
+  int delay_ms_;
+  int count_;
+};
+
+template <typename TypeParam>
+class BaseDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  BaseDataLayerTest() : blob_top_data_(new Blob<Dtype>()) {
+    blob_top_vec_.push_back(blob_top_data_);
+  }
+  virtual ~BaseDataLayerTest() { delete blob_top_data_; }
+
+  // Runs the layer, checking the batches arrive in order.
+  // With wait_for_data, each batch is only consumed once the prefetch thread
+  // has filled the queue.
+  void Run(CountingDataLayer<Dtype>* layer, int iters, bool wait_for_data) {
+    for (int iter = 0; iter < iters; ++iter) {
+      if (wait_for_data) {
+        layer->WaitForFullQueue();
+      }
+      layer->Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < blob_top_data_->count(); ++i) {
+        ASSERT_EQ(next_, blob_top_data_->cpu_data()[i]);
+      }
+      ++next_;
+    }
+  }
+
+  int next_;
+  Blob<Dtype>* const blob_top_data_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(BaseDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(BaseDataLayerTest, TestFixedDepth) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.mutable_data_param()->set_prefetch(3);
+  param.mutable_data_param()->set_prefetch_adapt_interval(2);
+  CountingDataLayer<Dtype> layer(param);
+  layer.set_delay_ms(2);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->next_ = 0;
+  this->Run(&layer, 20, false);
+  // without max_prefetch the depth never changes
+  EXPECT_EQ(layer.prefetch_stats().depth, 3);
+  EXPECT_GT(layer.prefetch_stats().consumer_stalls, 0);
+  EXPECT_GT(layer.prefetch_stats().consumer_wait_ms, 0);
+}
+
+TYPED_TEST(BaseDataLayerTest, TestAdaptiveDepth) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.mutable_data_param()->set_prefetch(2);
+  param.mutable_data_param()->set_max_prefetch(4);
+  param.mutable_data_param()->set_prefetch_adapt_interval(4);
+  CountingDataLayer<Dtype> layer(param);
+  // a slow producer makes the net wait: the queue grows
+  layer.set_delay_ms(3);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->next_ = 0;
+  this->Run(&layer, 24, false);
+  const int grown_depth = layer.prefetch_stats().depth;
+  EXPECT_GT(grown_depth, 2);
+  EXPECT_LE(grown_depth, 4);
+  EXPECT_GT(layer.prefetch_stats().consumer_stalls, 0);
+  // a consumer that never has to wait leaves the prefetch thread idle: the
+  // queue shrinks, but not below prefetch
+  layer.set_delay_ms(0);
+  this->Run(&layer, 60, true);
+  EXPECT_LT(layer.prefetch_stats().depth, grown_depth);
+  EXPECT_GE(layer.prefetch_stats().depth, 2);
+  EXPECT_GT(layer.prefetch_stats().producer_stalls, 0);
+}
+
+}  // namespace caffe
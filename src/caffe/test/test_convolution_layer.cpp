@@ -6,6 +6,10 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/int8.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -811,6 +815,393 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestDepthwiseConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  // kernel, stride, pad, dilation
+  const int kConfigs[][4] = {
+    {3, 1, 1, 1}, {3, 2, 1, 1}, {5, 1, 2, 1}, {3, 1, 2, 2}, {2, 3, 0, 1}
+  };
+  for (int c = 0; c < sizeof(kConfigs) / sizeof(kConfigs[0]); ++c) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(kConfigs[c][0]);
+    convolution_param->add_stride(kConfigs[c][1]);
+    convolution_param->add_pad(kConfigs[c][2]);
+    convolution_param->add_dilation(kConfigs[c][3]);
+    convolution_param->set_num_output(3);
+    convolution_param->set_group(3);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDepthwiseGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(2);
+  convolution_param->add_dilation(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestInt8Convolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  // int8 is a CPU path
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // The int8 layer must match a float convolution of the input and the
+  // weights rounded to their int8 values.
+  for (int group = 1; group <= 3; group += 2) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(3);
+    convolution_param->add_stride(2);
+    convolution_param->add_pad(1);
+    convolution_param->set_num_output(3);
+    convolution_param->set_group(group);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> float_layer(layer_param);
+    Blob<Dtype> float_top;
+    vector<Blob<Dtype>*> float_top_vec(1, &float_top);
+    float_layer.SetUp(this->blob_bottom_vec_, float_top_vec);
+    const float input_scale = 0.02;
+    layer_param.mutable_quantization_param()->set_precision(
+        QuantizationParameter_Precision_INT8);
+    layer_param.mutable_quantization_param()->set_input_scale(input_scale);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      layer.blobs()[i]->CopyFrom(*float_layer.blobs()[i]);
+    }
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype>* weights = float_layer.blobs()[0].get();
+    const int rows = weights->shape(0);
+    const int cols = weights->count(1);
+    vector<float> scales(rows);
+    vector<int8_t> q(weights->count());
+    int8_quantize_rows_cpu(rows, cols, weights->cpu_data(), false,
+        &scales[0], &q[0]);
+    for (int i = 0; i < weights->count(); ++i) {
+      weights->mutable_cpu_data()[i] = q[i] * scales[i / cols];
+    }
+    Blob<Dtype> bottom;
+    bottom.CopyFrom(*this->blob_bottom_, false, true);
+    q.resize(bottom.count());
+    int8_quantize_cpu(bottom.count(), bottom.cpu_data(), input_scale, &q[0]);
+    for (int i = 0; i < bottom.count(); ++i) {
+      bottom.mutable_cpu_data()[i] = q[i] * input_scale;
+    }
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    float_layer.Forward(bottom_vec, float_top_vec);
+    for (int i = 0; i < float_top.count(); ++i) {
+      EXPECT_NEAR(float_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+          1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestHalfConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  // 16-bit weights are a CPU path
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // The 16-bit layer must match a float convolution with the weights
+  // rounded to their 16-bit values.
+  const QuantizationParameter_Precision precisions[] = {
+      QuantizationParameter_Precision_FP16,
+      QuantizationParameter_Precision_BF16 };
+  for (int p = 0; p < 2; ++p) {
+    for (int group = 1; group <= 3; group += 2) {
+      LayerParameter layer_param;
+      ConvolutionParameter* convolution_param =
+          layer_param.mutable_convolution_param();
+      convolution_param->add_kernel_size(3);
+      convolution_param->add_stride(2);
+      convolution_param->add_pad(1);
+      convolution_param->set_num_output(3);
+      convolution_param->set_group(group);
+      convolution_param->mutable_weight_filler()->set_type("gaussian");
+      convolution_param->mutable_bias_filler()->set_type("gaussian");
+      ConvolutionLayer<Dtype> float_layer(layer_param);
+      Blob<Dtype> float_top;
+      vector<Blob<Dtype>*> float_top_vec(1, &float_top);
+      float_layer.SetUp(this->blob_bottom_vec_, float_top_vec);
+      layer_param.mutable_quantization_param()->set_precision(precisions[p]);
+      ConvolutionLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < layer.blobs().size(); ++i) {
+        layer.blobs()[i]->CopyFrom(*float_layer.blobs()[i]);
+      }
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      Blob<Dtype>* weights = float_layer.blobs()[0].get();
+      vector<float> w(weights->cpu_data(),
+          weights->cpu_data() + weights->count());
+      vector<uint16_t> h(w.size());
+      const HalfFormat format = p == 0 ?
+          BlobProto_HalfFormat_FP16 : BlobProto_HalfFormat_BF16;
+      half_from_float_cpu(format, w.size(), &w[0], &h[0]);
+      half_to_float_cpu(format, h.size(), &h[0], &w[0]);
+      for (int i = 0; i < weights->count(); ++i) {
+        weights->mutable_cpu_data()[i] = w[i];
+      }
+      float_layer.Forward(this->blob_bottom_vec_, float_top_vec);
+      for (int i = 0; i < float_top.count(); ++i) {
+        EXPECT_NEAR(float_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+            1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBatchedConvolutionGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(5, 3, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  // 60 values of columns and output per image: images go two at a time
+  convolution_param->set_cpu_workspace_limit(2 * 60 * sizeof(Dtype));
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Check against reference convolution.
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestSharedWorkspace) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // two layers of different workspace needs unroll into the same memory
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.set_share_workspace(true);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ConvolutionParameter convolution_param_1 = *convolution_param;
+  convolution_param->set_kernel_size(0, 2);
+  convolution_param->set_stride(0, 1);
+  ConvolutionLayer<Dtype> layer_2(layer_param);
+  layer_2.set_share_workspace(true);
+  vector<Blob<Dtype>*> top_vec_2(1, this->blob_top_2_);
+  layer_2.SetUp(this->blob_bottom_vec_, top_vec_2);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer_2.Forward(this->blob_bottom_vec_, top_vec_2);
+  caffe_conv(this->blob_bottom_, &convolution_param_1, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+        this->ref_blob_top_->cpu_data()[i], 1e-4);
+  }
+  caffe_conv(this->blob_bottom_, convolution_param, layer_2.blobs(),
+      this->MakeReferenceTop(this->blob_top_2_));
+  for (int i = 0; i < this->blob_top_2_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_2_->cpu_data()[i],
+        this->ref_blob_top_->cpu_data()[i], 1e-4);
+  }
+  // and take their gradients from it as well
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBatchedGradientGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(5, 3, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->set_cpu_workspace_limit(2 * 60 * sizeof(Dtype));
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradAgainstGEMM) {
+  typedef typename TypeParam::Dtype Dtype;
+  // output sizes that are not multiples of either tile
+  this->blob_bottom_->Reshape(2, 3, 7, 9);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  for (int tile = 2; tile <= 4; tile += 2) {
+    for (int pad = 0; pad <= 2; ++pad) {
+      LayerParameter layer_param;
+      ConvolutionParameter* convolution_param =
+          layer_param.mutable_convolution_param();
+      convolution_param->add_kernel_size(3);
+      convolution_param->add_pad(pad);
+      convolution_param->set_num_output(5);
+      convolution_param->set_winograd_tile(tile);
+      convolution_param->mutable_weight_filler()->set_type("gaussian");
+      convolution_param->mutable_bias_filler()->set_type("gaussian");
+      convolution_param->set_engine(ConvolutionParameter_Engine_CAFFE);
+      ConvolutionLayer<Dtype> gemm_layer(layer_param);
+      Blob<Dtype> gemm_top;
+      vector<Blob<Dtype>*> gemm_top_vec(1, &gemm_top);
+      gemm_layer.SetUp(this->blob_bottom_vec_, gemm_top_vec);
+      convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+      WinogradConvolutionLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < layer.blobs().size(); ++i) {
+        layer.blobs()[i]->CopyFrom(*gemm_layer.blobs()[i]);
+      }
+      ASSERT_TRUE(this->blob_top_->shape() == gemm_top.shape());
+      gemm_layer.Forward(this->blob_bottom_vec_, gemm_top_vec);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < gemm_top.count(); ++i) {
+        EXPECT_NEAR(gemm_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+            1e-3);
+      }
+      // the input gradient, also after the weights change
+      for (int iter = 0; iter < 2; ++iter) {
+        filler.Fill(&gemm_top);
+        caffe_copy(gemm_top.count(), gemm_top.cpu_data(),
+            this->blob_top_->mutable_cpu_diff());
+        caffe_copy(gemm_top.count(), gemm_top.cpu_data(),
+            gemm_top.mutable_cpu_diff());
+        vector<bool> propagate_down(1, true);
+        gemm_layer.Backward(gemm_top_vec, propagate_down,
+            this->blob_bottom_vec_);
+        Blob<Dtype> gemm_bottom_diff;
+        gemm_bottom_diff.CopyFrom(*this->blob_bottom_, true, true);
+        layer.Backward(this->blob_top_vec_, propagate_down,
+            this->blob_bottom_vec_);
+        for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+          EXPECT_NEAR(gemm_bottom_diff.cpu_diff()[i],
+              this->blob_bottom_->cpu_diff()[i], 1e-3);
+        }
+        filler.Fill(layer.blobs()[0].get());
+        gemm_layer.blobs()[0]->CopyFrom(*layer.blobs()[0]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  // small, as stride 1 makes every output depend on the weights
+  this->blob_bottom_->Reshape(1, 3, 4, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  convolution_param->set_winograd_tile(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDirectAgainstGEMM) {
+  typedef typename TypeParam::Dtype Dtype;
+  // channels that are not multiples of the block, and output rows that are
+  // not multiples of the pixel tile
+  this->blob_bottom_->Reshape(2, 11, 7, 9);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // kernel, stride, pad, dilation
+  const int kConfigs[][4] = {
+    {3, 1, 1, 1}, {3, 2, 0, 1}, {1, 1, 0, 1}, {1, 2, 0, 1}, {5, 1, 2, 2},
+    {7, 2, 3, 1}
+  };
+  for (int c = 0; c < sizeof(kConfigs) / sizeof(kConfigs[0]); ++c) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(kConfigs[c][0]);
+    convolution_param->add_stride(kConfigs[c][1]);
+    convolution_param->add_pad(kConfigs[c][2]);
+    convolution_param->add_dilation(kConfigs[c][3]);
+    convolution_param->set_num_output(10);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    convolution_param->set_engine(ConvolutionParameter_Engine_CAFFE);
+    ConvolutionLayer<Dtype> gemm_layer(layer_param);
+    Blob<Dtype> gemm_top;
+    vector<Blob<Dtype>*> gemm_top_vec(1, &gemm_top);
+    gemm_layer.SetUp(this->blob_bottom_vec_, gemm_top_vec);
+    convolution_param->set_engine(ConvolutionParameter_Engine_DIRECT);
+    DirectConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      layer.blobs()[i]->CopyFrom(*gemm_layer.blobs()[i]);
+    }
+    ASSERT_TRUE(this->blob_top_->shape() == gemm_top.shape());
+    // also after the weights change
+    for (int iter = 0; iter < 2; ++iter) {
+      gemm_layer.Forward(this->blob_bottom_vec_, gemm_top_vec);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < gemm_top.count(); ++i) {
+        EXPECT_NEAR(gemm_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+            1e-4);
+      }
+      filler.Fill(layer.blobs()[0].get());
+      gemm_layer.blobs()[0]->CopyFrom(*layer.blobs()[0]);
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
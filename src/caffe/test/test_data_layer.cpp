@@ -67,7 +67,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     db->Close();
   }
 
-  void TestRead() {
+  void TestRead(const int transform_threads = 1) {
     const Dtype scale = 3;
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -75,6 +75,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_transform_threads(transform_threads);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -105,7 +106,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
-  void TestSkip() {
+  void TestSkip(const int transform_threads = 1) {
     LayerParameter param;
     param.set_phase(TRAIN);
     DataParameter* data_param = param.mutable_data_param();
@@ -113,6 +114,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(batch_size);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_transform_threads(transform_threads);
     Caffe::set_solver_count(8);
     for (int dev = 0; dev < Caffe::solver_count(); ++dev) {
       Caffe::set_solver_rank(dev);
@@ -387,6 +389,17 @@ TYPED_TEST(DataLayerTest, TestSkipLevelDB) {
   this->TestSkip();
 }
 
+// Items must keep their order and sharding with several transform workers.
+TYPED_TEST(DataLayerTest, TestReadThreadedLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestRead(3);
+}
+
+TYPED_TEST(DataLayerTest, TestSkipThreadedLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestSkip(3);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -420,6 +433,29 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLevelDB) {
 }
 #endif  // USE_LEVELDB
 
+TYPED_TEST(DataLayerTest, TestReadMMap) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_MMAP);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestSkipMMap) {
+  this->Fill(false, DataParameter_DB_MMAP);
+  this->TestSkip();
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTrainMMap) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_MMAP);
+  this->TestReadCrop(TRAIN);
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTestMMap) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_MMAP);
+  this->TestReadCrop(TEST);
+}
+
 #ifdef USE_LMDB
 TYPED_TEST(DataLayerTest, TestReadLMDB) {
   const bool unique_pixels = false;  // all pixels the same; images different
@@ -432,6 +468,17 @@ TYPED_TEST(DataLayerTest, TestSkipLMDB) {
   this->TestSkip();
 }
 
+// Items must keep their order and sharding with several transform workers.
+TYPED_TEST(DataLayerTest, TestReadThreadedLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->TestRead(3);
+}
+
+TYPED_TEST(DataLayerTest, TestSkipThreadedLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->TestSkip(3);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
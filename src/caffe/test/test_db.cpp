@@ -117,6 +117,28 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestValueView) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  Datum datum, view_datum;
+  for (; cursor->valid(); cursor->Next()) {
+    const char* data;
+    size_t size;
+    cursor->value_view(&data, &size);
+    const string value = cursor->value();
+    EXPECT_EQ(value, string(data, size));
+    datum.ParseFromString(value);
+    // parsing in place into a reused datum gives the same result
+    cursor->ReadDatum(&view_datum);
+    EXPECT_EQ(datum.label(), view_datum.label());
+    EXPECT_EQ(datum.channels(), view_datum.channels());
+    EXPECT_EQ(datum.height(), view_datum.height());
+    EXPECT_EQ(datum.width(), view_datum.width());
+    EXPECT_EQ(datum.data(), view_datum.data());
+  }
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
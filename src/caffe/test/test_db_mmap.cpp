@@ -0,0 +1,113 @@
+#include <string>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/db_mmap.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+class MMapDBTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    MakeTempDir(&source_);
+    source_ += "/db";
+    scoped_ptr<db::DB> db(db::GetDB(DataParameter_DB_MMAP));
+    db->Open(source_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    // two commits, as the conversion tools do for large sets
+    for (int i = 0; i < 5; ++i) {
+      Datum datum = MakeDatum(i);
+      string out;
+      CHECK(datum.SerializeToString(&out));
+      txn->Put(Key(i), out);
+      if (i == 2) {
+        txn->Commit();
+      }
+    }
+    txn->Commit();
+    db->Close();
+  }
+
+  // 3 x 1 x 3 records: an odd size, to exercise the record padding
+  Datum MakeDatum(int i) {
+    Datum datum;
+    datum.set_channels(3);
+    datum.set_height(1);
+    datum.set_width(3);
+    datum.set_label(10 * i);
+    for (int j = 0; j < 9; ++j) {
+      datum.mutable_data()->push_back(static_cast<char>(i * 9 + j));
+    }
+    return datum;
+  }
+
+  string Key(int i) { return string(i + 1, 'a' + i); }
+
+  void ExpectDatum(int i, const Datum& datum) {
+    EXPECT_EQ(3, datum.channels());
+    EXPECT_EQ(1, datum.height());
+    EXPECT_EQ(3, datum.width());
+    EXPECT_EQ(10 * i, datum.label());
+    EXPECT_FALSE(datum.encoded());
+    EXPECT_EQ(MakeDatum(i).data(), datum.data());
+  }
+
+  string source_;
+};
+
+TEST_F(MMapDBTest, TestGetDB) {
+  scoped_ptr<db::DB> db(db::GetDB("mmap"));
+}
+
+TEST_F(MMapDBTest, TestRead) {
+  scoped_ptr<db::DB> db(db::GetDB(DataParameter_DB_MMAP));
+  db->Open(source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_TRUE(cursor->valid());
+    EXPECT_EQ(Key(i), cursor->key());
+    // value() round-trips through a serialized Datum, ReadDatum() does not
+    Datum datum;
+    ASSERT_TRUE(datum.ParseFromString(cursor->value()));
+    ExpectDatum(i, datum);
+    cursor->ReadDatum(&datum);
+    ExpectDatum(i, datum);
+    const char* data;
+    size_t size;
+    cursor->value_view(&data, &size);
+    EXPECT_EQ(cursor->value(), string(data, size));
+    cursor->Next();
+  }
+  EXPECT_FALSE(cursor->valid());
+  cursor->SeekToFirst();
+  ASSERT_TRUE(cursor->valid());
+  EXPECT_EQ(Key(0), cursor->key());
+}
+
+TEST_F(MMapDBTest, TestSeek) {
+  db::MMap db;
+  db.Open(source_, db::READ);
+  scoped_ptr<db::MMapCursor> cursor(db.NewCursor());
+  EXPECT_EQ(5, cursor->size());
+  const int order[] = { 3, 0, 4, 1, 2 };
+  for (int i = 0; i < 5; ++i) {
+    cursor->Seek(order[i]);
+    ASSERT_TRUE(cursor->valid());
+    EXPECT_EQ(Key(order[i]), cursor->key());
+    EXPECT_EQ(10 * order[i], cursor->label());
+    EXPECT_EQ(order[i] * 9, cursor->pixels()[0]);
+  }
+  cursor->Seek(5);
+  EXPECT_FALSE(cursor->valid());
+}
+
+}  // namespace caffe
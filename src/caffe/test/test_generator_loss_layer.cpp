@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/GeneratorLossLayer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class GeneratorLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  GeneratorLossLayerTest()
+      : blob_bottom_original_(new Blob<Dtype>(16, 4, 1, 1)),
+        blob_bottom_label_(new Blob<Dtype>(16, 1, 1, 1)),
+        blob_bottom_generate_(new Blob<Dtype>(8, 4, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_min(-1.0);
+    filler_param.set_max(1.0);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_original_);
+    filler.Fill(this->blob_bottom_generate_);
+    Dtype* label = blob_bottom_label_->mutable_cpu_data();
+    for (int i = 0; i < blob_bottom_label_->num(); i += 4) {
+      const int age = caffe_rng_rand() % 60;
+      label[i + 0] = age;
+      label[i + 1] = age;
+      label[i + 2] = age + 1 + caffe_rng_rand() % 9;
+      label[i + 3] = age + 10 + caffe_rng_rand() % 50;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_original_);
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_bottom_vec_.push_back(blob_bottom_generate_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~GeneratorLossLayerTest() {
+    delete blob_bottom_original_;
+    delete blob_bottom_label_;
+    delete blob_bottom_generate_;
+    delete blob_top_loss_;
+  }
+
+  Dtype DistSq(int generated, int original) {
+    const int S = this->blob_bottom_original_->channels();
+    Dtype dist_sq(0);
+    for (int k = 0; k < S; ++k) {
+      Dtype diff = this->blob_bottom_generate_->cpu_data()[generated * S + k] -
+          this->blob_bottom_original_->cpu_data()[original * S + k];
+      dist_sq += diff * diff;
+    }
+    return dist_sq;
+  }
+
+  Blob<Dtype>* const blob_bottom_original_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_bottom_generate_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(GeneratorLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(GeneratorLossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_qfunction_param()->set_margin(0.1);
+  GeneratorLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // manually compute to compare
+  QFunction<Dtype> q_func;
+  q_func.setup(layer_param);
+  const Dtype margin = layer_param.qfunction_param().margin();
+  const Dtype* label = this->blob_bottom_label_->cpu_data();
+  Dtype loss(0);
+  for (int j = 0; j < this->blob_bottom_generate_->num(); ++j) {
+    const int x = (j / 2) * 4 + j % 2;  // A or P
+    const int y = x + 2;                // N1 or N2
+    const Dtype dist_x = this->DistSq(j, x);
+    loss += dist_x + this->DistSq(j, y);
+    loss += std::max(Dtype(0),
+        dist_x * (1 - q_func.call(label[x], label[y])) - margin);
+  }
+  EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], loss, 1e-5);
+}
+
+TYPED_TEST(GeneratorLossLayerTest, TestForwardQuadRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_qfunction_param()->set_margin(0.1);
+  GeneratorLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype loss = this->blob_top_loss_->cpu_data()[0];
+  // a generator fed by a QuadExpand VIEW emits one <N1', N2'> row per
+  // quadruplet; the memory layout and hence the loss are the same
+  this->blob_bottom_generate_->Reshape(4, 8, 1, 1);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], loss, 1e-6);
+}
+
+TYPED_TEST(GeneratorLossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_qfunction_param()->set_margin(0.1);
+  GeneratorLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  // only the generated negatives receive a gradient
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 2);
+}
+
+}  // namespace caffe
@@ -0,0 +1,136 @@
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HalfTest : public ::testing::Test {
+ protected:
+  // Converts x to format and back, through the vector and the scalar paths.
+  vector<float> RoundTrip(const HalfFormat format, const vector<float>& x) {
+    vector<float> padded(x);
+    padded.resize(x.size() + 16, 0);
+    padded.insert(padded.end(), x.begin(), x.end());
+    vector<uint16_t> h(padded.size());
+    half_from_float_cpu(format, padded.size(), &padded[0], &h[0]);
+    vector<float> y(padded.size());
+    half_to_float_cpu(format, h.size(), &h[0], &y[0]);
+    for (int i = 0; i < x.size(); ++i) {
+      const float tail = y[x.size() + 16 + i];
+      EXPECT_TRUE(tail == y[i] || (std::isnan(tail) && std::isnan(y[i])));
+    }
+    y.resize(x.size());
+    return y;
+  }
+};
+
+TEST_F(HalfTest, TestFp16) {
+  const float inf = std::numeric_limits<float>::infinity();
+  vector<float> x;
+  const float values[] = { 0, -0.f, 1, -2.5f, 65504, 65519, 65520, 1e6f,
+      -inf, 1.f / 1024, 1 + 1.f / 2048, 1 + 3.f / 2048, 6.1035156e-5f,
+      5.9604645e-8f, 2.9802322e-8f, 2.98024e-8f, 1e-9f };
+  const float expected[] = { 0, -0.f, 1, -2.5f, 65504, 65504, inf, inf,
+      -inf, 1.f / 1024, 1, 1 + 2.f / 1024, 6.1035156e-5f,
+      5.9604645e-8f, 0, 5.9604645e-8f, 0 };
+  const int n = sizeof(values) / sizeof(values[0]);
+  x.assign(values, values + n);
+  x.push_back(std::numeric_limits<float>::quiet_NaN());
+  const vector<float> y = RoundTrip(BlobProto_HalfFormat_FP16, x);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(expected[i], y[i]) << "value " << values[i];
+    EXPECT_EQ(std::signbit(expected[i]), std::signbit(y[i]));
+  }
+  EXPECT_TRUE(std::isnan(y[n]));
+}
+
+TEST_F(HalfTest, TestBf16) {
+  const float inf = std::numeric_limits<float>::infinity();
+  const float values[] = { 0, -1, 3e38f, -inf, 1 + 1.f / 256,
+      1 + 3.f / 256, 1e-40f };
+  const float expected[] = { 0, -1, 3.0040553e38f, -inf, 1, 1 + 4.f / 256,
+      0 };
+  const int n = sizeof(values) / sizeof(values[0]);
+  vector<float> x(values, values + n);
+  x.push_back(std::numeric_limits<float>::quiet_NaN());
+  const vector<float> y = RoundTrip(BlobProto_HalfFormat_BF16, x);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(expected[i], y[i]) << "value " << values[i];
+  }
+  EXPECT_TRUE(std::isnan(y[n]));
+}
+
+TEST_F(HalfTest, TestGemm) {
+  // K not a multiple of the vector width; the larger K splits N into panels
+  const int kSizes[][3] = { {5, 30, 37}, {3, 40, 5000} };
+  const HalfFormat formats[] = { BlobProto_HalfFormat_FP16,
+      BlobProto_HalfFormat_BF16 };
+  for (int f = 0; f < 2; ++f) {
+    for (int s = 0; s < 2; ++s) {
+      const int M = kSizes[s][0], N = kSizes[s][1], K = kSizes[s][2];
+      vector<float> A(M * K), B(N * K);
+      for (int i = 0; i < A.size(); ++i) {
+        A[i] = static_cast<int>(caffe_rng_rand() % 17) - 8;
+      }
+      for (int i = 0; i < B.size(); ++i) {
+        B[i] = (static_cast<int>(caffe_rng_rand() % 17) - 8) / 4.f;
+      }
+      // small integers and quarters are exact in both formats
+      vector<uint16_t> B_half(B.size());
+      half_from_float_cpu(formats[f], B.size(), &B[0], &B_half[0]);
+      for (int transposed = 0; transposed <= 1; ++transposed) {
+        vector<float> C(M * N);
+        half_gemm_cpu(formats[f], M, N, K, &A[0], &B_half[0], &C[0],
+            transposed);
+        for (int i = 0; i < M; ++i) {
+          for (int j = 0; j < N; ++j) {
+            float expected = 0;
+            for (int k = 0; k < K; ++k) {
+              expected += A[i * K + k] * B[j * K + k];
+            }
+            ASSERT_EQ(expected, transposed ? C[j * M + i] : C[i * N + j]);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_F(HalfTest, TestBlobProto) {
+  const HalfFormat formats[] = { BlobProto_HalfFormat_FP16,
+      BlobProto_HalfFormat_BF16 };
+  // the relative rounding error of 11 and 8 significant bits
+  const float precision[] = { 1.f / 2048, 1.f / 256 };
+  Blob<float> blob(3, 5, 17, 19);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&blob);
+  for (int f = 0; f < 2; ++f) {
+    BlobProto proto;
+    half_blob_to_proto(blob, formats[f], &proto);
+    EXPECT_EQ(0, proto.data_size());
+    EXPECT_EQ(blob.count() * 2, proto.half_data().size());
+    Blob<double> restored;
+    restored.FromProto(proto);
+    ASSERT_TRUE(restored.shape() == blob.shape());
+    for (int i = 0; i < blob.count(); ++i) {
+      EXPECT_NEAR(blob.cpu_data()[i], restored.cpu_data()[i],
+          std::abs(blob.cpu_data()[i]) * precision[f] + 1e-7);
+    }
+    // writing float data clears the 16-bit data
+    blob.ToProto(&proto);
+    EXPECT_FALSE(proto.has_half_data());
+    EXPECT_EQ(blob.count(), proto.data_size());
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,74 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/im2col.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Checks the specialized CPU im2col and col2im kernels against the generic
+// loops.
+template <typename Dtype>
+class Im2colCPUTest : public ::testing::Test {
+ protected:
+  void Check(const int height, const int width, const int kernel,
+      const int stride, const int pad) {
+    const int channels = 3;
+    const int output_h = (height + 2 * pad - kernel) / stride + 1;
+    const int output_w = (width + 2 * pad - kernel) / stride + 1;
+    Blob<Dtype> image(1, channels, height, width);
+    Blob<Dtype> col(1, channels * kernel * kernel, output_h, output_w);
+    Blob<Dtype> ref(col.shape());
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&image);
+    filler.Fill(&col);
+    im2col_cpu(image.cpu_data(), channels, height, width, kernel, kernel,
+        pad, pad, stride, stride, 1, 1, col.mutable_cpu_data());
+    im2col_generic_cpu(image.cpu_data(), channels, height, width, kernel,
+        kernel, pad, pad, stride, stride, 1, 1, ref.mutable_cpu_data());
+    for (int i = 0; i < col.count(); ++i) {
+      ASSERT_EQ(ref.cpu_data()[i], col.cpu_data()[i])
+          << height << "x" << width << " kernel " << kernel << " stride "
+          << stride << " pad " << pad;
+    }
+    filler.Fill(&col);
+    filler.Fill(&image);
+    col2im_cpu(col.cpu_data(), channels, height, width, kernel, kernel,
+        pad, pad, stride, stride, 1, 1, image.mutable_cpu_data());
+    Blob<Dtype> ref_image(image.shape());
+    col2im_generic_cpu(col.cpu_data(), channels, height, width, kernel,
+        kernel, pad, pad, stride, stride, 1, 1, ref_image.mutable_cpu_data());
+    for (int i = 0; i < image.count(); ++i) {
+      ASSERT_NEAR(ref_image.cpu_data()[i], image.cpu_data()[i], 1e-5)
+          << height << "x" << width << " kernel " << kernel << " stride "
+          << stride << " pad " << pad;
+    }
+  }
+};
+
+TYPED_TEST_CASE(Im2colCPUTest, TestDtypes);
+
+TYPED_TEST(Im2colCPUTest, TestSpecializedAgainstGeneric) {
+  // kernel, stride: the specialized shapes
+  const int kShapes[][2] = { {3, 1}, {3, 2}, {1, 2}, {7, 2} };
+  for (int s = 0; s < sizeof(kShapes) / sizeof(kShapes[0]); ++s) {
+    const int kernel = kShapes[s][0];
+    const int stride = kShapes[s][1];
+    for (int pad = 0; pad <= kernel; ++pad) {
+      // even and odd sizes, and an image narrower than the kernel
+      this->Check(9, 10, kernel, stride, pad);
+      this->Check(8, 7, kernel, stride, pad);
+      if (2 + 2 * pad >= kernel) {
+        this->Check(4, 2, kernel, stride, pad);
+      }
+    }
+  }
+}
+
+}  // namespace caffe
@@ -6,6 +6,8 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/int8.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -208,6 +210,114 @@ TYPED_TEST(InnerProductLayerTest, TestForwardTranspose) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8) {
+  typedef typename TypeParam::Dtype Dtype;
+  // int8 is a CPU path
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  // The int8 layer must match a float inner product of the input and the
+  // weights rounded to their int8 values.
+  for (int transpose = 0; transpose <= 1; ++transpose) {
+    LayerParameter layer_param;
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(10);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    InnerProductLayer<Dtype> float_layer(layer_param);
+    Blob<Dtype> float_top;
+    vector<Blob<Dtype>*> float_top_vec(1, &float_top);
+    float_layer.SetUp(this->blob_bottom_vec_, float_top_vec);
+    // 0: the scale of the input range
+    layer_param.mutable_quantization_param()->set_precision(
+        QuantizationParameter_Precision_INT8);
+    InnerProductLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      layer.blobs()[i]->CopyFrom(*float_layer.blobs()[i]);
+    }
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype>* weights = float_layer.blobs()[0].get();
+    const int K = this->blob_bottom_->count(1);
+    vector<float> scales(10);
+    vector<int8_t> q(weights->count());
+    int8_quantize_rows_cpu(10, K, weights->cpu_data(), transpose,
+        &scales[0], &q[0]);
+    for (int n = 0; n < 10; ++n) {
+      for (int k = 0; k < K; ++k) {
+        weights->mutable_cpu_data()[transpose ? k * 10 + n : n * K + k] =
+            q[n * K + k] * scales[n];
+      }
+    }
+    Blob<Dtype> bottom;
+    bottom.CopyFrom(*this->blob_bottom_, false, true);
+    const float input_scale =
+        int8_scale(int8_absmax_cpu(bottom.count(), bottom.cpu_data()));
+    q.resize(bottom.count());
+    int8_quantize_cpu(bottom.count(), bottom.cpu_data(), input_scale, &q[0]);
+    for (int i = 0; i < bottom.count(); ++i) {
+      bottom.mutable_cpu_data()[i] = q[i] * input_scale;
+    }
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    float_layer.Forward(bottom_vec, float_top_vec);
+    for (int i = 0; i < float_top.count(); ++i) {
+      EXPECT_NEAR(float_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+          1e-4);
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardHalf) {
+  typedef typename TypeParam::Dtype Dtype;
+  // 16-bit weights are a CPU path
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  // The 16-bit layer must match a float inner product with the weights
+  // rounded to their 16-bit values.
+  const QuantizationParameter_Precision precisions[] = {
+      QuantizationParameter_Precision_FP16,
+      QuantizationParameter_Precision_BF16 };
+  for (int p = 0; p < 2; ++p) {
+    for (int transpose = 0; transpose <= 1; ++transpose) {
+      LayerParameter layer_param;
+      InnerProductParameter* inner_product_param =
+          layer_param.mutable_inner_product_param();
+      inner_product_param->set_num_output(10);
+      inner_product_param->set_transpose(transpose);
+      inner_product_param->mutable_weight_filler()->set_type("gaussian");
+      inner_product_param->mutable_bias_filler()->set_type("gaussian");
+      InnerProductLayer<Dtype> float_layer(layer_param);
+      Blob<Dtype> float_top;
+      vector<Blob<Dtype>*> float_top_vec(1, &float_top);
+      float_layer.SetUp(this->blob_bottom_vec_, float_top_vec);
+      layer_param.mutable_quantization_param()->set_precision(precisions[p]);
+      InnerProductLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < layer.blobs().size(); ++i) {
+        layer.blobs()[i]->CopyFrom(*float_layer.blobs()[i]);
+      }
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      Blob<Dtype>* weights = float_layer.blobs()[0].get();
+      vector<float> w(weights->cpu_data(),
+          weights->cpu_data() + weights->count());
+      vector<uint16_t> h(w.size());
+      const HalfFormat format = p == 0 ?
+          BlobProto_HalfFormat_FP16 : BlobProto_HalfFormat_BF16;
+      half_from_float_cpu(format, w.size(), &w[0], &h[0]);
+      half_to_float_cpu(format, h.size(), &h[0], &w[0]);
+      for (int i = 0; i < weights->count(); ++i) {
+        weights->mutable_cpu_data()[i] = w[i];
+      }
+      float_layer.Forward(this->blob_bottom_vec_, float_top_vec);
+      for (int i = 0; i < float_top.count(); ++i) {
+        EXPECT_NEAR(float_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+            1e-4);
+      }
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_nobatch_);
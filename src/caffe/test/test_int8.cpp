@@ -0,0 +1,81 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/int8.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class Int8Test : public ::testing::Test {};
+
+TEST_F(Int8Test, TestGemm) {
+  // K not a multiple of the vector width; the larger K splits N into panels
+  const int kSizes[][3] = { {5, 300, 37}, {3, 200, 5000} };
+  for (int s = 0; s < 2; ++s) {
+    const int M = kSizes[s][0], N = kSizes[s][1], K = kSizes[s][2];
+    vector<int8_t> A(M * K), B(N * K);
+    for (int i = 0; i < A.size(); ++i) {
+      A[i] = static_cast<int>(caffe_rng_rand() % 255) - kInt8Max;
+    }
+    for (int i = 0; i < B.size(); ++i) {
+      B[i] = static_cast<int>(caffe_rng_rand() % 255) - kInt8Max;
+    }
+    vector<int32_t> C(M * N);
+    int8_gemm_cpu(M, N, K, &A[0], &B[0], &C[0]);
+    for (int i = 0; i < M; ++i) {
+      for (int j = 0; j < N; ++j) {
+        int32_t expected = 0;
+        for (int k = 0; k < K; ++k) {
+          expected += A[i * K + k] * B[j * K + k];
+        }
+        ASSERT_EQ(expected, C[i * N + j]);
+      }
+    }
+  }
+}
+
+TEST_F(Int8Test, TestQuantizeTransposed) {
+  const int rows = 37, cols = 45;
+  vector<float> x(rows * cols);
+  for (int i = 0; i < x.size(); ++i) {
+    x[i] = i % 11 - 5;
+  }
+  vector<int8_t> q(rows * cols);
+  int8_quantize_transposed_cpu(rows, cols, &x[0], 0.5f, &q[0]);
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      EXPECT_EQ(x[r * cols + c] * 2, q[c * rows + r]);
+    }
+  }
+}
+
+TEST_F(Int8Test, TestBlobProto) {
+  Blob<float> blob(4, 3, 2, 2);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&blob);
+  BlobProto proto;
+  int8_blob_to_proto(blob, &proto);
+  EXPECT_EQ(0, proto.data_size());
+  EXPECT_EQ(blob.count(), proto.int8_data().size());
+  ASSERT_EQ(4, proto.int8_scale_size());
+  Blob<float> restored;
+  restored.FromProto(proto);
+  ASSERT_TRUE(restored.shape() == blob.shape());
+  for (int i = 0; i < blob.count(); ++i) {
+    EXPECT_LE(std::abs(restored.cpu_data()[i] - blob.cpu_data()[i]),
+        proto.int8_scale(i / 12) / 2 + 1e-6);
+  }
+  // storing the restored weights again gives the same int8 values
+  BlobProto proto2;
+  int8_blob_to_proto(restored, &proto2);
+  EXPECT_EQ(proto.int8_data(), proto2.int8_data());
+}
+
+}  // namespace caffe
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/knn.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class KNNTest : public ::testing::Test {
+ protected:
+  KNNTest() : dim_(16), num_(600), num_queries_(40) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    // points scattered around a few well separated centers
+    data_.resize(num_ * dim_);
+    queries_.resize(num_queries_ * dim_);
+    caffe_rng_gaussian<float>(data_.size(), 0, 1, &data_[0]);
+    caffe_rng_gaussian<float>(queries_.size(), 0, 1, &queries_[0]);
+    for (int i = 0; i < num_; ++i) {
+      data_[i * dim_ + i % dim_] += 10;
+    }
+    for (int i = 0; i < num_queries_; ++i) {
+      queries_[i * dim_ + i % dim_] += 10;
+    }
+  }
+
+  // the exact k nearest neighbors of query q, nearest first
+  vector<int> BruteForce(int q, int k) {
+    vector<std::pair<float, int> > dists;
+    for (int i = 0; i < num_; ++i) {
+      float dist = 0;
+      for (int j = 0; j < dim_; ++j) {
+        const float diff = queries_[q * dim_ + j] - data_[i * dim_ + j];
+        dist += diff * diff;
+      }
+      dists.push_back(std::make_pair(dist, i));
+    }
+    std::sort(dists.begin(), dists.end());
+    vector<int> ids;
+    for (int i = 0; i < k; ++i) {
+      ids.push_back(dists[i].second);
+    }
+    return ids;
+  }
+
+  const int dim_;
+  const int num_;
+  const int num_queries_;
+  vector<float> data_;
+  vector<float> queries_;
+};
+
+TEST_F(KNNTest, TestFlatSearch) {
+  const int k = 5;
+  FlatIndex index(dim_);
+  // added in two parts to check the ids continue
+  index.Add(num_ / 2, &data_[0]);
+  index.Add(num_ - num_ / 2, &data_[num_ / 2 * dim_]);
+  EXPECT_EQ(index.ntotal(), num_);
+  vector<int> ids(num_queries_ * k);
+  vector<float> dists(num_queries_ * k);
+  index.Search(num_queries_, &queries_[0], k, &ids[0], &dists[0]);
+  for (int q = 0; q < num_queries_; ++q) {
+    vector<int> expected = BruteForce(q, k);
+    for (int i = 0; i < k; ++i) {
+      EXPECT_EQ(expected[i], ids[q * k + i]);
+      if (i > 0) {
+        EXPECT_LE(dists[q * k + i - 1], dists[q * k + i]);
+      }
+    }
+  }
+}
+
+TEST_F(KNNTest, TestFlatSearchPadding) {
+  FlatIndex index(dim_);
+  index.Add(2, &data_[0]);
+  vector<int> ids(4);
+  vector<float> dists(4);
+  index.Search(1, &queries_[0], 4, &ids[0], &dists[0]);
+  EXPECT_GE(ids[0], 0);
+  EXPECT_GE(ids[1], 0);
+  EXPECT_EQ(ids[2], -1);
+  EXPECT_EQ(ids[3], -1);
+}
+
+TEST_F(KNNTest, TestKMeans) {
+  // the centers are recovered from the data
+  const int k = dim_;
+  vector<float> centroids(k * dim_);
+  KMeans(num_, dim_, &data_[0], k, 20, &centroids[0]);
+  int recovered = 0;
+  for (int c = 0; c < k; ++c) {
+    const float* centroid = &centroids[c * dim_];
+    const int axis = std::max_element(centroid, centroid + dim_) - centroid;
+    recovered += centroid[axis] > 8;
+  }
+  EXPECT_GE(recovered, k - 2);
+}
+
+TEST_F(KNNTest, TestIVFPQSearch) {
+  const int k = 10;
+  IVFPQIndex index(dim_, 8, 4);
+  EXPECT_FALSE(index.is_trained());
+  index.Train(num_, &data_[0]);
+  EXPECT_TRUE(index.is_trained());
+  index.Add(num_, &data_[0]);
+  EXPECT_EQ(index.ntotal(), num_);
+  index.set_nprobe(8);
+  vector<int> ids(num_queries_ * k);
+  vector<float> dists(num_queries_ * k);
+  index.Search(num_queries_, &queries_[0], k, &ids[0], &dists[0]);
+  // approximate: most true neighbors are found, all in the right cluster
+  int hits = 0;
+  for (int q = 0; q < num_queries_; ++q) {
+    vector<int> expected = BruteForce(q, k);
+    for (int i = 0; i < k; ++i) {
+      const int id = ids[q * k + i];
+      ASSERT_GE(id, 0);
+      EXPECT_EQ(id % dim_, q % dim_);
+      hits += std::find(expected.begin(), expected.end(), id) !=
+              expected.end();
+    }
+  }
+  EXPECT_GT(hits, num_queries_ * k / 4);
+}
+
+}  // namespace caffe
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
@@ -839,6 +841,89 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoFileWithState(proto, phase, level, stages);
   }
 
+  virtual void InitBranchingNet(const bool optimize_memory,
+                                const int forward_threads = 1) {
+    string proto =
+        "name: 'BranchingNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape: { dim: 4 dim: 5 } } "
+        "} ";
+    const char* ip_layers[][3] = { {"ip1", "data", "8"}, {"ip2", "ip1", "6"},
+        {"ip3a", "ip2", "6"}, {"ip3b", "ip2", "6"}, {"ip4", "ip3a", "6"} };
+    for (int i = 0; i < 5; ++i) {
+      proto += string("layer { name: '") + ip_layers[i][0] + "' "
+          "  type: 'InnerProduct' "
+          "  bottom: '" + ip_layers[i][1] + "' top: '" + ip_layers[i][0] + "' "
+          "  inner_product_param { num_output: " + ip_layers[i][2] +
+          "    weight_filler { type: 'gaussian' std: 0.5 } "
+          "    bias_filler { type: 'gaussian' std: 0.5 } "
+          "  } "
+          "} ";
+      if (i == 0) {
+        proto += "layer { name: 'relu1' type: 'ReLU' "
+            "  bottom: 'ip1' top: 'ip1' } ";
+      }
+    }
+    proto +=
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'ip4' "
+        "  bottom: 'ip3b' "
+        "  top: 'out' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.set_optimize_memory(optimize_memory);
+    param.set_forward_threads(forward_threads);
+    net_.reset(new Net<Dtype>(param));
+  }
+
+  virtual void InitDirectConvNet(const bool blocked_layout,
+                                 const bool optimize_memory) {
+    string proto =
+        "name: 'DirectConvNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape: { dim: 2 dim: 5 dim: 9 dim: 9 } } "
+        "} ";
+    // name, bottom, num_output, kernel_size, pad, and the layers after it
+    const char* conv_layers[][6] = {
+      {"conv1", "data", "12", "3", "1",
+       "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' } "
+       "layer { name: 'pool1' type: 'Pooling' bottom: 'conv1' top: 'pool1' "
+       "  pooling_param { pool: MAX kernel_size: 3 stride: 2 } } "},
+      {"conv2", "pool1", "10", "3", "1",
+       "layer { name: 'pool2' type: 'Pooling' bottom: 'conv2' top: 'pool2' "
+       "  pooling_param { pool: AVE kernel_size: 3 stride: 2 pad: 1 } } "},
+      {"conv3", "pool2", "3", "1", "0", ""} };
+    for (int i = 0; i < 3; ++i) {
+      proto += string("layer { name: '") + conv_layers[i][0] + "' "
+          "  type: 'Convolution' "
+          "  bottom: '" + conv_layers[i][1] + "' "
+          "  top: '" + conv_layers[i][0] + "' "
+          "  convolution_param { num_output: " + conv_layers[i][2] +
+          "    kernel_size: " + conv_layers[i][3] +
+          "    pad: " + conv_layers[i][4] + " engine: DIRECT "
+          "    weight_filler { type: 'gaussian' std: 0.5 } "
+          "    bias_filler { type: 'gaussian' std: 0.5 } "
+          "  } "
+          "} " + conv_layers[i][5];
+    }
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.set_blocked_layout(blocked_layout);
+    param.set_optimize_memory(optimize_memory);
+    net_.reset(new Net<Dtype>(param));
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
@@ -2446,6 +2531,109 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestOptimizeMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitBranchingNet(false);
+  shared_ptr<Net<Dtype> > reference_net = this->net_;
+  this->InitBranchingNet(true);
+  this->net_->ShareTrainedLayersWith(reference_net.get());
+  // Blobs whose lifetimes do not overlap share memory: ip1 ends at ip2, and
+  // ip2 with the tops of its split ends at ip3b.
+  const Net<Dtype>& net = *this->net_;
+  EXPECT_EQ(net.blob_by_name("ip1")->cpu_data(),
+      net.blob_by_name("ip3a")->cpu_data());
+  EXPECT_EQ(net.blob_by_name("ip2")->cpu_data(),
+      net.blob_by_name("ip4")->cpu_data());
+  EXPECT_NE(net.blob_by_name("ip3a")->cpu_data(),
+      net.blob_by_name("ip3b")->cpu_data());
+  EXPECT_NE(net.blob_by_name("data")->cpu_data(),
+      net.blob_by_name("ip3a")->cpu_data());
+  // The outputs match the unplanned net, also after reshaping the input.
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int num = 4; num <= 7; num += 3) {
+    Blob<Dtype>* reference_input = reference_net->input_blobs()[0];
+    Blob<Dtype>* input = this->net_->input_blobs()[0];
+    reference_input->Reshape(num, 5, 1, 1);
+    input->Reshape(num, 5, 1, 1);
+    filler.Fill(reference_input);
+    caffe_copy(input->count(), reference_input->cpu_data(),
+        input->mutable_cpu_data());
+    reference_net->Reshape();
+    this->net_->Reshape();
+    const Blob<Dtype>* reference_output = reference_net->Forward()[0];
+    // twice, as a reused buffer must not clobber the input
+    this->net_->Forward();
+    const Blob<Dtype>* output = this->net_->Forward()[0];
+    ASSERT_EQ(reference_output->count(), output->count());
+    for (int i = 0; i < output->count(); ++i) {
+      EXPECT_EQ(reference_output->cpu_data()[i], output->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestForwardThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitBranchingNet(false);
+  shared_ptr<Net<Dtype> > reference_net = this->net_;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  // The branches run concurrently, also when they reuse planned memory.
+  for (int optimize_memory = 0; optimize_memory <= 1; ++optimize_memory) {
+    this->InitBranchingNet(optimize_memory, 3);
+    this->net_->ShareTrainedLayersWith(reference_net.get());
+    for (int iter = 0; iter < 10; ++iter) {
+      Blob<Dtype>* reference_input = reference_net->input_blobs()[0];
+      filler.Fill(reference_input);
+      caffe_copy(reference_input->count(), reference_input->cpu_data(),
+          this->net_->input_blobs()[0]->mutable_cpu_data());
+      const Blob<Dtype>* reference_output = reference_net->Forward()[0];
+      const Blob<Dtype>* output = this->net_->Forward()[0];
+      ASSERT_EQ(reference_output->count(), output->count());
+      for (int i = 0; i < output->count(); ++i) {
+        EXPECT_EQ(reference_output->cpu_data()[i], output->cpu_data()[i]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestBlockedLayout) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The blocked layout is read by the CPU implementations only.
+  if (Caffe::mode() == Caffe::GPU) { return; }
+  this->InitDirectConvNet(false, false);
+  shared_ptr<Net<Dtype> > reference_net = this->net_;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int optimize_memory = 0; optimize_memory <= 1; ++optimize_memory) {
+    this->InitDirectConvNet(true, optimize_memory);
+    this->net_->ShareTrainedLayersWith(reference_net.get());
+    // The blobs between DIRECT convolutions, ReLU and pooling are blocked,
+    // the net input and output are not.
+    const Net<Dtype>& net = *this->net_;
+    EXPECT_FALSE(net.blob_by_name("data")->blocked());
+    EXPECT_TRUE(net.blob_by_name("conv1")->blocked());
+    EXPECT_TRUE(net.blob_by_name("pool1")->blocked());
+    EXPECT_TRUE(net.blob_by_name("conv2")->blocked());
+    EXPECT_TRUE(net.blob_by_name("pool2")->blocked());
+    EXPECT_FALSE(net.blob_by_name("conv3")->blocked());
+    EXPECT_FALSE(reference_net->blob_by_name("conv1")->blocked());
+    for (int iter = 0; iter < 2; ++iter) {
+      Blob<Dtype>* reference_input = reference_net->input_blobs()[0];
+      filler.Fill(reference_input);
+      caffe_copy(reference_input->count(), reference_input->cpu_data(),
+          this->net_->input_blobs()[0]->mutable_cpu_data());
+      const Blob<Dtype>* reference_output = reference_net->Forward()[0];
+      const Blob<Dtype>* output = this->net_->Forward()[0];
+      ASSERT_TRUE(reference_output->shape() == output->shape());
+      for (int i = 0; i < output->count(); ++i) {
+        EXPECT_NEAR(reference_output->cpu_data()[i], output->cpu_data()[i],
+            1e-4 * std::max(Dtype(1), std::fabs(output->cpu_data()[i])));
+      }
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -0,0 +1,111 @@
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/optimize_inference.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class OptimizeInferenceTest : public ::testing::Test {
+ protected:
+  OptimizeInferenceTest() {
+    Caffe::set_random_seed(1701);
+    const string proto =
+        "name: 'FoldingNetwork' "
+        "state { phase: TEST } "
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape: { dim: 2 dim: 3 dim: 9 dim: 9 } } } "
+        // Convolution, BatchNorm, Scale, ReLU and Dropout in place: one layer
+        "layer { name: 'conv1' type: 'Convolution' bottom: 'data' "
+        "  top: 'conv1' convolution_param { num_output: 4 kernel_size: 3 "
+        "  pad: 1 weight_filler { type: 'gaussian' std: 0.3 } "
+        "  bias_filler { type: 'gaussian' std: 0.3 } } } "
+        "layer { name: 'bn1' type: 'BatchNorm' bottom: 'conv1' top: 'conv1' } "
+        "layer { name: 'scale1' type: 'Scale' bottom: 'conv1' top: 'conv1' "
+        "  scale_param { bias_term: true } } "
+        "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' } "
+        "layer { name: 'drop1' type: 'Dropout' bottom: 'conv1' top: 'conv1' } "
+        // without a bias, BatchNorm and Bias out of place
+        "layer { name: 'conv2' type: 'Convolution' bottom: 'conv1' "
+        "  top: 'conv2' convolution_param { num_output: 5 kernel_size: 1 "
+        "  bias_term: false weight_filler { type: 'gaussian' std: 0.3 } } } "
+        "layer { name: 'bn2' type: 'BatchNorm' bottom: 'conv2' top: 'bn2' } "
+        "layer { name: 'bias2' type: 'Bias' bottom: 'bn2' top: 'bias2' } "
+        // a BatchNorm whose input is also read by Concat stays
+        "layer { name: 'conv3' type: 'Convolution' bottom: 'data' "
+        "  top: 'conv3' convolution_param { num_output: 5 kernel_size: 3 "
+        "  pad: 1 weight_filler { type: 'gaussian' std: 0.3 } } } "
+        "layer { name: 'bn3' type: 'BatchNorm' bottom: 'conv3' top: 'bn3' } "
+        "layer { name: 'concat' type: 'Concat' bottom: 'bias2' "
+        "  bottom: 'conv3' bottom: 'bn3' top: 'concat' } "
+        "layer { name: 'drop2' type: 'Dropout' bottom: 'concat' top: 'drop2' } "
+        "layer { name: 'pool' type: 'Pooling' bottom: 'drop2' top: 'pool' "
+        "  pooling_param { pool: MAX kernel_size: 3 stride: 2 } } ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<float>(param));
+    // Give the BatchNorm, Scale and Bias layers trained-looking parameters.
+    FillerParameter filler_param;
+    filler_param.set_min(0.5);
+    filler_param.set_max(2);
+    UniformFiller<float> positive_filler(filler_param);
+    GaussianFiller<float> gaussian_filler(filler_param);
+    for (int i = 0; i < net_->layers().size(); ++i) {
+      const string& type = net_->layers()[i]->type();
+      vector<shared_ptr<Blob<float> > >& blobs = net_->layers()[i]->blobs();
+      if (type == "BatchNorm") {
+        gaussian_filler.Fill(blobs[0].get());
+        positive_filler.Fill(blobs[1].get());
+        blobs[2]->mutable_cpu_data()[0] = 2;
+      } else if (type == "Scale" || type == "Bias") {
+        for (int j = 0; j < blobs.size(); ++j) {
+          gaussian_filler.Fill(blobs[j].get());
+        }
+      }
+    }
+    gaussian_filler.Fill(net_->input_blobs()[0]);
+  }
+
+  shared_ptr<Net<float> > net_;
+};
+
+TEST_F(OptimizeInferenceTest, TestOptimize) {
+  NetParameter trained;
+  net_->ToProto(&trained, false);
+  NetParameter optimized;
+  OptimizeInference(trained, &optimized);
+  std::map<string, int> num_layers;
+  for (int i = 0; i < optimized.layer_size(); ++i) {
+    ++num_layers[optimized.layer(i).type()];
+  }
+  EXPECT_EQ(3, num_layers["Convolution"]);
+  EXPECT_EQ(1, num_layers["BatchNorm"]);
+  EXPECT_EQ(0, num_layers["Scale"]);
+  EXPECT_EQ(0, num_layers["Bias"]);
+  EXPECT_EQ(0, num_layers["ReLU"]);
+  EXPECT_EQ(0, num_layers["Dropout"]);
+  EXPECT_EQ(0, num_layers["Split"]);
+  EXPECT_TRUE(optimized.layer(1).convolution_param().relu());
+
+  Net<float> optimized_net(optimized);
+  optimized_net.input_blobs()[0]->CopyFrom(*net_->input_blobs()[0]);
+  const Blob<float>* expected = net_->Forward()[0];
+  const Blob<float>* output = optimized_net.Forward()[0];
+  ASSERT_TRUE(expected->shape() == output->shape());
+  for (int i = 0; i < output->count(); ++i) {
+    EXPECT_NEAR(expected->cpu_data()[i], output->cpu_data()[i],
+        1e-4 * std::max(1.f, std::abs(expected->cpu_data()[i])));
+  }
+}
+
+}  // namespace caffe
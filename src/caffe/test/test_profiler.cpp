@@ -0,0 +1,88 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ProfilerTest : public ::testing::Test {
+ protected:
+  ProfilerTest() {
+    Caffe::set_mode(Caffe::CPU);
+    const string proto =
+        "name: 'ProfiledNetwork' "
+        "layer { name: 'data' type: 'DummyData' top: 'data' top: 'label' "
+        "  dummy_data_param { shape { dim: 4 dim: 5 } shape { dim: 4 dim: 3 } "
+        "    data_filler { type: 'gaussian' } } } "
+        "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip' "
+        "  inner_product_param { num_output: 3 "
+        "    weight_filler { type: 'gaussian' } } } "
+        "layer { name: 'loss' type: 'EuclideanLoss' bottom: 'ip' "
+        "  bottom: 'label' top: 'loss' } ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.mutable_state()->set_phase(TRAIN);
+    net_.reset(new Net<float>(param));
+  }
+  virtual ~ProfilerTest() {
+    Profiler::Get().Disable();
+  }
+
+  shared_ptr<Net<float> > net_;
+};
+
+TEST_F(ProfilerTest, TestRecord) {
+  Profiler& profiler = Profiler::Get();
+  profiler.Enable(true);
+  net_->ForwardBackward();
+  net_->ForwardBackward();
+  // 4 x 5 inputs, 3 outputs: data, top, weights and bias
+  const Profiler::Total forward = profiler.total("forward", "ip");
+  EXPECT_EQ(2, forward.count);
+  EXPECT_EQ(2 * 2 * 4 * 5 * 3, forward.flops);
+  EXPECT_EQ(2 * (20 + 12 + 15 + 3) * sizeof(float), forward.bytes);
+  const Profiler::Total backward = profiler.total("backward", "ip");
+  EXPECT_EQ(2, backward.count);
+  EXPECT_EQ(2 * forward.flops, backward.flops);
+  EXPECT_EQ(2 * forward.bytes, backward.bytes);
+  EXPECT_EQ(2, profiler.total("forward", "data").count);
+  EXPECT_EQ(0, profiler.total("forward", "data").flops);
+
+  string filename;
+  MakeTempFilename(&filename);
+  profiler.WriteTrace(filename);
+  EXPECT_FALSE(profiler.tracing());
+  std::ifstream file(filename.c_str());
+  std::stringstream trace;
+  trace << file.rdbuf();
+  EXPECT_EQ(0, trace.str().find("{\"traceEvents\": ["));
+  EXPECT_NE(string::npos, trace.str().find(
+      "{\"name\": \"ip\", \"cat\": \"backward\", \"ph\": \"X\""));
+
+  // the summary starts the next
+  profiler.LogSummary();
+  EXPECT_EQ(0, profiler.total("forward", "ip").count);
+  net_->Forward();
+  EXPECT_EQ(1, profiler.total("forward", "ip").count);
+}
+
+TEST_F(ProfilerTest, TestDisabled) {
+  Profiler& profiler = Profiler::Get();
+  profiler.Enable(false);
+  profiler.LogSummary();
+  profiler.Disable();
+  net_->ForwardBackward();
+  EXPECT_EQ(0, profiler.total("forward", "ip").count);
+  EXPECT_EQ(0, profiler.total("backward", "ip").count);
+}
+
+}  // namespace caffe
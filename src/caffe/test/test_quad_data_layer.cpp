@@ -0,0 +1,138 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/QuadDataLayer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+template <typename TypeParam>
+class QuadDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  QuadDataLayerTest()
+      : blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    MakeTempDir(&filename_);
+    filename_ += "/db";
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+  }
+  virtual ~QuadDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  // Writes records of the given ages in that order; every pixel of record i
+  // holds i, so a sample can be traced back to its record.
+  void Fill(const vector<int>& ages) {
+    scoped_ptr<db::DB> db(db::GetDB(DataParameter_DB_MMAP));
+    db->Open(filename_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < ages.size(); ++i) {
+      Datum datum;
+      datum.set_label(ages[i]);
+      datum.set_channels(1);
+      datum.set_height(2);
+      datum.set_width(2);
+      datum.set_data(string(4, static_cast<char>(i)));
+      stringstream ss;
+      ss << i;
+      string out;
+      CHECK(datum.SerializeToString(&out));
+      txn->Put(ss.str(), out);
+    }
+    txn->Commit();
+    db->Close();
+    ages_ = ages;
+  }
+
+  LayerParameter Param() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(16);
+    data_param->set_source(filename_);
+    data_param->set_backend(DataParameter_DB_MMAP);
+    param.mutable_qfunction_param()->set_age_margin(5);
+    return param;
+  }
+
+  // Checks the batch is made of valid quadruplets and returns how many
+  // followed the near/far age_margin split.
+  int CheckQuadruplets(int age_margin) {
+    const Dtype* data = blob_top_data_->cpu_data();
+    const Dtype* label = blob_top_label_->cpu_data();
+    int split = 0;
+    for (int i = 0; i < blob_top_data_->num(); ++i) {
+      // the label is the age of the record the pixels come from
+      const int record = static_cast<int>(data[i * 4]);
+      EXPECT_EQ(ages_[record], label[i]);
+    }
+    for (int i = 0; i < blob_top_data_->num(); i += 4) {
+      EXPECT_NE(data[i * 4], data[(i + 1) * 4]);
+      EXPECT_EQ(label[i], label[i + 1]);
+      EXPECT_NE(label[i], label[i + 2]);
+      EXPECT_NE(label[i + 1], label[i + 3]);
+      EXPECT_NE(label[i + 2], label[i + 3]);
+      if (std::fabs(label[i + 2] - label[i]) <= age_margin &&
+          std::fabs(label[i + 3] - label[i]) > age_margin) {
+        ++split;
+      }
+    }
+    return split;
+  }
+
+  string filename_;
+  vector<int> ages_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(QuadDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(QuadDataLayerTest, TestSample) {
+  typedef typename TypeParam::Dtype Dtype;
+  // an unordered database where every anchor age has near and far negatives
+  const int ages[] = { 20, 40, 23, 20, 60, 40, 23, 61, 20, 37, 60, 40 };
+  this->Fill(vector<int>(ages, ages + 12));
+  QuadDataLayer<Dtype> layer(this->Param());
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 16);
+  EXPECT_EQ(this->blob_top_label_->num(), 16);
+  for (int iter = 0; iter < 10; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(this->CheckQuadruplets(5), 4);
+  }
+}
+
+TYPED_TEST(QuadDataLayerTest, TestSampleFallback) {
+  typedef typename TypeParam::Dtype Dtype;
+  // no age has a near negative: far ones stand in for N1
+  const int ages[] = { 30, 50, 30, 50, 80 };
+  this->Fill(vector<int>(ages, ages + 5));
+  QuadDataLayer<Dtype> layer(this->Param());
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int iter = 0; iter < 10; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    this->CheckQuadruplets(5);
+  }
+}
+
+}  // namespace caffe
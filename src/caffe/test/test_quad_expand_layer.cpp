@@ -0,0 +1,105 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/QuadExpandLayer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class QuadExpandLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  QuadExpandLayerTest()
+      : blob_bottom_(new Blob<Dtype>(8, 3, 1, 1)),
+        blob_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~QuadExpandLayerTest() { delete blob_bottom_; delete blob_top_; }
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(QuadExpandLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(QuadExpandLayerTest, TestSetUp) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  QuadExpandLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), 4);
+  EXPECT_EQ(this->blob_top_->channels(), 9);
+  EXPECT_EQ(this->blob_top_->height(), 1);
+  EXPECT_EQ(this->blob_top_->width(), 1);
+}
+
+TYPED_TEST(QuadExpandLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  QuadExpandLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int S = this->blob_bottom_->channels();
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  // each top row is <N, A, P> for one negative of a quadruplet
+  for (int j = 0; j < this->blob_top_->num(); ++j) {
+    const int quad = (j / 2) * 4;
+    const int src[3] = { quad + 2 + j % 2, quad, quad + 1 };
+    for (int seg = 0; seg < 3; ++seg) {
+      for (int k = 0; k < S; ++k) {
+        EXPECT_EQ(top_data[(j * 3 + seg) * S + k],
+                  bottom_data[src[seg] * S + k]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(QuadExpandLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  QuadExpandLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(QuadExpandLayerTest, TestForwardView) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_quad_expand_param()->set_mode(
+      QuadExpandParameter_Mode_VIEW);
+  QuadExpandLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), 2);
+  EXPECT_EQ(this->blob_top_->channels(), 12);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // one <A, P, N1, N2> row per quadruplet, without a copy
+  EXPECT_EQ(this->blob_top_->cpu_data(), this->blob_bottom_->cpu_data());
+}
+
+TYPED_TEST(QuadExpandLayerTest, TestGradientView) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_quad_expand_param()->set_mode(
+      QuadExpandParameter_Mode_VIEW);
+  QuadExpandLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
@@ -0,0 +1,291 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/GeneratorLossLayer.hpp"
+#include "caffe/layers/QuadMergeLayer.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class QuadMergeLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  QuadMergeLayerTest()
+      : blob_bottom_original_(new Blob<Dtype>(8, 3, 1, 1)),
+        blob_bottom_generate_(new Blob<Dtype>(4, 3, 1, 1)),
+        blob_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_original_);
+    filler.Fill(this->blob_bottom_generate_);
+    blob_bottom_vec_.push_back(blob_bottom_original_);
+    blob_bottom_vec_.push_back(blob_bottom_generate_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~QuadMergeLayerTest() {
+    delete blob_bottom_original_;
+    delete blob_bottom_generate_;
+    delete blob_top_;
+  }
+  // The row of the generated blob that replaces the N1 or N2 row n.
+  int GeneratedRow(const int n) { return n / 4 * 2 + n % 4 - 2; }
+
+  // An embedding whose quadruplet rows are merged with generated ones and
+  // fed to a loss, with the merge in the given mode.
+  shared_ptr<Net<Dtype> > InitMergeNet(const QuadMergeParameter_Mode mode) {
+    const string merged =
+        mode == QuadMergeParameter_Mode_SHARE ? "original" : "merged";
+    const string proto =
+        "name: 'QuadMergeNet' "
+        "force_backward: true "
+        "layer { "
+        "  name: 'input' type: 'Input' "
+        "  top: 'data' top: 'generate' top: 'target' "
+        "  input_param { "
+        "    shape { dim: 8 dim: 5 } shape { dim: 4 dim: 3 } "
+        "    shape { dim: 8 dim: 3 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'embed' type: 'InnerProduct' bottom: 'data' top: 'original' "
+        "  inner_product_param { "
+        "    num_output: 3 weight_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'merge' type: 'QuadMerge' "
+        "  bottom: 'original' bottom: 'generate' top: '" + merged + "' "
+        "  quad_merge_param { mode: " + QuadMergeParameter_Mode_Name(mode) +
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' type: 'EuclideanLoss' "
+        "  bottom: '" + merged + "' bottom: 'target' top: 'loss' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    return shared_ptr<Net<Dtype> >(new Net<Dtype>(param));
+  }
+
+  Blob<Dtype>* const blob_bottom_original_;
+  Blob<Dtype>* const blob_bottom_generate_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(QuadMergeLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(QuadMergeLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  QuadMergeLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->shape(), this->blob_bottom_original_->shape());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int S = this->blob_top_->channels();
+  for (int n = 0; n < this->blob_top_->num(); ++n) {
+    // A and P from the original blob, N1 and N2 from the generated one
+    const Dtype* src = n % 4 < 2 ?
+        this->blob_bottom_original_->cpu_data() + n * S :
+        this->blob_bottom_generate_->cpu_data() + this->GeneratedRow(n) * S;
+    for (int k = 0; k < S; ++k) {
+      EXPECT_EQ(this->blob_top_->cpu_data()[n * S + k], src[k]);
+    }
+  }
+}
+
+TYPED_TEST(QuadMergeLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  QuadMergeLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(QuadMergeLayerTest, TestForwardShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_quad_merge_param()->set_mode(
+      QuadMergeParameter_Mode_SHARE);
+  Blob<Dtype> original;
+  original.CopyFrom(*this->blob_bottom_original_, false, true);
+  // in place of the original blob
+  vector<Blob<Dtype>*> top_vec(1, this->blob_bottom_original_);
+  QuadMergeLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, top_vec);
+  layer.Forward(this->blob_bottom_vec_, top_vec);
+  const int S = original.channels();
+  for (int n = 0; n < original.num(); ++n) {
+    const Dtype* src = n % 4 < 2 ? original.cpu_data() + n * S :
+        this->blob_bottom_generate_->cpu_data() + this->GeneratedRow(n) * S;
+    for (int k = 0; k < S; ++k) {
+      EXPECT_EQ(this->blob_bottom_original_->cpu_data()[n * S + k], src[k]);
+    }
+  }
+}
+
+TYPED_TEST(QuadMergeLayerTest, TestBackwardShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_quad_merge_param()->set_mode(
+      QuadMergeParameter_Mode_SHARE);
+  vector<Blob<Dtype>*> top_vec(1, this->blob_bottom_original_);
+  QuadMergeLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, top_vec);
+  layer.Forward(this->blob_bottom_vec_, top_vec);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> top_diff(this->blob_bottom_original_->shape());
+  filler.Fill(&top_diff);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+             this->blob_bottom_original_->mutable_cpu_diff());
+  layer.Backward(top_vec, vector<bool>(2, true), this->blob_bottom_vec_);
+  // A and P keep their diff in place, N1 and N2 move to the generated blob
+  const int S = top_diff.channels();
+  for (int n = 0; n < top_diff.num(); ++n) {
+    const bool original = n % 4 < 2;
+    for (int k = 0; k < S; ++k) {
+      const Dtype diff = top_diff.cpu_data()[n * S + k];
+      EXPECT_EQ(original ? diff : 0,
+                this->blob_bottom_original_->cpu_diff()[n * S + k]);
+      if (!original) {
+        EXPECT_EQ(diff, this->blob_bottom_generate_->cpu_diff()[
+            this->GeneratedRow(n) * S + k]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(QuadMergeLayerTest, TestShareNet) {
+  typedef typename TypeParam::Dtype Dtype;
+  // SHARE must train the embedding and the generated rows like COPY does
+  shared_ptr<Net<Dtype> > copy_net =
+      this->InitMergeNet(QuadMergeParameter_Mode_COPY);
+  shared_ptr<Net<Dtype> > share_net =
+      this->InitMergeNet(QuadMergeParameter_Mode_SHARE);
+  share_net->ShareTrainedLayersWith(copy_net.get());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  const char* inputs[] = { "data", "generate", "target" };
+  for (int i = 0; i < 3; ++i) {
+    Blob<Dtype>* blob = copy_net->blob_by_name(inputs[i]).get();
+    filler.Fill(blob);
+    share_net->blob_by_name(inputs[i])->CopyFrom(*blob);
+  }
+  const Dtype copy_loss = copy_net->ForwardBackward();
+  const Dtype share_loss = share_net->ForwardBackward();
+  EXPECT_NEAR(copy_loss, share_loss, 1e-6);
+  const Blob<Dtype>* diffs[][2] = {
+      { copy_net->blob_by_name("generate").get(),
+        share_net->blob_by_name("generate").get() },
+      { copy_net->layer_by_name("embed")->blobs()[0].get(),
+        share_net->layer_by_name("embed")->blobs()[0].get() } };
+  for (int d = 0; d < 2; ++d) {
+    for (int i = 0; i < diffs[d][0]->count(); ++i) {
+      EXPECT_NEAR(diffs[d][0]->cpu_diff()[i], diffs[d][1]->cpu_diff()[i],
+                  1e-6);
+    }
+  }
+}
+
+TYPED_TEST(QuadMergeLayerTest, TestGeneratorLossNet) {
+  typedef typename TypeParam::Dtype Dtype;
+  // One generated blob feeds both the merge and GeneratorLoss, and its diff
+  // is the sum of what both send back.
+  const string proto =
+      "name: 'GeneratorNet' "
+      "force_backward: true "
+      "layer { "
+      "  name: 'input' type: 'Input' "
+      "  top: 'data' top: 'label' top: 'generate' top: 'target' "
+      "  input_param { "
+      "    shape { dim: 8 dim: 5 } shape { dim: 8 } "
+      "    shape { dim: 4 dim: 3 } shape { dim: 8 dim: 3 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'embed' type: 'InnerProduct' bottom: 'data' top: 'original' "
+      "  inner_product_param { "
+      "    num_output: 3 weight_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'merge' type: 'QuadMerge' "
+      "  bottom: 'original' bottom: 'generate' top: 'merged' "
+      "} "
+      "layer { "
+      "  name: 'loss' type: 'EuclideanLoss' "
+      "  bottom: 'merged' bottom: 'target' top: 'loss' "
+      "} "
+      "layer { "
+      "  name: 'generator_loss' type: 'GeneratorLoss' "
+      "  bottom: 'original' bottom: 'label' bottom: 'generate' "
+      "  top: 'generator_loss' "
+      "  qfunction_param { margin: 0.1 } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(net.blob_by_name("data").get());
+  filler.Fill(net.blob_by_name("generate").get());
+  filler.Fill(net.blob_by_name("target").get());
+  Dtype* label = net.blob_by_name("label")->mutable_cpu_data();
+  for (int i = 0; i < 8; i += 4) {
+    label[i + 0] = label[i + 1] = 20;
+    label[i + 2] = 25;
+    label[i + 3] = 40;
+  }
+  net.ForwardBackward();
+  // GeneratorLoss alone on the same blobs
+  LayerParameter layer_param;
+  layer_param.mutable_qfunction_param()->set_margin(0.1);
+  GeneratorLossLayer<Dtype> layer(layer_param);
+  Blob<Dtype> generate;
+  generate.CopyFrom(*net.blob_by_name("generate"), false, true);
+  Blob<Dtype> loss;
+  vector<Blob<Dtype>*> bottom_vec;
+  bottom_vec.push_back(net.blob_by_name("original").get());
+  bottom_vec.push_back(net.blob_by_name("label").get());
+  bottom_vec.push_back(&generate);
+  vector<Blob<Dtype>*> top_vec(1, &loss);
+  layer.SetUp(bottom_vec, top_vec);
+  layer.Forward(bottom_vec, top_vec);
+  loss.mutable_cpu_diff()[0] = 1;
+  vector<bool> propagate_down(3, false);
+  propagate_down[2] = true;
+  layer.Backward(top_vec, propagate_down, bottom_vec);
+  const Blob<Dtype>* merged = net.blob_by_name("merged").get();
+  const Blob<Dtype>* target = net.blob_by_name("target").get();
+  const int S = merged->channels();
+  for (int n = 0; n < 8; ++n) {
+    if (n % 4 < 2) { continue; }
+    const int j = this->GeneratedRow(n);
+    for (int k = 0; k < S; ++k) {
+      EXPECT_EQ(net.blob_by_name("generate")->cpu_data()[j * S + k],
+                merged->cpu_data()[n * S + k]);
+      // the EuclideanLoss diff is (merged - target) / num
+      const Dtype expected = generate.cpu_diff()[j * S + k] +
+          (merged->cpu_data()[n * S + k] - target->cpu_data()[n * S + k]) / 8;
+      EXPECT_NEAR(expected, net.blob_by_name("generate")->cpu_diff()[j * S + k],
+                  1e-5);
+    }
+  }
+}
+
+}  // namespace caffe
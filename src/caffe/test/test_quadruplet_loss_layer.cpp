@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/QuadrupletLossLayer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class QuadrupletLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  QuadrupletLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(32, 5, 1, 1)),
+        blob_bottom_label_(new Blob<Dtype>(32, 1, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    // fill the values
+    FillerParameter filler_param;
+    filler_param.set_min(-1.0);
+    filler_param.set_max(1.0);  // distances~=1.0 to test both sides of margin
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    // <A, P, N1, N2> with A and P sharing an age and distinct negatives
+    Dtype* label = blob_bottom_label_->mutable_cpu_data();
+    for (int i = 0; i < blob_bottom_label_->num(); i += 4) {
+      const int age = caffe_rng_rand() % 60;
+      label[i + 0] = age;
+      label[i + 1] = age;
+      label[i + 2] = age + 1 + caffe_rng_rand() % 9;
+      label[i + 3] = age + 10 + caffe_rng_rand() % 50;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~QuadrupletLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+  }
+
+  Dtype DistSq(int i, int j) {
+    const int channels = this->blob_bottom_data_->channels();
+    const Dtype* data = this->blob_bottom_data_->cpu_data();
+    Dtype dist_sq(0);
+    for (int k = 0; k < channels; ++k) {
+      Dtype diff = data[i * channels + k] - data[j * channels + k];
+      dist_sq += diff * diff;
+    }
+    return dist_sq;
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(QuadrupletLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(QuadrupletLossLayerTest, TestQFunctionTable) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_qfunction_param()->set_max_age(80);
+  QFunction<Dtype> q_func;
+  q_func.setup(layer_param);
+  EXPECT_EQ(q_func.table_.count(), 81);
+  // integer gaps hit the table, which must agree with the closed form
+  for (int d = 0; d <= 80; ++d) {
+    EXPECT_NEAR(q_func.call(Dtype(3), Dtype(3 + d)),
+                q_func.Q(Dtype(3), Dtype(3 + d)), 1e-6);
+    EXPECT_EQ(q_func.call(Dtype(3 + d), Dtype(3)),
+              q_func.table_.cpu_data()[d]);
+  }
+  EXPECT_EQ(q_func.call(Dtype(0), Dtype(0)), Dtype(0));
+  // the gap at max_age is normalized to 1
+  EXPECT_NEAR(q_func.call(Dtype(0), Dtype(80)), Dtype(1), 1e-6);
+  // fractional and out of range gaps fall back to the closed form
+  EXPECT_EQ(q_func.call(Dtype(0), Dtype(2.5)), q_func.Q(Dtype(0), Dtype(2.5)));
+  EXPECT_EQ(q_func.call(Dtype(0), Dtype(90)), q_func.Q(Dtype(0), Dtype(90)));
+}
+
+TYPED_TEST(QuadrupletLossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  QuadrupletLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // manually compute to compare
+  QFunction<Dtype> q_func;
+  q_func.setup(layer_param);
+  const Dtype margin = layer_param.qfunction_param().margin();
+  const Dtype* label = this->blob_bottom_label_->cpu_data();
+  const int num = this->blob_bottom_data_->num();
+  Dtype loss(0);
+  for (int i = 0; i < num; i += 4) {
+    loss += this->DistSq(i, i + 1);
+    loss += std::max(Dtype(0), margin -
+        q_func.call(label[i], label[i + 2]) * this->DistSq(i, i + 2));
+    loss += std::max(Dtype(0), margin -
+        q_func.call(label[i + 1], label[i + 3]) * this->DistSq(i + 1, i + 3));
+  }
+  loss /= static_cast<Dtype>(num);
+  EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], loss, 1e-6);
+}
+
+TYPED_TEST(QuadrupletLossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  QuadrupletLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
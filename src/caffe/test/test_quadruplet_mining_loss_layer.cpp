@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/QuadrupletMiningLossLayer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class QuadrupletMiningLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  QuadrupletMiningLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(12, 4, 1, 1)),
+        blob_bottom_label_(new Blob<Dtype>(12, 1, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_min(-1.0);
+    filler_param.set_max(1.0);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    // an unordered batch: four ages, three samples each, plus an age with a
+    // single sample that can only serve as a negative
+    const Dtype ages[12] = { 20, 35, 20, 50, 35, 62, 20, 50, 35, 50, 8, 62 };
+    for (int i = 0; i < 12; ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = ages[i];
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~QuadrupletMiningLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+  }
+
+  Dtype DistSq(int i, int j) {
+    const int channels = this->blob_bottom_data_->channels();
+    const Dtype* data = this->blob_bottom_data_->cpu_data();
+    Dtype dist_sq(0);
+    for (int k = 0; k < channels; ++k) {
+      Dtype diff = data[i * channels + k] - data[j * channels + k];
+      dist_sq += diff * diff;
+    }
+    return dist_sq;
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(QuadrupletMiningLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(QuadrupletMiningLossLayerTest, TestMining) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_quadruplet_mining_param()->set_strategy(
+      QuadrupletMiningParameter_Strategy_HARD);
+  QuadrupletMiningLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  QFunction<Dtype> q_func;
+  q_func.setup(layer_param);
+  const Dtype* label = this->blob_bottom_label_->cpu_data();
+  const int num = this->blob_bottom_data_->num();
+  const vector<int>& mined = layer.mined();
+  // every sample but the lone 8 year old is an anchor
+  ASSERT_EQ(mined.size(), 4 * (num - 1));
+  for (int i = 0; i < mined.size(); i += 4) {
+    const int a = mined[i], p = mined[i + 1], n1 = mined[i + 2];
+    const int n2 = mined[i + 3];
+    EXPECT_NE(a, p);
+    EXPECT_EQ(label[a], label[p]);
+    EXPECT_NE(label[a], label[n1]);
+    EXPECT_NE(label[p], label[n2]);
+    EXPECT_NE(label[n1], label[n2]);
+    for (int j = 0; j < num; ++j) {
+      if (j != a && label[j] == label[a]) {
+        // the hardest positive is the farthest one
+        EXPECT_GE(this->DistSq(a, p), this->DistSq(a, j) - 1e-4);
+      } else if (label[j] != label[a]) {
+        // the hardest negative has the smallest Q-weighted distance
+        EXPECT_LE(q_func.call(label[a], label[n1]) * this->DistSq(a, n1),
+                  q_func.call(label[a], label[j]) * this->DistSq(a, j) + 1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(QuadrupletMiningLossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  QuadrupletMiningLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // manually compute the loss of the mined quadruplets to compare
+  QFunction<Dtype> q_func;
+  q_func.setup(layer_param);
+  const Dtype margin = layer_param.qfunction_param().margin();
+  const Dtype* label = this->blob_bottom_label_->cpu_data();
+  const vector<int>& mined = layer.mined();
+  ASSERT_GT(mined.size(), 0);
+  Dtype loss(0);
+  for (int i = 0; i < mined.size(); i += 4) {
+    const int a = mined[i], p = mined[i + 1], n1 = mined[i + 2];
+    const int n2 = mined[i + 3];
+    loss += this->DistSq(a, p);
+    loss += std::max(Dtype(0), margin -
+        q_func.call(label[a], label[n1]) * this->DistSq(a, n1));
+    loss += std::max(Dtype(0), margin -
+        q_func.call(label[p], label[n2]) * this->DistSq(p, n2));
+  }
+  loss /= static_cast<Dtype>(mined.size());
+  EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], loss, 1e-6);
+}
+
+TYPED_TEST(QuadrupletMiningLossLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  QuadrupletMiningLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  GradientChecker<Dtype> checker(1e-3, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
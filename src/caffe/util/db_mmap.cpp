@@ -0,0 +1,209 @@
+#include "caffe/util/db_mmap.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/static_assert.hpp>
+
+#include <cstring>
+#include <string>
+
+namespace caffe { namespace db {
+
+static const char kMMapMagic[8] = { 'C', 'A', 'F', 'F', 'E', 'R', 'E', 'C' };
+static const uint32_t kMMapVersion = 1;
+// records start at a fixed, aligned offset after the header
+static const uint64_t kMMapDataOffset = 64;
+BOOST_STATIC_ASSERT(sizeof(MMapHeader) <= kMMapDataOffset);
+
+const char* MMapCursor::record() const {
+  CHECK_LT(index_, header_->num_records);
+  return base_ + kMMapDataOffset + index_ * header_->record_size;
+}
+
+string MMapCursor::key() {
+  CHECK(valid());
+  const uint64_t* offsets =
+      reinterpret_cast<const uint64_t*>(base_ + header_->keys_offset);
+  const char* keys = reinterpret_cast<const char*>(
+      offsets + header_->num_records + 1);
+  return string(keys + offsets[index_], offsets[index_ + 1] - offsets[index_]);
+}
+
+bool MMapCursor::Seek(const string& key) {
+  if (key_index_.empty()) {
+    const uint64_t index = index_;
+    for (index_ = 0; index_ < header_->num_records; ++index_) {
+      key_index_[this->key()] = index_;
+    }
+    index_ = index;
+  }
+  map<string, uint64_t>::const_iterator it = key_index_.find(key);
+  index_ = it == key_index_.end() ? header_->num_records : it->second;
+  return it != key_index_.end();
+}
+
+string MMapCursor::value() {
+  Datum datum;
+  ReadDatum(&datum);
+  string out;
+  CHECK(datum.SerializeToString(&out));
+  return out;
+}
+
+void MMapCursor::ReadDatum(Datum* datum) {
+  datum->set_channels(header_->channels);
+  datum->set_height(header_->height);
+  datum->set_width(header_->width);
+  datum->set_label(label());
+  datum->set_encoded(false);
+  datum->clear_float_data();
+  // assign() reuses the capacity of the datum's buffer
+  datum->mutable_data()->assign(reinterpret_cast<const char*>(pixels()),
+      header_->channels * header_->height * header_->width);
+}
+
+void MMap::Open(const string& source, Mode mode) {
+  source_ = source;
+  if (mode == READ) {
+    fd_ = open(source.c_str(), O_RDONLY);
+    CHECK_NE(fd_, -1) << "File not found: " << source;
+    struct stat st;
+    CHECK_EQ(fstat(fd_, &st), 0) << "stat " << source << " failed";
+    map_size_ = st.st_size;
+    CHECK_GE(map_size_, kMMapDataOffset) << source << " is not an mmap db";
+    void* map = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd_, 0);
+    CHECK(map != MAP_FAILED) << "mmap " << source << " failed";
+    map_ = static_cast<char*>(map);
+    const MMapHeader* header = reinterpret_cast<const MMapHeader*>(map_);
+    CHECK_EQ(memcmp(header->magic, kMMapMagic, sizeof(kMMapMagic)), 0)
+        << source << " is not an mmap db";
+    CHECK_EQ(header->version, kMMapVersion) << "Unsupported mmap db version";
+    // Every region the cursors read must lie inside the file, so that a
+    // truncated or corrupt db fails here rather than faulting later.
+    const uint64_t keys_offset = header->keys_offset;
+    const uint64_t num_records = header->num_records;
+    CHECK_GE(keys_offset, kMMapDataOffset) << source << " is corrupt";
+    CHECK_EQ(keys_offset % sizeof(uint64_t), 0) << source << " is corrupt";
+    CHECK_LE(keys_offset, map_size_) << source << " is truncated";
+    if (num_records > 0) {
+      CHECK_GE(header->record_size, sizeof(int32_t) +
+          static_cast<uint64_t>(header->channels) * header->height *
+          header->width) << source << " is corrupt";
+      CHECK_LE(num_records,
+          (keys_offset - kMMapDataOffset) / header->record_size)
+          << source << " is truncated";
+    }
+    const uint64_t key_bytes = map_size_ - keys_offset;
+    CHECK_LT(num_records, key_bytes / sizeof(uint64_t))
+        << source << " is truncated";
+    const uint64_t* key_offsets =
+        reinterpret_cast<const uint64_t*>(map_ + keys_offset);
+    const uint64_t keys_size = key_bytes - (num_records + 1) * sizeof(uint64_t);
+    CHECK_EQ(key_offsets[0], 0u) << source << " is corrupt";
+    for (uint64_t i = 0; i < num_records; ++i) {
+      CHECK_LE(key_offsets[i], key_offsets[i + 1]) << source << " is corrupt";
+    }
+    CHECK_LE(key_offsets[num_records], keys_size)
+        << source << " is truncated";
+    LOG_IF(INFO, Caffe::root_solver()) << "Opened mmap db " << source
+        << " (" << header->num_records << " records)";
+  } else {
+    CHECK_EQ(mode, NEW) << "mmap databases are written once, in mode NEW";
+    out_.open(source.c_str(), std::ios::out | std::ios::binary |
+        std::ios::trunc);
+    CHECK(out_.is_open()) << "Failed to open " << source;
+    memset(&header_, 0, sizeof(header_));
+    memcpy(header_.magic, kMMapMagic, sizeof(kMMapMagic));
+    header_.version = kMMapVersion;
+    key_offsets_.assign(1, 0);
+    keys_.clear();
+    // the header is written on Close(), once the records are known
+    const string padding(kMMapDataOffset, '\0');
+    out_.write(padding.data(), padding.size());
+  }
+}
+
+void MMap::Close() {
+  if (map_ != NULL) {
+    munmap(map_, map_size_);
+    map_ = NULL;
+  }
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+  if (out_.is_open()) {
+    // align the key offsets
+    const uint64_t end = out_.tellp();
+    header_.keys_offset = (end + 7) / 8 * 8;
+    const string padding(header_.keys_offset - end, '\0');
+    out_.write(padding.data(), padding.size());
+    out_.write(reinterpret_cast<const char*>(&key_offsets_[0]),
+        key_offsets_.size() * sizeof(uint64_t));
+    out_.write(keys_.data(), keys_.size());
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    out_.close();
+    CHECK(!out_.fail()) << "Failed to write " << source_;
+  }
+}
+
+MMapCursor* MMap::NewCursor() {
+  CHECK(map_) << "mmap db " << source_ << " is not open for reading";
+  return new MMapCursor(map_);
+}
+
+MMapTransaction* MMap::NewTransaction() {
+  CHECK(out_.is_open()) << "mmap db " << source_
+      << " is not open for writing";
+  return new MMapTransaction(this);
+}
+
+void MMap::Append(const string& key, const Datum& datum) {
+  CHECK(!datum.encoded()) << "mmap db records must be decoded";
+  CHECK_EQ(datum.float_data_size(), 0) << "mmap db records must be uint8";
+  if (header_.num_records == 0) {
+    header_.channels = datum.channels();
+    header_.height = datum.height();
+    header_.width = datum.width();
+    // keep the int32 labels aligned
+    header_.record_size = (sizeof(int32_t) + datum.data().size() + 3) / 4 * 4;
+  }
+  CHECK_EQ(datum.channels(), header_.channels) << "mmap db records must "
+      << "all have the same shape; resize the images first";
+  CHECK_EQ(datum.height(), header_.height);
+  CHECK_EQ(datum.width(), header_.width);
+  const uint64_t size = datum.data().size();
+  CHECK_EQ(size, static_cast<uint64_t>(header_.channels) * header_.height *
+      header_.width);
+  const int32_t label = datum.label();
+  out_.write(reinterpret_cast<const char*>(&label), sizeof(label));
+  out_.write(datum.data().data(), size);
+  const string padding(header_.record_size - sizeof(label) - size, '\0');
+  out_.write(padding.data(), padding.size());
+  ++header_.num_records;
+  keys_ += key;
+  key_offsets_.push_back(keys_.size());
+}
+
+void MMapTransaction::Put(const string& key, const string& value) {
+  keys.push_back(key);
+  values.push_back(value);
+}
+
+void MMapTransaction::Commit() {
+  Datum datum;
+  for (int i = 0; i < keys.size(); i++) {
+    CHECK(datum.ParseFromString(values[i])) << "mmap db values must be Datums";
+    db_->Append(keys[i], datum);
+  }
+  keys.clear();
+  values.clear();
+  CHECK(!db_->out_.fail()) << "Failed to write " << db_->source_;
+}
+
+}  // namespace db
+}  // namespace caffe
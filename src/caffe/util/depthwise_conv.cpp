@@ -0,0 +1,167 @@
+#include <algorithm>
+
+#include "caffe/util/conv_range.hpp"
+#include "caffe/util/depthwise_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void depthwise_conv_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int output_h,
+    const int output_w, const Dtype* weights, Dtype* data_out) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* im = data_im + c * height * width;
+    const Dtype* weight = weights + c * kernel_h * kernel_w;
+    for (int oy = 0; oy < output_h; ++oy) {
+      Dtype* out = data_out + (c * output_h + oy) * output_w;
+      caffe_set(output_w, Dtype(0), out);
+      for (int ky = 0; ky < kernel_h; ++ky) {
+        const int iy = oy * stride_h - pad_h + ky * dilation_h;
+        if (iy < 0 || iy >= height) { continue; }
+        for (int kx = 0; kx < kernel_w; ++kx) {
+          const int offset = kx * dilation_w - pad_w;
+          int begin, end;
+          valid_output_range(offset, stride_w, width, output_w, &begin, &end);
+          const Dtype w = weight[ky * kernel_w + kx];
+          const Dtype* in = im + iy * width + offset;
+          if (stride_w == 1) {
+            for (int ox = begin; ox < end; ++ox) {
+              out[ox] += w * in[ox];
+            }
+          } else {
+            for (int ox = begin; ox < end; ++ox) {
+              out[ox] += w * in[ox * stride_w];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template void depthwise_conv_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int output_h, const int output_w, const float* weights,
+    float* data_out);
+template void depthwise_conv_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width, const int kernel_h,
+    const int kernel_w, const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int output_h, const int output_w, const double* weights,
+    double* data_out);
+
+template <typename Dtype>
+void depthwise_conv_backward_data_cpu(const Dtype* out_diff,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int output_h, const int output_w,
+    const Dtype* weights, Dtype* im_diff) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int c = 0; c < channels; ++c) {
+    Dtype* im = im_diff + c * height * width;
+    const Dtype* weight = weights + c * kernel_h * kernel_w;
+    caffe_set(height * width, Dtype(0), im);
+    for (int oy = 0; oy < output_h; ++oy) {
+      const Dtype* out = out_diff + (c * output_h + oy) * output_w;
+      for (int ky = 0; ky < kernel_h; ++ky) {
+        const int iy = oy * stride_h - pad_h + ky * dilation_h;
+        if (iy < 0 || iy >= height) { continue; }
+        for (int kx = 0; kx < kernel_w; ++kx) {
+          const int offset = kx * dilation_w - pad_w;
+          int begin, end;
+          valid_output_range(offset, stride_w, width, output_w, &begin, &end);
+          const Dtype w = weight[ky * kernel_w + kx];
+          Dtype* in = im + iy * width + offset;
+          if (stride_w == 1) {
+            for (int ox = begin; ox < end; ++ox) {
+              in[ox] += w * out[ox];
+            }
+          } else {
+            for (int ox = begin; ox < end; ++ox) {
+              in[ox * stride_w] += w * out[ox];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template void depthwise_conv_backward_data_cpu<float>(const float* out_diff,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int output_h, const int output_w,
+    const float* weights, float* im_diff);
+template void depthwise_conv_backward_data_cpu<double>(const double* out_diff,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int output_h, const int output_w,
+    const double* weights, double* im_diff);
+
+template <typename Dtype>
+void depthwise_conv_backward_weight_cpu(const Dtype* data_im,
+    const Dtype* out_diff, const int channels, const int height,
+    const int width, const int kernel_h, const int kernel_w, const int pad_h,
+    const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int output_h,
+    const int output_w, Dtype* weight_diff) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* im = data_im + c * height * width;
+    Dtype* weight = weight_diff + c * kernel_h * kernel_w;
+    for (int oy = 0; oy < output_h; ++oy) {
+      const Dtype* out = out_diff + (c * output_h + oy) * output_w;
+      for (int ky = 0; ky < kernel_h; ++ky) {
+        const int iy = oy * stride_h - pad_h + ky * dilation_h;
+        if (iy < 0 || iy >= height) { continue; }
+        for (int kx = 0; kx < kernel_w; ++kx) {
+          const int offset = kx * dilation_w - pad_w;
+          int begin, end;
+          valid_output_range(offset, stride_w, width, output_w, &begin, &end);
+          const Dtype* in = im + iy * width + offset;
+          Dtype sum = 0;
+          if (stride_w == 1) {
+            for (int ox = begin; ox < end; ++ox) {
+              sum += in[ox] * out[ox];
+            }
+          } else {
+            for (int ox = begin; ox < end; ++ox) {
+              sum += in[ox * stride_w] * out[ox];
+            }
+          }
+          weight[ky * kernel_w + kx] += sum;
+        }
+      }
+    }
+  }
+}
+
+template void depthwise_conv_backward_weight_cpu<float>(const float* data_im,
+    const float* out_diff, const int channels, const int height,
+    const int width, const int kernel_h, const int kernel_w, const int pad_h,
+    const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int output_h,
+    const int output_w, float* weight_diff);
+template void depthwise_conv_backward_weight_cpu<double>(
+    const double* data_im, const double* out_diff, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int output_h,
+    const int output_w, double* weight_diff);
+
+}  // namespace caffe
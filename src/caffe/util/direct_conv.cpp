@@ -0,0 +1,358 @@
+#if (defined(__AVX2__) && defined(__FMA__)) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#include "caffe/util/direct_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// The number of output pixels of a row computed together, so that every
+// weight vector loaded is used that many times.
+static const int kDirectConvPixels = 4;
+
+// The number of output channel blocks computed together: with AVX-512, two
+// 8-channel blocks fill a 16-float register.
+#ifdef __AVX512F__
+static const int kDirectConvOutBlocks = 2;
+#else
+static const int kDirectConvOutBlocks = 1;
+#endif
+
+// Accumulates n <= kDirectConvPixels output pixels of 8 channels. im points
+// to the first input of the first pixel; the inputs of a pixel are
+// pixel_step apart, the kernel taps row_step and col_step apart and the
+// channel blocks plane apart.
+template <typename Dtype>
+inline void direct_conv_pixels_generic(const Dtype* im, const Dtype* weights,
+    const int blocks, const int kernel_h, const int kernel_w,
+    const int row_step, const int col_step, const int plane,
+    const int pixel_step, const int n, Dtype* out) {
+  const int B = kDirectConvBlock;
+  Dtype acc[kDirectConvPixels * kDirectConvBlock] = { 0 };
+  for (int cb = 0; cb < blocks; ++cb) {
+    for (int ky = 0; ky < kernel_h; ++ky) {
+      for (int kx = 0; kx < kernel_w; ++kx) {
+        const Dtype* x = im + cb * plane + ky * row_step + kx * col_step;
+        const Dtype* w =
+            weights + ((cb * kernel_h + ky) * kernel_w + kx) * B * B;
+        for (int c = 0; c < B; ++c) {
+          for (int p = 0; p < n; ++p) {
+            const Dtype value = x[p * pixel_step + c];
+            for (int k = 0; k < B; ++k) {
+              acc[p * B + k] += value * w[c * B + k];
+            }
+          }
+        }
+      }
+    }
+  }
+  for (int i = 0; i < n * B; ++i) {
+    out[i] = acc[i];
+  }
+}
+
+template <typename Dtype>
+inline void direct_conv_pixels(const Dtype* im, const Dtype* weights,
+    const int blocks, const int kernel_h, const int kernel_w,
+    const int row_step, const int col_step, const int plane,
+    const int pixel_step, const int n, Dtype* out) {
+  direct_conv_pixels_generic(im, weights, blocks, kernel_h, kernel_w,
+      row_step, col_step, plane, pixel_step, n, out);
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+// One 8-float register per output pixel, kept for the whole reduction.
+template <>
+inline void direct_conv_pixels<float>(const float* im, const float* weights,
+    const int blocks, const int kernel_h, const int kernel_w,
+    const int row_step, const int col_step, const int plane,
+    const int pixel_step, const int n, float* out) {
+  if (n != kDirectConvPixels) {
+    direct_conv_pixels_generic(im, weights, blocks, kernel_h, kernel_w,
+        row_step, col_step, plane, pixel_step, n, out);
+    return;
+  }
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  __m256 acc2 = _mm256_setzero_ps();
+  __m256 acc3 = _mm256_setzero_ps();
+  for (int cb = 0; cb < blocks; ++cb) {
+    for (int ky = 0; ky < kernel_h; ++ky) {
+      for (int kx = 0; kx < kernel_w; ++kx) {
+        const float* x = im + cb * plane + ky * row_step + kx * col_step;
+        const float* w =
+            weights + ((cb * kernel_h + ky) * kernel_w + kx) * 64;
+        for (int c = 0; c < 8; ++c) {
+          const __m256 wc = _mm256_loadu_ps(w + c * 8);
+          acc0 = _mm256_fmadd_ps(_mm256_set1_ps(x[c]), wc, acc0);
+          acc1 = _mm256_fmadd_ps(_mm256_set1_ps(x[pixel_step + c]), wc, acc1);
+          acc2 = _mm256_fmadd_ps(_mm256_set1_ps(x[2 * pixel_step + c]), wc,
+              acc2);
+          acc3 = _mm256_fmadd_ps(_mm256_set1_ps(x[3 * pixel_step + c]), wc,
+              acc3);
+        }
+      }
+    }
+  }
+  _mm256_storeu_ps(out, acc0);
+  _mm256_storeu_ps(out + 8, acc1);
+  _mm256_storeu_ps(out + 16, acc2);
+  _mm256_storeu_ps(out + 24, acc3);
+}
+#endif
+
+// direct_conv_pixels for two output channel blocks, whose weights are
+// weight_block and outputs out_block apart.
+template <typename Dtype>
+inline void direct_conv_pixels2(const Dtype* im, const Dtype* weights,
+    const int weight_block, const int blocks, const int kernel_h,
+    const int kernel_w, const int row_step, const int col_step,
+    const int plane, const int pixel_step, const int n, Dtype* out,
+    const int out_block) {
+  direct_conv_pixels(im, weights, blocks, kernel_h, kernel_w, row_step,
+      col_step, plane, pixel_step, n, out);
+  direct_conv_pixels(im, weights + weight_block, blocks, kernel_h, kernel_w,
+      row_step, col_step, plane, pixel_step, n, out + out_block);
+}
+
+#ifdef __AVX512F__
+// One 16-float register per output pixel, the low half accumulating the
+// first block and the high half the second, so each input broadcast feeds
+// 16 output channels.
+template <>
+inline void direct_conv_pixels2<float>(const float* im, const float* weights,
+    const int weight_block, const int blocks, const int kernel_h,
+    const int kernel_w, const int row_step, const int col_step,
+    const int plane, const int pixel_step, const int n, float* out,
+    const int out_block) {
+  if (n != kDirectConvPixels) {
+    direct_conv_pixels(im, weights, blocks, kernel_h, kernel_w, row_step,
+        col_step, plane, pixel_step, n, out);
+    direct_conv_pixels(im, weights + weight_block, blocks, kernel_h,
+        kernel_w, row_step, col_step, plane, pixel_step, n, out + out_block);
+    return;
+  }
+  __m512 acc0 = _mm512_setzero_ps();
+  __m512 acc1 = _mm512_setzero_ps();
+  __m512 acc2 = _mm512_setzero_ps();
+  __m512 acc3 = _mm512_setzero_ps();
+  for (int cb = 0; cb < blocks; ++cb) {
+    for (int ky = 0; ky < kernel_h; ++ky) {
+      for (int kx = 0; kx < kernel_w; ++kx) {
+        const float* x = im + cb * plane + ky * row_step + kx * col_step;
+        const float* w =
+            weights + ((cb * kernel_h + ky) * kernel_w + kx) * 64;
+        for (int c = 0; c < 8; ++c) {
+          const __m512 wc = _mm512_castpd_ps(_mm512_insertf64x4(
+              _mm512_castpd256_pd512(_mm256_castps_pd(
+              _mm256_loadu_ps(w + c * 8))), _mm256_castps_pd(
+              _mm256_loadu_ps(w + weight_block + c * 8)), 1));
+          acc0 = _mm512_fmadd_ps(_mm512_set1_ps(x[c]), wc, acc0);
+          acc1 = _mm512_fmadd_ps(_mm512_set1_ps(x[pixel_step + c]), wc, acc1);
+          acc2 = _mm512_fmadd_ps(_mm512_set1_ps(x[2 * pixel_step + c]), wc,
+              acc2);
+          acc3 = _mm512_fmadd_ps(_mm512_set1_ps(x[3 * pixel_step + c]), wc,
+              acc3);
+        }
+      }
+    }
+  }
+  const __m512 acc[4] = { acc0, acc1, acc2, acc3 };
+  for (int p = 0; p < 4; ++p) {
+    _mm256_storeu_ps(out + p * 8, _mm512_castps512_ps256(acc[p]));
+    _mm256_storeu_ps(out + out_block + p * 8, _mm256_castpd_ps(
+        _mm512_extractf64x4_pd(_mm512_castps_pd(acc[p]), 1)));
+  }
+}
+#endif
+
+template <typename Dtype>
+void direct_conv_pack_weights_cpu(const Dtype* weights,
+    const int out_channels, const int in_channels, const int kernel_h,
+    const int kernel_w, Dtype* packed) {
+  const int B = kDirectConvBlock;
+  const int in_blocks = direct_conv_blocks(in_channels);
+  const int kernel_size = kernel_h * kernel_w;
+  caffe_set(direct_conv_blocks(out_channels) * in_blocks * kernel_size * B * B,
+      Dtype(0), packed);
+  for (int o = 0; o < out_channels; ++o) {
+    for (int i = 0; i < in_channels; ++i) {
+      for (int k = 0; k < kernel_size; ++k) {
+        packed[(((o / B) * in_blocks + i / B) * kernel_size + k) * B * B +
+            (i % B) * B + o % B] = weights[(o * in_channels + i) *
+            kernel_size + k];
+      }
+    }
+  }
+}
+
+template void direct_conv_pack_weights_cpu<float>(const float* weights,
+    const int out_channels, const int in_channels, const int kernel_h,
+    const int kernel_w, float* packed);
+template void direct_conv_pack_weights_cpu<double>(const double* weights,
+    const int out_channels, const int in_channels, const int kernel_h,
+    const int kernel_w, double* packed);
+
+template <typename Dtype>
+void direct_conv_pack_input_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    Dtype* packed) {
+  const int B = kDirectConvBlock;
+  const int padded_h = height + 2 * pad_h;
+  const int padded_w = width + 2 * pad_w;
+  caffe_set(direct_conv_blocks(channels) * padded_h * padded_w * B, Dtype(0),
+      packed);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* im = data_im + c * height * width;
+    Dtype* plane = packed + (c / B) * padded_h * padded_w * B + c % B;
+    for (int y = 0; y < height; ++y) {
+      Dtype* row = plane + ((y + pad_h) * padded_w + pad_w) * B;
+      for (int x = 0; x < width; ++x) {
+        row[x * B] = im[y * width + x];
+      }
+    }
+  }
+}
+
+template void direct_conv_pack_input_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, float* packed);
+template void direct_conv_pack_input_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, double* packed);
+
+template <typename Dtype>
+void direct_conv_pad_input_cpu(const Dtype* packed_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    Dtype* packed) {
+  const int B = kDirectConvBlock;
+  const int blocks = direct_conv_blocks(channels);
+  const int padded_h = height + 2 * pad_h;
+  const int padded_w = width + 2 * pad_w;
+  caffe_set(blocks * padded_h * padded_w * B, Dtype(0), packed);
+  for (int cb = 0; cb < blocks; ++cb) {
+    for (int y = 0; y < height; ++y) {
+      memcpy(packed + ((cb * padded_h + y + pad_h) * padded_w + pad_w) * B,
+          packed_im + (cb * height + y) * width * B,
+          width * B * sizeof(Dtype));
+    }
+  }
+}
+
+template void direct_conv_pad_input_cpu<float>(const float* packed_im,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, float* packed);
+template void direct_conv_pad_input_cpu<double>(const double* packed_im,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, double* packed);
+
+template <typename Dtype>
+void direct_conv_cpu(const Dtype* packed_im, const int channels,
+    const int padded_h, const int padded_w, const Dtype* packed_weights,
+    const int out_channels, const int kernel_h, const int kernel_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int output_h, const int output_w,
+    Dtype* packed_out) {
+  const int B = kDirectConvBlock;
+  const int in_blocks = direct_conv_blocks(channels);
+  const int out_blocks = direct_conv_blocks(out_channels);
+  const int plane = padded_h * padded_w * B;
+  const int weight_block = in_blocks * kernel_h * kernel_w * B * B;
+  const int out_groups =
+      (out_blocks + kDirectConvOutBlocks - 1) / kDirectConvOutBlocks;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int job = 0; job < out_groups * output_h; ++job) {
+    const int kb = job / output_h * kDirectConvOutBlocks;
+    const int y = job % output_h;
+    const Dtype* row = packed_im + y * stride_h * padded_w * B;
+    Dtype* out = packed_out + (kb * output_h + y) * output_w * B;
+    for (int x = 0; x < output_w; x += kDirectConvPixels) {
+      const int n = std::min(kDirectConvPixels, output_w - x);
+      if (kb + 1 < out_blocks && kDirectConvOutBlocks == 2) {
+        direct_conv_pixels2(row + x * stride_w * B,
+            packed_weights + kb * weight_block, weight_block, in_blocks,
+            kernel_h, kernel_w, dilation_h * padded_w * B, dilation_w * B,
+            plane, stride_w * B, n, out + x * B, output_h * output_w * B);
+      } else {
+        direct_conv_pixels(row + x * stride_w * B,
+            packed_weights + kb * weight_block, in_blocks, kernel_h,
+            kernel_w, dilation_h * padded_w * B, dilation_w * B, plane,
+            stride_w * B, n, out + x * B);
+      }
+    }
+  }
+}
+
+template void direct_conv_cpu<float>(const float* packed_im,
+    const int channels, const int padded_h, const int padded_w,
+    const float* packed_weights, const int out_channels, const int kernel_h,
+    const int kernel_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int output_h,
+    const int output_w, float* packed_out);
+template void direct_conv_cpu<double>(const double* packed_im,
+    const int channels, const int padded_h, const int padded_w,
+    const double* packed_weights, const int out_channels, const int kernel_h,
+    const int kernel_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int output_h,
+    const int output_w, double* packed_out);
+
+template <typename Dtype>
+void direct_conv_bias_cpu(const Dtype* bias, const int channels,
+    const int spatial_dim, const bool relu, Dtype* packed) {
+  const int B = kDirectConvBlock;
+  const int blocks = direct_conv_blocks(channels);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int cb = 0; cb < blocks; ++cb) {
+    Dtype b[kDirectConvBlock] = { 0 };
+    for (int k = 0; bias && k < B && cb * B + k < channels; ++k) {
+      b[k] = bias[cb * B + k];
+    }
+    Dtype* out = packed + cb * spatial_dim * B;
+    for (int i = 0; i < spatial_dim; ++i) {
+      for (int k = 0; k < B; ++k) {
+        const Dtype value = out[i * B + k] + b[k];
+        out[i * B + k] = relu ? std::max(value, Dtype(0)) : value;
+      }
+    }
+  }
+}
+
+template void direct_conv_bias_cpu<float>(const float* bias,
+    const int channels, const int spatial_dim, const bool relu, float* packed);
+template void direct_conv_bias_cpu<double>(const double* bias,
+    const int channels, const int spatial_dim, const bool relu,
+    double* packed);
+
+template <typename Dtype>
+void direct_conv_unpack_cpu(const Dtype* packed, const int channels,
+    const int height, const int width, Dtype* data_im) {
+  const int B = kDirectConvBlock;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* plane = packed + (c / B) * height * width * B + c % B;
+    Dtype* im = data_im + c * height * width;
+    for (int i = 0; i < height * width; ++i) {
+      im[i] = plane[i * B];
+    }
+  }
+}
+
+template void direct_conv_unpack_cpu<float>(const float* packed,
+    const int channels, const int height, const int width, float* data_im);
+template void direct_conv_unpack_cpu<double>(const double* packed,
+    const int channels, const int height, const int width, double* data_im);
+
+}  // namespace caffe
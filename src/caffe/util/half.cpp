@@ -0,0 +1,334 @@
+#if defined(__F16C__) || defined(__AVX512BF16__)
+#include <immintrin.h>
+#endif
+// The products convert 16-bit weights in registers with F16C, or for BF16
+// with an AVX2 shift, and accumulate with FMA.
+#if defined(__AVX2__) && defined(__FMA__) && defined(__F16C__)
+#define CAFFE_HALF_GEMM_AVX2
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/util/half.hpp"
+#include "caffe/util/int8.hpp"
+
+namespace caffe {
+
+namespace {
+
+inline uint32_t float_bits(const float x) {
+  uint32_t u;
+  memcpy(&u, &x, sizeof(u));
+  return u;
+}
+
+inline float bits_float(const uint32_t u) {
+  float x;
+  memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+inline uint16_t fp16_from_float(const float x) {
+  const uint32_t u = float_bits(x);
+  const uint32_t sign = (u >> 16) & 0x8000;
+  uint32_t abs = u & 0x7fffffff;
+  if (abs >= 0x7f800000) {
+    // infinity, or a quiet NaN keeping the upper payload bits
+    const uint32_t payload =
+        abs > 0x7f800000 ? 0x200 | ((abs >> 13) & 0x3ff) : 0;
+    return sign | 0x7c00 | payload;
+  }
+  if (abs >= 0x477ff000) {
+    // rounds past 65504
+    return sign | 0x7c00;
+  }
+  if (abs < 0x38800000) {
+    // below 2^-14, subnormal: let the float adder round the bits into place
+    const float magic = bits_float(126 << 23);
+    return sign | (float_bits(bits_float(abs) + magic) - (126 << 23));
+  }
+  // rebias the exponent from 127 to 15 and round to nearest even
+  abs += 0xc8000fff + ((abs >> 13) & 1);
+  return sign | (abs >> 13);
+}
+
+inline float fp16_to_float(const uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t u = static_cast<uint32_t>(h & 0x7fff) << 13;
+  const uint32_t exponent = u & (0x7c00 << 13);
+  u += (127 - 15) << 23;
+  if (exponent == 0x7c00 << 13) {
+    u += (128 - 16) << 23;  // infinity or NaN
+  } else if (exponent == 0) {
+    u = float_bits(bits_float(u + (1 << 23)) - bits_float(113 << 23));
+  }
+  return bits_float(u | sign);
+}
+
+inline uint16_t bf16_from_float(const float x) {
+  const uint32_t u = float_bits(x);
+  if ((u & 0x7fffffff) > 0x7f800000) {
+    return (u >> 16) | 0x40;  // quiet NaN
+  }
+  if ((u & 0x7f800000) == 0) {
+    return (u >> 16) & 0x8000;  // subnormals flush to zero, as in AVX512-BF16
+  }
+  return (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+}
+
+inline float bf16_to_float(const uint16_t h) {
+  return bits_float(static_cast<uint32_t>(h) << 16);
+}
+
+}  // namespace
+
+void half_from_float_cpu(const HalfFormat format, const int n, const float* x,
+    uint16_t* y) {
+  int i = 0;
+  if (format == BlobProto_HalfFormat_FP16) {
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i),
+          _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+    for (; i < n; ++i) {
+      y[i] = fp16_from_float(x[i]);
+    }
+  } else {
+#if defined(__AVX512BF16__)
+    for (; i + 16 <= n; i += 16) {
+      const __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(x + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i),
+          reinterpret_cast<const __m256i&>(h));
+    }
+#endif
+    for (; i < n; ++i) {
+      y[i] = bf16_from_float(x[i]);
+    }
+  }
+}
+
+void half_to_float_cpu(const HalfFormat format, const int n, const uint16_t* x,
+    float* y) {
+  int i = 0;
+  if (format == BlobProto_HalfFormat_FP16) {
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+      _mm256_storeu_ps(y + i, _mm256_cvtph_ps(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+    }
+#endif
+    for (; i < n; ++i) {
+      y[i] = fp16_to_float(x[i]);
+    }
+  } else {
+    for (; i < n; ++i) {
+      y[i] = bf16_to_float(x[i]);
+    }
+  }
+}
+
+namespace {
+
+template <typename Dtype>
+inline Dtype half_dot(const HalfFormat format, const Dtype* a,
+    const uint16_t* b, const int n) {
+  Dtype sum = 0;
+  for (int i = 0; i < n; ++i) {
+    sum += a[i] * (format == BlobProto_HalfFormat_FP16 ?
+        fp16_to_float(b[i]) : bf16_to_float(b[i]));
+  }
+  return sum;
+}
+
+#ifdef CAFFE_HALF_GEMM_AVX2
+template <bool bf16>
+inline __m256 half_load8(const uint16_t* x) {
+  const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x));
+  return bf16 ? _mm256_castsi256_ps(_mm256_slli_epi32(
+      _mm256_cvtepu16_epi32(h), 16)) : _mm256_cvtph_ps(h);
+}
+
+inline float half_hsum(const __m256 x) {
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(x),
+      _mm256_extractf128_ps(x, 1));
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum);
+}
+
+// C[0..1][0..3] for rows a and a + K of A and rows b .. b + 3K of B, as
+// int8_dot_2x4: each B vector is converted once and used twice.
+template <bool bf16>
+inline void half_dot_2x4(const float* a, const uint16_t* b, const int K,
+    float* C) {
+  __m256 c00 = _mm256_setzero_ps(), c01 = c00, c02 = c00, c03 = c00;
+  __m256 c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+  int k = 0;
+  for (; k + 8 <= K; k += 8) {
+    const __m256 a0 = _mm256_loadu_ps(a + k);
+    const __m256 a1 = _mm256_loadu_ps(a + K + k);
+    __m256 bc = half_load8<bf16>(b + k);
+    c00 = _mm256_fmadd_ps(a0, bc, c00);
+    c10 = _mm256_fmadd_ps(a1, bc, c10);
+    bc = half_load8<bf16>(b + K + k);
+    c01 = _mm256_fmadd_ps(a0, bc, c01);
+    c11 = _mm256_fmadd_ps(a1, bc, c11);
+    bc = half_load8<bf16>(b + 2 * K + k);
+    c02 = _mm256_fmadd_ps(a0, bc, c02);
+    c12 = _mm256_fmadd_ps(a1, bc, c12);
+    bc = half_load8<bf16>(b + 3 * K + k);
+    c03 = _mm256_fmadd_ps(a0, bc, c03);
+    c13 = _mm256_fmadd_ps(a1, bc, c13);
+  }
+  const __m256 acc[2][4] = { {c00, c01, c02, c03}, {c10, c11, c12, c13} };
+  const HalfFormat format =
+      bf16 ? BlobProto_HalfFormat_BF16 : BlobProto_HalfFormat_FP16;
+  for (int r = 0; r < 2; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      C[r * 4 + c] = half_hsum(acc[r][c]) +
+          half_dot(format, a + r * K + k, b + c * K + k, K - k);
+    }
+  }
+}
+#endif
+
+// C[i * ldi + j * ldj] for all rows i of A and the rows j0 <= j < j1 of B.
+template <typename Dtype>
+void half_gemm_panel(const HalfFormat format, const int M, const int j0,
+    const int j1, const int K, const Dtype* A, const uint16_t* B, Dtype* C,
+    const int ldi, const int ldj) {
+  // without vector conversions, the panel is converted once
+  vector<float> b(static_cast<int64_t>(j1 - j0) * K);
+  half_to_float_cpu(format, b.size(), B + static_cast<int64_t>(j0) * K,
+      &b[0]);
+  for (int i = 0; i < M; ++i) {
+    const Dtype* a = A + static_cast<int64_t>(i) * K;
+    for (int j = j0; j < j1; ++j) {
+      const float* bj = &b[static_cast<int64_t>(j - j0) * K];
+      Dtype sum = 0;
+      for (int k = 0; k < K; ++k) {
+        sum += a[k] * bj[k];
+      }
+      C[static_cast<int64_t>(i) * ldi + static_cast<int64_t>(j) * ldj] = sum;
+    }
+  }
+}
+
+#ifdef CAFFE_HALF_GEMM_AVX2
+template <>
+void half_gemm_panel<float>(const HalfFormat format, const int M,
+    const int j0, const int j1, const int K, const float* A,
+    const uint16_t* B, float* C, const int ldi, const int ldj) {
+  const bool bf16 = format == BlobProto_HalfFormat_BF16;
+  int i = 0;
+  for (; i + 2 <= M; i += 2) {
+    const float* a = A + static_cast<int64_t>(i) * K;
+    int j = j0;
+    for (; j + 4 <= j1; j += 4) {
+      const uint16_t* b = B + static_cast<int64_t>(j) * K;
+      float c[8];
+      if (bf16) {
+        half_dot_2x4<true>(a, b, K, c);
+      } else {
+        half_dot_2x4<false>(a, b, K, c);
+      }
+      for (int r = 0; r < 2; ++r) {
+        for (int cc = 0; cc < 4; ++cc) {
+          C[static_cast<int64_t>(i + r) * ldi +
+              static_cast<int64_t>(j + cc) * ldj] = c[r * 4 + cc];
+        }
+      }
+    }
+    for (; j < j1; ++j) {
+      for (int r = 0; r < 2; ++r) {
+        C[static_cast<int64_t>(i + r) * ldi + static_cast<int64_t>(j) * ldj]
+            = half_dot(format, a + r * K, B + static_cast<int64_t>(j) * K, K);
+      }
+    }
+  }
+  for (; i < M; ++i) {
+    const float* a = A + static_cast<int64_t>(i) * K;
+    for (int j = j0; j < j1; ++j) {
+      C[static_cast<int64_t>(i) * ldi + static_cast<int64_t>(j) * ldj] =
+          half_dot(format, a, B + static_cast<int64_t>(j) * K, K);
+    }
+  }
+}
+#endif
+
+}  // namespace
+
+template <typename Dtype>
+void half_gemm_cpu(const HalfFormat format, const int M, const int N,
+    const int K, const Dtype* A, const uint16_t* B, Dtype* C,
+    const bool transposed_c) {
+  // a panel of B rows that stays in cache while every row of A passes over
+  // it
+  const int panel = std::max(4, (128 << 10) / std::max(1, K) / 4 * 4);
+  const int panels = (N + panel - 1) / panel;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int p = 0; p < panels; ++p) {
+    const int j0 = p * panel;
+    half_gemm_panel(format, M, j0, std::min(N, j0 + panel), K, A, B, C,
+        transposed_c ? 1 : N, transposed_c ? M : 1);
+  }
+}
+
+template void half_gemm_cpu<float>(const HalfFormat format, const int M,
+    const int N, const int K, const float* A, const uint16_t* B, float* C,
+    const bool transposed_c);
+template void half_gemm_cpu<double>(const HalfFormat format, const int M,
+    const int N, const int K, const double* A, const uint16_t* B, double* C,
+    const bool transposed_c);
+
+template <typename Dtype>
+void HalfWeights<Dtype>::Update(const Blob<Dtype>& weights,
+    const HalfFormat format, const int rows, const int cols,
+    const bool transposed) {
+  CHECK_EQ(weights.count(), rows * cols);
+  const uint64_t hash = weights_hash(weights.cpu_data(),
+      weights.count() * sizeof(Dtype));
+  if (!data_.empty() && hash == hash_ && format == format_ &&
+      data_.size() == weights.count()) {
+    return;
+  }
+  data_.resize(weights.count());
+  const Dtype* x = weights.cpu_data();
+  vector<float> row(cols);
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      row[c] = transposed ? x[c * rows + r] : x[r * cols + c];
+    }
+    half_from_float_cpu(format, cols, &row[0], &data_[r * cols]);
+  }
+  format_ = format;
+  hash_ = hash;
+}
+
+INSTANTIATE_CLASS(HalfWeights);
+
+float half_max(const HalfFormat format) {
+  return format == BlobProto_HalfFormat_FP16 ? 65504.f :
+      bf16_to_float(0x7f7f);
+}
+
+void half_blob_to_proto(const Blob<float>& blob, const HalfFormat format,
+    BlobProto* proto) {
+  blob.ToProto(proto);
+  proto->clear_data();
+  proto->clear_double_data();
+  std::string data(blob.count() * sizeof(uint16_t), '\0');
+  half_from_float_cpu(format, blob.count(), blob.cpu_data(),
+      reinterpret_cast<uint16_t*>(&data[0]));
+  proto->set_half_data(data);
+  proto->set_half_format(format);
+}
+
+}  // namespace caffe
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <vector>
 
+#include "caffe/util/conv_range.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -15,13 +17,16 @@ inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
   return static_cast<unsigned>(a) < static_cast<unsigned>(b);
 }
 
+// Unrolls one image; each row of the column matrix starts col_row_stride
+// elements after the previous one.
 template <typename Dtype>
-void im2col_cpu(const Dtype* data_im, const int channels,
-    const int height, const int width, const int kernel_h, const int kernel_w,
+inline void im2col_generic_strided_cpu(const Dtype* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
     const int dilation_h, const int dilation_w,
-    Dtype* data_col) {
+    const int col_row_stride, Dtype* data_col) {
   const int output_h = (height + 2 * pad_h -
     (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
   const int output_w = (width + 2 * pad_w -
@@ -49,11 +54,216 @@ void im2col_cpu(const Dtype* data_im, const int channels,
           }
           input_row += stride_h;
         }
+        data_col += col_row_stride - output_h * output_w;
       }
     }
   }
 }
 
+// im2col for an undilated kKernelH x kKernelW kernel of stride kStrideH x
+// kStrideW. Every kernel tap copies, per output row, the columns whose input
+// lies inside the image with a branch-free loop of constant stride that the
+// compiler can vectorize, and zero-fills the border columns and padding rows
+// around it.
+template <typename Dtype, int kKernelH, int kKernelW, int kStrideH,
+    int kStrideW>
+void im2col_fixed_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const int col_row_stride, Dtype* data_col) {
+  const int output_h = (height + 2 * pad_h - kKernelH) / kStrideH + 1;
+  const int output_w = (width + 2 * pad_w - kKernelW) / kStrideW + 1;
+  const int channel_size = height * width;
+  for (int channel = channels; channel--; data_im += channel_size) {
+    for (int kernel_row = 0; kernel_row < kKernelH; kernel_row++) {
+      for (int kernel_col = 0; kernel_col < kKernelW; kernel_col++) {
+        const int offset = kernel_col - pad_w;
+        int begin, end;
+        valid_output_range(offset, kStrideW, width, output_w, &begin, &end);
+        int input_row = kernel_row - pad_h;
+        Dtype* col = data_col;
+        for (int output_row = 0; output_row < output_h; output_row++) {
+          if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
+            caffe_set(output_w, Dtype(0), col);
+          } else {
+            const Dtype* im = data_im + input_row * width + offset;
+            for (int output_col = 0; output_col < begin; output_col++) {
+              col[output_col] = 0;
+            }
+            for (int output_col = begin; output_col < end; output_col++) {
+              col[output_col] = im[output_col * kStrideW];
+            }
+            for (int output_col = end; output_col < output_w; output_col++) {
+              col[output_col] = 0;
+            }
+          }
+          col += output_w;
+          input_row += kStrideH;
+        }
+        data_col += col_row_stride;
+      }
+    }
+  }
+}
+
+// col2im counterpart of im2col_fixed_cpu.
+template <typename Dtype, int kKernelH, int kKernelW, int kStrideH,
+    int kStrideW>
+void col2im_fixed_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    Dtype* data_im) {
+  const int output_h = (height + 2 * pad_h - kKernelH) / kStrideH + 1;
+  const int output_w = (width + 2 * pad_w - kKernelW) / kStrideW + 1;
+  const int channel_size = height * width;
+  caffe_set(channel_size * channels, Dtype(0), data_im);
+  for (int channel = channels; channel--; data_im += channel_size) {
+    for (int kernel_row = 0; kernel_row < kKernelH; kernel_row++) {
+      for (int kernel_col = 0; kernel_col < kKernelW; kernel_col++) {
+        const int offset = kernel_col - pad_w;
+        int begin, end;
+        valid_output_range(offset, kStrideW, width, output_w, &begin, &end);
+        int input_row = kernel_row - pad_h;
+        for (int output_row = 0; output_row < output_h; output_row++) {
+          if (is_a_ge_zero_and_a_lt_b(input_row, height)) {
+            Dtype* im = data_im + input_row * width + offset;
+            for (int output_col = begin; output_col < end; output_col++) {
+              im[output_col * kStrideW] += data_col[output_col];
+            }
+          }
+          data_col += output_w;
+          input_row += kStrideH;
+        }
+      }
+    }
+  }
+}
+
+// Dispatches the shapes with a specialized kernel: 3x3 of stride 1 or 2,
+// 1x1 of stride 2 and 7x7 of stride 2, undilated. Returns false for the
+// others.
+template <typename Dtype>
+inline bool im2col_specialized_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int col_row_stride,
+    Dtype* data_col) {
+  if (dilation_h != 1 || dilation_w != 1 || kernel_h != kernel_w ||
+      stride_h != stride_w) {
+    return false;
+  }
+  if (kernel_h == 3 && stride_h == 1) {
+    im2col_fixed_cpu<Dtype, 3, 3, 1, 1>(data_im, channels, height, width,
+        pad_h, pad_w, col_row_stride, data_col);
+  } else if (kernel_h == 3 && stride_h == 2) {
+    im2col_fixed_cpu<Dtype, 3, 3, 2, 2>(data_im, channels, height, width,
+        pad_h, pad_w, col_row_stride, data_col);
+  } else if (kernel_h == 1 && stride_h == 2) {
+    im2col_fixed_cpu<Dtype, 1, 1, 2, 2>(data_im, channels, height, width,
+        pad_h, pad_w, col_row_stride, data_col);
+  } else if (kernel_h == 7 && stride_h == 2) {
+    im2col_fixed_cpu<Dtype, 7, 7, 2, 2>(data_im, channels, height, width,
+        pad_h, pad_w, col_row_stride, data_col);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+template <typename Dtype>
+inline bool col2im_specialized_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, Dtype* data_im) {
+  if (dilation_h != 1 || dilation_w != 1 || kernel_h != kernel_w ||
+      stride_h != stride_w) {
+    return false;
+  }
+  if (kernel_h == 3 && stride_h == 1) {
+    col2im_fixed_cpu<Dtype, 3, 3, 1, 1>(data_col, channels, height, width,
+        pad_h, pad_w, data_im);
+  } else if (kernel_h == 3 && stride_h == 2) {
+    col2im_fixed_cpu<Dtype, 3, 3, 2, 2>(data_col, channels, height, width,
+        pad_h, pad_w, data_im);
+  } else if (kernel_h == 1 && stride_h == 2) {
+    col2im_fixed_cpu<Dtype, 1, 1, 2, 2>(data_col, channels, height, width,
+        pad_h, pad_w, data_im);
+  } else if (kernel_h == 7 && stride_h == 2) {
+    col2im_fixed_cpu<Dtype, 7, 7, 2, 2>(data_col, channels, height, width,
+        pad_h, pad_w, data_im);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+template <typename Dtype>
+inline void im2col_strided_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    const int col_row_stride, Dtype* data_col) {
+  if (!im2col_specialized_cpu(data_im, channels, height, width, kernel_h,
+      kernel_w, pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w,
+      col_row_stride, data_col)) {
+    im2col_generic_strided_cpu(data_im, channels, height, width, kernel_h,
+        kernel_w, pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w,
+        col_row_stride, data_col);
+  }
+}
+
+template <typename Dtype>
+void im2col_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  im2col_strided_cpu(data_im, channels, height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w,
+      output_h * output_w, data_col);
+}
+
+template <typename Dtype>
+void im2col_generic_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  im2col_generic_strided_cpu(data_im, channels, height, width, kernel_h,
+      kernel_w, pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w,
+      output_h * output_w, data_col);
+}
+
+template <typename Dtype>
+void im2col_batch_cpu(const Dtype* data_im, const int num,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  const int output_size = output_h * output_w;
+  const int image_size = channels * height * width;
+  for (int n = 0; n < num; ++n) {
+    im2col_strided_cpu(data_im + n * image_size, channels, height, width,
+        kernel_h, kernel_w, pad_h, pad_w, stride_h, stride_w,
+        dilation_h, dilation_w, num * output_size,
+        data_col + n * output_size);
+  }
+}
+
 // Explicit instantiation
 template void im2col_cpu<float>(const float* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -65,6 +275,26 @@ template void im2col_cpu<double>(const double* data_im, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, const int dilation_h, const int dilation_w,
     double* data_col);
+template void im2col_batch_cpu<float>(const float* data_im, const int num,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, float* data_col);
+template void im2col_batch_cpu<double>(const double* data_im, const int num,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, double* data_col);
+template void im2col_generic_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, float* data_col);
+template void im2col_generic_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, double* data_col);
 
 template <typename Dtype>
 inline void im2col_nd_core_cpu(const Dtype* data_input, const bool im2col,
@@ -160,7 +390,7 @@ template void im2col_nd_cpu<double>(const double* data_im,
     const int* dilation, double* data_col);
 
 template <typename Dtype>
-void col2im_cpu(const Dtype* data_col, const int channels,
+void col2im_generic_cpu(const Dtype* data_col, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
@@ -196,6 +426,21 @@ void col2im_cpu(const Dtype* data_col, const int channels,
   }
 }
 
+template <typename Dtype>
+void col2im_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_im) {
+  if (!col2im_specialized_cpu(data_col, channels, height, width, kernel_h,
+      kernel_w, pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w,
+      data_im)) {
+    col2im_generic_cpu(data_col, channels, height, width, kernel_h, kernel_w,
+        pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w, data_im);
+  }
+}
+
 // Explicit instantiation
 template void col2im_cpu<float>(const float* data_col, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -207,6 +452,16 @@ template void col2im_cpu<double>(const double* data_col, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, const int dilation_h, const int dilation_w,
     double* data_im);
+template void col2im_generic_cpu<float>(const float* data_col,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, float* data_im);
+template void col2im_generic_cpu<double>(const double* data_col,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, double* data_im);
 
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
@@ -0,0 +1,316 @@
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+// VNNI multiplies unsigned by signed bytes, 4 products per int32 lane.
+#if defined(__AVXVNNI__)
+#define CAFFE_INT8_VNNI
+#define CAFFE_DPBUSD _mm256_dpbusd_avx_epi32
+#elif defined(__AVX512VNNI__) && defined(__AVX512VL__)
+#define CAFFE_INT8_VNNI
+#define CAFFE_DPBUSD _mm256_dpbusd_epi32
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include "caffe/util/int8.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+Dtype int8_absmax_cpu(const int n, const Dtype* x) {
+  Dtype absmax = 0;
+  for (int i = 0; i < n; ++i) {
+    absmax = std::max(absmax, std::abs(x[i]));
+  }
+  return absmax;
+}
+
+template float int8_absmax_cpu<float>(const int n, const float* x);
+template double int8_absmax_cpu<double>(const int n, const double* x);
+
+template <typename Dtype>
+inline int8_t int8_quantize(const Dtype x, const Dtype inv_scale) {
+  const Dtype q = std::floor(x * inv_scale + Dtype(0.5));
+  return static_cast<int8_t>(std::min<Dtype>(kInt8Max,
+      std::max<Dtype>(-kInt8Max, q)));
+}
+
+template <typename Dtype>
+void int8_quantize_cpu(const int n, const Dtype* x, const float scale,
+    int8_t* q) {
+  const Dtype inv_scale = Dtype(1) / scale;
+  for (int i = 0; i < n; ++i) {
+    q[i] = int8_quantize(x[i], inv_scale);
+  }
+}
+
+template void int8_quantize_cpu<float>(const int n, const float* x,
+    const float scale, int8_t* q);
+template void int8_quantize_cpu<double>(const int n, const double* x,
+    const float scale, int8_t* q);
+
+template <typename Dtype>
+void int8_quantize_transposed_cpu(const int rows, const int cols,
+    const Dtype* x, const float scale, int8_t* q) {
+  const Dtype inv_scale = Dtype(1) / scale;
+  // tiles keep both the reads and the writes within a few cache lines
+  const int kTile = 32;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int c0 = 0; c0 < cols; c0 += kTile) {
+    const int c1 = std::min(cols, c0 + kTile);
+    for (int r0 = 0; r0 < rows; r0 += kTile) {
+      const int r1 = std::min(rows, r0 + kTile);
+      for (int c = c0; c < c1; ++c) {
+        for (int r = r0; r < r1; ++r) {
+          q[c * rows + r] = int8_quantize(x[r * cols + c], inv_scale);
+        }
+      }
+    }
+  }
+}
+
+template void int8_quantize_transposed_cpu<float>(const int rows,
+    const int cols, const float* x, const float scale, int8_t* q);
+template void int8_quantize_transposed_cpu<double>(const int rows,
+    const int cols, const double* x, const float scale, int8_t* q);
+
+template <typename Dtype>
+void int8_quantize_rows_cpu(const int rows, const int cols, const Dtype* x,
+    const bool transposed, float* scales, int8_t* q) {
+  for (int r = 0; r < rows; ++r) {
+    Dtype absmax = 0;
+    for (int c = 0; c < cols; ++c) {
+      absmax = std::max(absmax, std::abs(transposed ? x[c * rows + r] :
+          x[r * cols + c]));
+    }
+    scales[r] = int8_scale(absmax);
+    const Dtype inv_scale = Dtype(1) / scales[r];
+    for (int c = 0; c < cols; ++c) {
+      q[r * cols + c] = int8_quantize(transposed ? x[c * rows + r] :
+          x[r * cols + c], inv_scale);
+    }
+  }
+}
+
+template void int8_quantize_rows_cpu<float>(const int rows, const int cols,
+    const float* x, const bool transposed, float* scales, int8_t* q);
+template void int8_quantize_rows_cpu<double>(const int rows, const int cols,
+    const double* x, const bool transposed, float* scales, int8_t* q);
+
+inline int32_t int8_dot(const int8_t* a, const int8_t* b, const int n) {
+  int32_t sum = 0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sum)
+#endif
+  for (int i = 0; i < n; ++i) {
+    sum += static_cast<int16_t>(a[i]) * static_cast<int16_t>(b[i]);
+  }
+  return sum;
+}
+
+#if defined(__AVX2__)
+inline __m256i int8_load16(const int8_t* x) {
+  return _mm256_cvtepi8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(x)));
+}
+
+inline int32_t int8_hsum(const __m256i x) {
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(x),
+      _mm256_extracti128_si256(x, 1));
+  sum = _mm_hadd_epi32(sum, sum);
+  sum = _mm_hadd_epi32(sum, sum);
+  return _mm_cvtsi128_si32(sum);
+}
+
+// C[0..1][0..3] for rows a and a + K of A and rows b .. b + 3K of B: eight
+// accumulators of pairwise int16 products, so that every operand loaded
+// is used two or four times. Spelled out to stay in registers at -O2.
+inline void int8_dot_2x4(const int8_t* a, const int8_t* b, const int K,
+    const int N, int32_t* C) {
+  __m256i c00 = _mm256_setzero_si256(), c01 = c00, c02 = c00, c03 = c00;
+  __m256i c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+  int k = 0;
+  for (; k + 16 <= K; k += 16) {
+    const __m256i a0 = int8_load16(a + k);
+    const __m256i a1 = int8_load16(a + K + k);
+    __m256i bc = int8_load16(b + k);
+    c00 = _mm256_add_epi32(c00, _mm256_madd_epi16(a0, bc));
+    c10 = _mm256_add_epi32(c10, _mm256_madd_epi16(a1, bc));
+    bc = int8_load16(b + K + k);
+    c01 = _mm256_add_epi32(c01, _mm256_madd_epi16(a0, bc));
+    c11 = _mm256_add_epi32(c11, _mm256_madd_epi16(a1, bc));
+    bc = int8_load16(b + 2 * K + k);
+    c02 = _mm256_add_epi32(c02, _mm256_madd_epi16(a0, bc));
+    c12 = _mm256_add_epi32(c12, _mm256_madd_epi16(a1, bc));
+    bc = int8_load16(b + 3 * K + k);
+    c03 = _mm256_add_epi32(c03, _mm256_madd_epi16(a0, bc));
+    c13 = _mm256_add_epi32(c13, _mm256_madd_epi16(a1, bc));
+  }
+  const __m256i acc[2][4] = { {c00, c01, c02, c03}, {c10, c11, c12, c13} };
+  for (int r = 0; r < 2; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      C[r * N + c] = int8_hsum(acc[r][c]) +
+          int8_dot(a + r * K + k, b + c * K + k, K - k);
+    }
+  }
+}
+#endif
+
+#ifdef CAFFE_INT8_VNNI
+// int8_dot_2x4 with VNNI, 32 products per instruction. A is made unsigned
+// by adding 128 (flipping the sign bit), which adds 128 * sum(B row) to
+// every product: b_sums holds those sums over the first K / 32 * 32
+// columns, the part computed this way.
+inline void int8_dot_2x4_vnni(const int8_t* a, const int8_t* b, const int K,
+    const int N, const int32_t* b_sums, int32_t* C) {
+  const __m256i sign = _mm256_set1_epi8(static_cast<char>(0x80));
+  __m256i c00 = _mm256_setzero_si256(), c01 = c00, c02 = c00, c03 = c00;
+  __m256i c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+  int k = 0;
+  for (; k + 32 <= K; k += 32) {
+    const __m256i a0 = _mm256_xor_si256(sign,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)));
+    const __m256i a1 = _mm256_xor_si256(sign,
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + K + k)));
+    __m256i bc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k));
+    c00 = CAFFE_DPBUSD(c00, a0, bc);
+    c10 = CAFFE_DPBUSD(c10, a1, bc);
+    bc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + K + k));
+    c01 = CAFFE_DPBUSD(c01, a0, bc);
+    c11 = CAFFE_DPBUSD(c11, a1, bc);
+    bc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 2 * K + k));
+    c02 = CAFFE_DPBUSD(c02, a0, bc);
+    c12 = CAFFE_DPBUSD(c12, a1, bc);
+    bc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 3 * K + k));
+    c03 = CAFFE_DPBUSD(c03, a0, bc);
+    c13 = CAFFE_DPBUSD(c13, a1, bc);
+  }
+  const __m256i acc[2][4] = { {c00, c01, c02, c03}, {c10, c11, c12, c13} };
+  for (int r = 0; r < 2; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      C[r * N + c] = int8_hsum(acc[r][c]) - 128 * b_sums[c] +
+          int8_dot(a + r * K + k, b + c * K + k, K - k);
+    }
+  }
+}
+#endif
+
+void int8_gemm_cpu(const int M, const int N, const int K, const int8_t* A,
+    const int8_t* B, int32_t* C) {
+  // a panel of B rows that stays in cache while every row of A passes over
+  // it
+  const int panel = std::max(4, (256 << 10) / std::max(1, K) / 4 * 4);
+  const int panels = (N + panel - 1) / panel;
+#ifdef CAFFE_INT8_VNNI
+  const int vnni_k = K / 32 * 32;
+  vector<int32_t> b_sums(N);
+  for (int j = 0; j < N; ++j) {
+    int32_t sum = 0;
+    for (int k = 0; k < vnni_k; ++k) {
+      sum += B[static_cast<int64_t>(j) * K + k];
+    }
+    b_sums[j] = sum;
+  }
+#endif
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int p = 0; p < panels; ++p) {
+    const int j0 = p * panel;
+    const int j1 = std::min(N, j0 + panel);
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 2 <= M; i += 2) {
+      int j = j0;
+      for (; j + 4 <= j1; j += 4) {
+#ifdef CAFFE_INT8_VNNI
+        int8_dot_2x4_vnni(A + static_cast<int64_t>(i) * K,
+            B + static_cast<int64_t>(j) * K, K, N, &b_sums[j],
+            C + static_cast<int64_t>(i) * N + j);
+#else
+        int8_dot_2x4(A + static_cast<int64_t>(i) * K,
+            B + static_cast<int64_t>(j) * K, K, N,
+            C + static_cast<int64_t>(i) * N + j);
+#endif
+      }
+      for (; j < j1; ++j) {
+        for (int r = i; r < i + 2; ++r) {
+          C[static_cast<int64_t>(r) * N + j] = int8_dot(
+              A + static_cast<int64_t>(r) * K,
+              B + static_cast<int64_t>(j) * K, K);
+        }
+      }
+    }
+#endif
+    for (; i < M; ++i) {
+      const int8_t* a = A + static_cast<int64_t>(i) * K;
+      for (int j = j0; j < j1; ++j) {
+        C[static_cast<int64_t>(i) * N + j] =
+            int8_dot(a, B + static_cast<int64_t>(j) * K, K);
+      }
+    }
+  }
+}
+
+// Four independent lanes wide so that it is not bound by the multiplication
+// latency.
+uint64_t weights_hash(const void* data, const size_t size) {
+  const uint64_t kPrime = 0x100000001b3ULL;
+  uint64_t lanes[4] = { 0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL,
+      0x9ce484222325cbf2ULL, 0x2325cbf29ce48422ULL };
+  const char* bytes = static_cast<const char*>(data);
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (int l = 0; l < 4; ++l) {
+      uint64_t word;
+      memcpy(&word, bytes + i + 8 * l, 8);
+      lanes[l] = (lanes[l] ^ word) * kPrime;
+    }
+  }
+  for (; i < size; ++i) {
+    lanes[0] = (lanes[0] ^ static_cast<unsigned char>(bytes[i])) * kPrime;
+  }
+  return ((lanes[0] * kPrime ^ lanes[1]) * kPrime ^ lanes[2]) * kPrime ^
+      lanes[3];
+}
+
+template <typename Dtype>
+void Int8Weights<Dtype>::Update(const Blob<Dtype>& weights, const int rows,
+    const int cols, const bool transposed) {
+  CHECK_EQ(weights.count(), rows * cols);
+  const uint64_t hash = weights_hash(weights.cpu_data(),
+      weights.count() * sizeof(Dtype));
+  if (!data_.empty() && hash == hash_ && data_.size() == weights.count()) {
+    return;
+  }
+  data_.resize(weights.count());
+  scales_.resize(rows);
+  int8_quantize_rows_cpu(rows, cols, weights.cpu_data(), transposed,
+      &scales_[0], &data_[0]);
+  hash_ = hash;
+}
+
+INSTANTIATE_CLASS(Int8Weights);
+
+void int8_blob_to_proto(const Blob<float>& blob, BlobProto* proto) {
+  blob.ToProto(proto);
+  proto->clear_data();
+  const int rows = blob.num_axes() > 0 ? blob.shape(0) : 1;
+  const int cols = blob.count() / std::max(1, rows);
+  std::string data(blob.count(), '\0');
+  vector<float> scales(rows);
+  int8_quantize_rows_cpu(rows, cols, blob.cpu_data(), false, &scales[0],
+      reinterpret_cast<int8_t*>(&data[0]));
+  proto->set_int8_data(data);
+  proto->clear_int8_scale();
+  for (int r = 0; r < rows; ++r) {
+    proto->add_int8_scale(scales[r]);
+  }
+}
+
+}  // namespace caffe
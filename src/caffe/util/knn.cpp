@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cfloat>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/knn.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+typedef std::pair<float, int> Neighbor;
+
+// Keeps the k nearest neighbors seen so far in a max-heap.
+static inline void PushNeighbor(std::vector<Neighbor>* heap, int k,
+                                float dist, int id) {
+  if (heap->size() < k) {
+    heap->push_back(Neighbor(dist, id));
+    std::push_heap(heap->begin(), heap->end());
+  } else if (dist < heap->front().first) {
+    std::pop_heap(heap->begin(), heap->end());
+    heap->back() = Neighbor(dist, id);
+    std::push_heap(heap->begin(), heap->end());
+  }
+}
+
+// Writes the neighbors in increasing distance order, padded to k.
+static void WriteNeighbors(std::vector<Neighbor>* heap, int k, int* ids,
+                           float* dists) {
+  std::sort_heap(heap->begin(), heap->end());
+  for (int i = 0; i < k; ++i) {
+    ids[i] = i < heap->size() ? (*heap)[i].second : -1;
+    dists[i] = i < heap->size() ? (*heap)[i].first : FLT_MAX;
+  }
+}
+
+void FlatIndex::Add(int n, const float* x) {
+  // offsets into the stored vectors are size_t: millions of them overflow
+  // an int
+  data_.insert(data_.end(), x, x + static_cast<size_t>(n) * dim_);
+  for (int i = 0; i < n; ++i) {
+    const float* xi = x + static_cast<size_t>(i) * dim_;
+    norms_.push_back(caffe_cpu_dot(dim_, xi, xi));
+  }
+  ntotal_ += n;
+}
+
+void FlatIndex::Search(int n, const float* x, int k, int* ids,
+                       float* dists) const {
+  CHECK_GT(k, 0);
+  // sized so a block of inner products stays in cache
+  const int kQueryBlock = 256;
+  const int kDataBlock = 1024;
+  std::vector<float> ip(kQueryBlock * kDataBlock);
+  std::vector<float> query_norms(kQueryBlock);
+  std::vector<std::vector<Neighbor> > heaps(kQueryBlock);
+  for (int q0 = 0; q0 < n; q0 += kQueryBlock) {
+    const int nq = std::min(kQueryBlock, n - q0);
+    const float* query = x + static_cast<size_t>(q0) * dim_;
+    for (int i = 0; i < nq; ++i) {
+      const float* qi = query + static_cast<size_t>(i) * dim_;
+      query_norms[i] = caffe_cpu_dot(dim_, qi, qi);
+      heaps[i].clear();
+    }
+    for (int x0 = 0; x0 < ntotal_; x0 += kDataBlock) {
+      const int nx = std::min(kDataBlock, ntotal_ - x0);
+      caffe_cpu_gemm<float>(CblasNoTrans, CblasTrans, nq, nx, dim_, 1.f,
+                            query, &data_[static_cast<size_t>(x0) * dim_], 0.f,
+                            &ip[0]);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+      for (int i = 0; i < nq; ++i) {
+        const float* row = &ip[i * nx];
+        for (int j = 0; j < nx; ++j) {
+          const float dist = std::max(
+              query_norms[i] + norms_[x0 + j] - 2 * row[j], 0.f);
+          PushNeighbor(&heaps[i], k, dist, x0 + j);
+        }
+      }
+    }
+    for (int i = 0; i < nq; ++i) {
+      const size_t offset = static_cast<size_t>(q0 + i) * k;
+      WriteNeighbors(&heaps[i], k, ids + offset, dists + offset);
+    }
+  }
+}
+
+IVFPQIndex::IVFPQIndex(int dim, int nlist, int m)
+    : KNNIndex(dim), nlist_(nlist), m_(m), dsub_(dim / m), ksub_(256),
+      nprobe_(1), trained_(false), coarse_(dim) {
+  CHECK_GT(nlist, 0);
+  CHECK_GT(m, 0);
+  CHECK_EQ(dim % m, 0) << "The dimension must be a multiple of m.";
+}
+
+void IVFPQIndex::Residual(const float* x, int list, float* residual) const {
+  caffe_sub(dim_, x, coarse_.data() + static_cast<size_t>(list) * dim_,
+            residual);
+}
+
+void IVFPQIndex::Train(int n, const float* x) {
+  CHECK_GE(n, nlist_) << "Need at least nlist training vectors.";
+  const int kIterations = 10;
+  std::vector<float> centroids(static_cast<size_t>(nlist_) * dim_);
+  KMeans(n, dim_, x, nlist_, kIterations, &centroids[0]);
+  coarse_.Add(nlist_, &centroids[0]);
+
+  // The sub-quantizers are trained on the residuals.
+  std::vector<int> lists(n);
+  std::vector<float> dists(n);
+  coarse_.Search(n, x, 1, &lists[0], &dists[0]);
+  std::vector<float> residuals(static_cast<size_t>(n) * dim_);
+  for (int i = 0; i < n; ++i) {
+    const size_t offset = static_cast<size_t>(i) * dim_;
+    Residual(x + offset, lists[i], &residuals[offset]);
+  }
+  ksub_ = std::min(256, n);
+  std::vector<float> sub(static_cast<size_t>(n) * dsub_);
+  std::vector<float> sub_centroids(ksub_ * dsub_);
+  pq_.clear();
+  for (int j = 0; j < m_; ++j) {
+    for (int i = 0; i < n; ++i) {
+      caffe_copy(dsub_, &residuals[static_cast<size_t>(i) * dim_ + j * dsub_],
+                 &sub[static_cast<size_t>(i) * dsub_]);
+    }
+    KMeans(n, dsub_, &sub[0], ksub_, kIterations, &sub_centroids[0]);
+    pq_.push_back(shared_ptr<FlatIndex>(new FlatIndex(dsub_)));
+    pq_.back()->Add(ksub_, &sub_centroids[0]);
+  }
+  list_ids_.assign(nlist_, std::vector<int>());
+  list_codes_.assign(nlist_, std::vector<uint8_t>());
+  trained_ = true;
+}
+
+void IVFPQIndex::Add(int n, const float* x) {
+  CHECK(trained_) << "Train the index before adding vectors.";
+  std::vector<int> lists(n);
+  std::vector<float> dists(n);
+  coarse_.Search(n, x, 1, &lists[0], &dists[0]);
+  std::vector<float> residuals(static_cast<size_t>(n) * dim_);
+  for (int i = 0; i < n; ++i) {
+    const size_t offset = static_cast<size_t>(i) * dim_;
+    Residual(x + offset, lists[i], &residuals[offset]);
+  }
+  // encode one sub-vector position at a time, for all vectors at once
+  std::vector<uint8_t> codes(static_cast<size_t>(n) * m_);
+  std::vector<float> sub(static_cast<size_t>(n) * dsub_);
+  std::vector<int> nearest(n);
+  for (int j = 0; j < m_; ++j) {
+    for (int i = 0; i < n; ++i) {
+      caffe_copy(dsub_, &residuals[static_cast<size_t>(i) * dim_ + j * dsub_],
+                 &sub[static_cast<size_t>(i) * dsub_]);
+    }
+    pq_[j]->Search(n, &sub[0], 1, &nearest[0], &dists[0]);
+    for (int i = 0; i < n; ++i) {
+      codes[static_cast<size_t>(i) * m_ + j] =
+          static_cast<uint8_t>(nearest[i]);
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    list_ids_[lists[i]].push_back(ntotal_ + i);
+    const uint8_t* code = &codes[static_cast<size_t>(i) * m_];
+    list_codes_[lists[i]].insert(list_codes_[lists[i]].end(), code,
+                                 code + m_);
+  }
+  ntotal_ += n;
+}
+
+void IVFPQIndex::Search(int n, const float* x, int k, int* ids,
+                        float* dists) const {
+  CHECK(trained_) << "Train the index before searching it.";
+  CHECK_GT(k, 0);
+  const int nprobe = std::min(nprobe_, nlist_);
+  std::vector<int> probes(static_cast<size_t>(n) * nprobe);
+  std::vector<float> probe_dists(static_cast<size_t>(n) * nprobe);
+  coarse_.Search(n, x, nprobe, &probes[0], &probe_dists[0]);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int q = 0; q < n; ++q) {
+    std::vector<Neighbor> heap;
+    std::vector<float> residual(dim_);
+    std::vector<float> table(m_ * ksub_);
+    for (int p = 0; p < nprobe; ++p) {
+      const int list = probes[static_cast<size_t>(q) * nprobe + p];
+      if (list < 0 || list_ids_[list].empty()) {
+        continue;
+      }
+      // distances of the query residual to every sub-centroid
+      Residual(x + static_cast<size_t>(q) * dim_, list, &residual[0]);
+      for (int j = 0; j < m_; ++j) {
+        const float* r = &residual[j * dsub_];
+        const float* centroids = pq_[j]->data();
+        for (int c = 0; c < ksub_; ++c) {
+          float dist = 0;
+          for (int t = 0; t < dsub_; ++t) {
+            const float diff = r[t] - centroids[c * dsub_ + t];
+            dist += diff * diff;
+          }
+          table[j * ksub_ + c] = dist;
+        }
+      }
+      const std::vector<int>& list_ids = list_ids_[list];
+      const uint8_t* codes = &list_codes_[list][0];
+      for (int i = 0; i < list_ids.size(); ++i) {
+        const uint8_t* code = codes + static_cast<size_t>(i) * m_;
+        float dist = 0;
+        for (int j = 0; j < m_; ++j) {
+          dist += table[j * ksub_ + code[j]];
+        }
+        PushNeighbor(&heap, k, dist, list_ids[i]);
+      }
+    }
+    const size_t offset = static_cast<size_t>(q) * k;
+    WriteNeighbors(&heap, k, ids + offset, dists + offset);
+  }
+}
+
+void KMeans(int n, int d, const float* x, int k, int iterations,
+            float* centroids) {
+  CHECK_GE(n, k) << "Need at least as many points as centroids.";
+  // start from k distinct random points
+  std::vector<int> perm(n);
+  for (int i = 0; i < n; ++i) {
+    perm[i] = i;
+  }
+  for (int i = 0; i < k; ++i) {
+    std::swap(perm[i], perm[i + caffe_rng_rand() % (n - i)]);
+    caffe_copy(d, x + static_cast<size_t>(perm[i]) * d, centroids + i * d);
+  }
+  std::vector<int> assign(n);
+  std::vector<float> dists(n);
+  std::vector<int> counts(k);
+  for (int iter = 0; iter < iterations; ++iter) {
+    FlatIndex index(d);
+    index.Add(k, centroids);
+    index.Search(n, x, 1, &assign[0], &dists[0]);
+    caffe_set(k * d, 0.f, centroids);
+    std::fill(counts.begin(), counts.end(), 0);
+    for (int i = 0; i < n; ++i) {
+      caffe_axpy(d, 1.f, x + static_cast<size_t>(i) * d,
+                 centroids + assign[i] * d);
+      ++counts[assign[i]];
+    }
+    for (int c = 0; c < k; ++c) {
+      if (counts[c] > 0) {
+        caffe_scal(d, 1.f / counts[c], centroids + c * d);
+      } else {
+        // restart an empty cluster from a random point
+        caffe_copy(d, x + static_cast<size_t>(caffe_rng_rand() % n) * d,
+                   centroids + c * d);
+      }
+    }
+  }
+}
+
+}  // namespace caffe
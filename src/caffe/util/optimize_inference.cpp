@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/optimize_inference.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The layers after layer_id reading the version of blob it writes, up to and
+// including the next layer writing blob in place.
+vector<int> BlobReaders(const NetParameter& param, const vector<bool>& removed,
+    const int layer_id, const string& blob) {
+  vector<int> readers;
+  for (int i = layer_id + 1; i < param.layer_size(); ++i) {
+    if (removed[i]) { continue; }
+    const LayerParameter& layer_param = param.layer(i);
+    bool writes = false;
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      if (layer_param.bottom(j) == blob) {
+        readers.push_back(i);
+        break;
+      }
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      writes = writes || layer_param.top(j) == blob;
+    }
+    if (writes) { break; }
+  }
+  return readers;
+}
+
+bool Writes(const LayerParameter& layer_param, const string& blob) {
+  for (int j = 0; j < layer_param.top_size(); ++j) {
+    if (layer_param.top(j) == blob) { return true; }
+  }
+  return false;
+}
+
+// Removes layer_id, an identity at test time, if its consumers can read its
+// bottom instead of its tops: none of them writes a top in place, and
+// nothing writes the bottom before the last of them has read it.
+bool RemoveIdentity(NetParameter* param, vector<bool>* removed,
+    const int layer_id) {
+  const LayerParameter& layer_param = param->layer(layer_id);
+  if (layer_param.bottom_size() != 1) { return false; }
+  const string& bottom = layer_param.bottom(0);
+  vector<vector<int> > readers(layer_param.top_size());
+  int last_reader = layer_id;
+  for (int t = 0; t < layer_param.top_size(); ++t) {
+    const string& top = layer_param.top(t);
+    if (top == bottom) { continue; }
+    readers[t] = BlobReaders(*param, *removed, layer_id, top);
+    if (readers[t].empty()) { return false; }  // a net output
+    for (int i = 0; i < readers[t].size(); ++i) {
+      if (Writes(param->layer(readers[t][i]), top)) { return false; }
+      last_reader = std::max(last_reader, readers[t][i]);
+    }
+  }
+  for (int i = layer_id + 1; i < last_reader; ++i) {
+    if (!(*removed)[i] && Writes(param->layer(i), bottom)) { return false; }
+  }
+  for (int t = 0; t < readers.size(); ++t) {
+    for (int i = 0; i < readers[t].size(); ++i) {
+      LayerParameter* reader = param->mutable_layer(readers[t][i]);
+      for (int j = 0; j < reader->bottom_size(); ++j) {
+        if (reader->bottom(j) == layer_param.top(t)) {
+          reader->set_bottom(j, bottom);
+        }
+      }
+    }
+  }
+  (*removed)[layer_id] = true;
+  return true;
+}
+
+// Reads the per-channel affine map y = scale * x + shift that a BatchNorm,
+// Scale or Bias layer applies to num_output channels, if it is one.
+bool ChannelAffine(const LayerParameter& layer_param, const int num_output,
+    vector<float>* scale, vector<float>* shift) {
+  const string& type = layer_param.type();
+  if ((type != "BatchNorm" && type != "Scale" && type != "Bias") ||
+      layer_param.bottom_size() != 1 || layer_param.top_size() != 1) {
+    return false;
+  }
+  scale->assign(num_output, 1);
+  shift->assign(num_output, 0);
+  vector<Blob<float> > blobs(layer_param.blobs_size());
+  for (int i = 0; i < blobs.size(); ++i) {
+    blobs[i].FromProto(layer_param.blobs(i));
+  }
+  if (type == "BatchNorm") {
+    const BatchNormParameter& bn_param = layer_param.batch_norm_param();
+    const bool use_global_stats = bn_param.has_use_global_stats() ?
+        bn_param.use_global_stats() : layer_param.phase() == TEST;
+    if (!use_global_stats || blobs.size() != 3 ||
+        blobs[0].count() != num_output) {
+      return false;
+    }
+    const float factor = blobs[2].cpu_data()[0] == 0 ? 0 :
+        1 / blobs[2].cpu_data()[0];
+    for (int c = 0; c < num_output; ++c) {
+      (*scale)[c] = 1 / std::sqrt(blobs[1].cpu_data()[c] * factor +
+          bn_param.eps());
+      (*shift)[c] = -blobs[0].cpu_data()[c] * factor * (*scale)[c];
+    }
+    return true;
+  }
+  if (type == "Scale") {
+    const ScaleParameter& scale_param = layer_param.scale_param();
+    if (scale_param.axis() != 1 || scale_param.num_axes() != 1 ||
+        blobs.size() != (scale_param.bias_term() ? 2 : 1) ||
+        blobs[0].count() != num_output) {
+      return false;
+    }
+    caffe_copy(num_output, blobs[0].cpu_data(), &(*scale)[0]);
+    if (scale_param.bias_term()) {
+      caffe_copy(num_output, blobs[1].cpu_data(), &(*shift)[0]);
+    }
+    return true;
+  }
+  const BiasParameter& bias_param = layer_param.bias_param();
+  if (bias_param.axis() != 1 || bias_param.num_axes() != 1 ||
+      blobs.size() != 1 || blobs[0].count() != num_output) {
+    return false;
+  }
+  caffe_copy(num_output, blobs[0].cpu_data(), &(*shift)[0]);
+  return true;
+}
+
+// Applies the affine map to the output channels of a Convolution, adding
+// a bias if it has none.
+void FoldIntoConvolution(const vector<float>& scale,
+    const vector<float>& shift, LayerParameter* conv_param) {
+  const int num_output = scale.size();
+  Blob<float> weights;
+  weights.FromProto(conv_param->blobs(0));
+  const int dim = weights.count() / num_output;
+  for (int c = 0; c < num_output; ++c) {
+    caffe_scal(dim, scale[c], weights.mutable_cpu_data() + c * dim);
+  }
+  Blob<float> bias(vector<int>(1, num_output));
+  caffe_set(num_output, 0.f, bias.mutable_cpu_data());
+  if (conv_param->blobs_size() > 1) {
+    bias.FromProto(conv_param->blobs(1));
+  } else {
+    conv_param->add_blobs();
+  }
+  for (int c = 0; c < num_output; ++c) {
+    bias.mutable_cpu_data()[c] = bias.cpu_data()[c] * scale[c] + shift[c];
+  }
+  conv_param->mutable_blobs(0)->Clear();
+  weights.ToProto(conv_param->mutable_blobs(0));
+  conv_param->mutable_blobs(1)->Clear();
+  bias.ToProto(conv_param->mutable_blobs(1));
+  conv_param->mutable_convolution_param()->set_bias_term(true);
+}
+
+bool CanFoldInto(const LayerParameter& layer_param) {
+  if (layer_param.type() != "Convolution" || layer_param.bottom_size() != 1 ||
+      layer_param.top_size() != 1 || layer_param.blobs_size() == 0 ||
+      layer_param.convolution_param().axis() != 1) {
+    return false;
+  }
+  // weights shared with another layer would change under it
+  for (int i = 0; i < layer_param.param_size(); ++i) {
+    if (!layer_param.param(i).name().empty()) { return false; }
+  }
+  return true;
+}
+
+}  // namespace
+
+void OptimizeInference(const NetParameter& param,
+    NetParameter* param_optimized) {
+  NetParameter net_param(param);
+  vector<bool> removed(net_param.layer_size(), false);
+  int num_removed = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    const string& type = net_param.layer(i).type();
+    if ((type == "Dropout" || type == "Split") &&
+        RemoveIdentity(&net_param, &removed, i)) {
+      ++num_removed;
+    }
+  }
+  int num_folded = 0;
+  int num_fused = 0;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    if (removed[i] || !CanFoldInto(net_param.layer(i))) { continue; }
+    LayerParameter* conv_param = net_param.mutable_layer(i);
+    const int num_output = conv_param->convolution_param().num_output();
+    vector<float> scale, shift;
+    // Fold the layers applied to the output only, until a ReLU.
+    while (!conv_param->convolution_param().relu()) {
+      const vector<int> readers =
+          BlobReaders(net_param, removed, i, conv_param->top(0));
+      if (readers.size() != 1) { break; }
+      const LayerParameter& next = net_param.layer(readers[0]);
+      if (next.type() == "ReLU" && next.bottom_size() == 1 &&
+          next.top_size() == 1 && next.relu_param().negative_slope() == 0) {
+        conv_param->mutable_convolution_param()->set_relu(true);
+        ++num_fused;
+      } else if (ChannelAffine(next, num_output, &scale, &shift)) {
+        FoldIntoConvolution(scale, shift, conv_param);
+        ++num_folded;
+      } else {
+        break;
+      }
+      conv_param->set_top(0, next.top(0));
+      removed[readers[0]] = true;
+    }
+  }
+  param_optimized->CopyFrom(net_param);
+  param_optimized->clear_layer();
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    if (!removed[i]) {
+      param_optimized->add_layer()->CopyFrom(net_param.layer(i));
+    }
+  }
+  LOG(INFO) << "Folded " << num_folded << " BatchNorm, Scale and Bias layers "
+      << "into convolutions, fused " << num_fused << " ReLU layers and "
+      << "removed " << num_removed << " Dropout and Split layers";
+}
+
+}  // namespace caffe
@@ -0,0 +1,165 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/profiler.hpp"
+
+namespace caffe {
+
+namespace {
+
+const boost::posix_time::ptime kEpoch =
+    boost::posix_time::microsec_clock::universal_time();
+
+// Escapes a name for a JSON string.
+string JsonEscape(const string& name) {
+  string escaped;
+  for (int i = 0; i < name.size(); ++i) {
+    if (name[i] == '"' || name[i] == '\\') {
+      escaped += '\\';
+    }
+    escaped += name[i];
+  }
+  return escaped;
+}
+
+bool LongerTotal(const pair<int64_t, string>& a,
+                 const pair<int64_t, string>& b) {
+  return a.first > b.first;
+}
+
+}  // namespace
+
+class Profiler::sync {
+ public:
+  mutable boost::mutex mutex_;
+  // the trace thread ids, in order of the first event on each thread
+  map<boost::thread::id, int> threads_;
+};
+
+boost::atomic<bool> Profiler::enabled_(false);
+
+Profiler& Profiler::Get() {
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::Profiler()
+    : tracing_(false), summary_start_(0), sync_(new sync()) {
+}
+
+int64_t Profiler::Now() {
+  return (boost::posix_time::microsec_clock::universal_time() - kEpoch)
+      .total_microseconds();
+}
+
+void Profiler::Enable(bool trace) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  tracing_ = trace;
+  summary_start_ = Now();
+  enabled_ = true;
+}
+
+void Profiler::Disable() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  enabled_ = false;
+  tracing_ = false;
+  events_.clear();
+}
+
+void Profiler::Record(const string& name, const char* category,
+    int64_t start, double bytes, double flops) {
+  const int64_t duration = Now() - start;
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  Total& total = totals_[make_pair(string(category), name)];
+  ++total.count;
+  total.microseconds += duration;
+  total.bytes += bytes;
+  total.flops += flops;
+  if (!tracing_) { return; }
+  Event event;
+  event.name = name;
+  event.category = category;
+  const boost::thread::id thread = boost::this_thread::get_id();
+  if (!sync_->threads_.count(thread)) {
+    const int id = sync_->threads_.size();
+    sync_->threads_[thread] = id;
+  }
+  event.thread = sync_->threads_[thread];
+  event.start = start;
+  event.duration = duration;
+  event.bytes = bytes;
+  event.flops = flops;
+  events_.push_back(event);
+}
+
+Profiler::Total Profiler::total(const string& category,
+    const string& name) const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  map<pair<string, string>, Total>::const_iterator it =
+      totals_.find(make_pair(category, name));
+  return it == totals_.end() ? Total() : it->second;
+}
+
+void Profiler::LogSummary() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  const int64_t now = Now();
+  const double window_ms = (now - summary_start_) / 1000.;
+  vector<pair<int64_t, string> > lines;
+  for (map<pair<string, string>, Total>::const_iterator it = totals_.begin();
+       it != totals_.end(); ++it) {
+    const Total& total = it->second;
+    if (total.count == 0) { continue; }
+    const double ms = total.microseconds / 1000.;
+    const double seconds = std::max<int64_t>(total.microseconds, 1) / 1e6;
+    std::ostringstream line;
+    line << "    " << it->first.first << " " << it->first.second << ": "
+        << total.count << " calls, " << ms / total.count << " ms each, "
+        << 100 * ms / std::max(window_ms, 1e-3) << "% of the time";
+    if (total.flops > 0) {
+      line << ", " << total.flops / seconds / 1e9 << " GFLOP/s";
+    }
+    if (total.bytes > 0) {
+      line << ", " << total.bytes / seconds / 1e9 << " GB/s";
+    }
+    lines.push_back(make_pair(total.microseconds, line.str()));
+  }
+  std::stable_sort(lines.begin(), lines.end(), LongerTotal);
+  LOG(INFO) << "Profile of the last " << window_ms << " ms:";
+  for (int i = 0; i < lines.size(); ++i) {
+    LOG(INFO) << lines[i].second;
+  }
+  totals_.clear();
+  summary_start_ = now;
+}
+
+void Profiler::WriteTrace(const string& filename) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  std::ofstream trace(filename.c_str());
+  CHECK(trace.good()) << "Failed to open " << filename;
+  trace << "{\"traceEvents\": [";
+  for (int i = 0; i < events_.size(); ++i) {
+    const Event& event = events_[i];
+    trace << (i ? ",\n" : "\n") << "{\"name\": \""
+        << JsonEscape(event.name) << "\", \"cat\": \"" << event.category
+        << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << event.thread
+        << ", \"ts\": " << event.start << ", \"dur\": " << event.duration
+        << ", \"args\": {\"bytes\": " << event.bytes << ", \"flops\": "
+        << event.flops << "}}";
+  }
+  trace << "\n], \"displayTimeUnit\": \"ms\"}\n";
+  CHECK(trace.good()) << "Failed to write " << filename;
+  LOG(INFO) << "Wrote " << events_.size() << " profile events to "
+      << filename;
+  tracing_ = false;
+  events_.clear();
+}
+
+}  // namespace caffe
@@ -0,0 +1,106 @@
+#include <boost/thread.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <exception>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable task_queued_;
+  boost::condition_variable tasks_done_;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : unfinished_(0), stop_(false), sync_(new sync()) {
+  CHECK_GT(num_threads, 0);
+  int device = 0;
+#ifndef CPU_ONLY
+  CUDA_CHECK(cudaGetDevice(&device));
+#endif
+  int inner_threads = 1;
+#ifdef _OPENMP
+  inner_threads = std::max(1, omp_get_max_threads() / num_threads);
+#endif
+  try {
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &ThreadPool::Work, this, device, Caffe::mode(), caffe_rng_rand(),
+          Caffe::solver_count(), Caffe::solver_rank(), Caffe::multiprocess(),
+          inner_threads)));
+    }
+  } catch (std::exception& e) {
+    LOG(FATAL) << "Thread exception: " << e.what();
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    stop_ = true;
+  }
+  sync_->task_queued_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void ThreadPool::Run(const boost::function<void()>& task) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  tasks_.push_back(task);
+  ++unfinished_;
+  lock.unlock();
+  sync_->task_queued_.notify_one();
+}
+
+void ThreadPool::Wait() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (unfinished_ > 0) {
+    sync_->tasks_done_.wait(lock);
+  }
+}
+
+void ThreadPool::Work(int device, Caffe::Brew mode, int rand_seed,
+    int solver_count, int solver_rank, bool multiprocess, int inner_threads) {
+#ifndef CPU_ONLY
+  CUDA_CHECK(cudaSetDevice(device));
+#endif
+  Caffe::set_mode(mode);
+  Caffe::set_random_seed(rand_seed);
+  Caffe::set_solver_count(solver_count);
+  Caffe::set_solver_rank(solver_rank);
+  Caffe::set_multiprocess(multiprocess);
+#ifdef _OPENMP
+  omp_set_num_threads(inner_threads);
+#endif
+#ifdef USE_MKL
+  mkl_set_num_threads_local(inner_threads);
+#endif
+
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (true) {
+    while (tasks_.empty() && !stop_) {
+      sync_->task_queued_.wait(lock);
+    }
+    if (tasks_.empty()) {
+      return;
+    }
+    boost::function<void()> task = tasks_.front();
+    tasks_.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+    if (--unfinished_ == 0) {
+      sync_->tasks_done_.notify_all();
+    }
+  }
+}
+
+}  // namespace caffe
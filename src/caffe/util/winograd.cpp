@@ -0,0 +1,216 @@
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+// The transform matrices of F(2x2, 3x3) and F(4x4, 3x3), from Lavin & Gray,
+// "Fast Algorithms for Convolutional Neural Networks": B^T (alpha x alpha),
+// G (alpha x 3) and A^T (m x alpha), with alpha = m + 2.
+static const double kBT2[] = {
+  1,  0, -1,  0,
+  0,  1,  1,  0,
+  0, -1,  1,  0,
+  0,  1,  0, -1
+};
+static const double kG2[] = {
+  1,    0,   0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0,    0,   1
+};
+static const double kAT2[] = {
+  1, 1,  1,  0,
+  0, 1, -1, -1
+};
+static const double kBT4[] = {
+  4,  0, -5,  0, 1, 0,
+  0, -4, -4,  1, 1, 0,
+  0,  4, -4, -1, 1, 0,
+  0, -2, -1,  2, 1, 0,
+  0,  2, -1, -2, 1, 0,
+  0,  4,  0, -5, 0, 1
+};
+static const double kG4[] = {
+  1. / 4,   0,        0,
+  -1. / 6,  -1. / 6,  -1. / 6,
+  -1. / 6,  1. / 6,   -1. / 6,
+  1. / 24,  1. / 12,  1. / 6,
+  1. / 24,  -1. / 12, 1. / 6,
+  0,        0,        1
+};
+static const double kAT4[] = {
+  1, 1,  1, 1,  1, 0,
+  0, 1, -1, 2, -2, 0,
+  0, 1,  1, 4,  4, 0,
+  0, 1, -1, 8, -8, 1
+};
+static const int kMaxAlpha = 6;
+
+static inline void CheckTile(const int tile) {
+  CHECK(tile == 2 || tile == 4) << "Winograd supports 2x2 and 4x4 tiles only.";
+}
+
+// out (rows x cols) = left (rows x inner) * right (inner x cols).
+template <typename Dtype>
+static inline void small_gemm(const int rows, const int cols, const int inner,
+    const double* left, const Dtype* right, Dtype* out) {
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < inner; ++k) {
+        sum += left[i * inner + k] * right[k * cols + j];
+      }
+      out[i * cols + j] = sum;
+    }
+  }
+}
+
+// out (rows x cols) = left (rows x inner) * right^T, right (cols x inner).
+template <typename Dtype>
+static inline void small_gemm_nt(const int rows, const int cols,
+    const int inner, const Dtype* left, const double* right, Dtype* out) {
+  for (int i = 0; i < rows; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < inner; ++k) {
+        sum += left[i * inner + k] * right[j * inner + k];
+      }
+      out[i * cols + j] = sum;
+    }
+  }
+}
+
+template <typename Dtype>
+void winograd_filter_transform_cpu(const Dtype* weights,
+    const int out_channels, const int in_channels, const int tile,
+    const bool flip, Dtype* filters) {
+  CheckTile(tile);
+  const int alpha = tile + 2;
+  const int size = alpha * alpha;
+  const double* G = tile == 2 ? kG2 : kG4;
+  for (int o = 0; o < out_channels; ++o) {
+    for (int i = 0; i < in_channels; ++i) {
+      Dtype g[9];
+      for (int r = 0; r < 9; ++r) {
+        g[r] = flip ? weights[(i * out_channels + o) * 9 + 8 - r] :
+            weights[(o * in_channels + i) * 9 + r];
+      }
+      Dtype t[kMaxAlpha * 3];
+      Dtype u[kMaxAlpha * kMaxAlpha];
+      small_gemm(alpha, 3, 3, G, g, t);
+      small_gemm_nt(alpha, alpha, 3, t, G, u);
+      for (int xi = 0; xi < size; ++xi) {
+        filters[(xi * out_channels + o) * in_channels + i] = u[xi];
+      }
+    }
+  }
+}
+
+template void winograd_filter_transform_cpu<float>(const float* weights,
+    const int out_channels, const int in_channels, const int tile,
+    const bool flip, float* filters);
+template void winograd_filter_transform_cpu<double>(const double* weights,
+    const int out_channels, const int in_channels, const int tile,
+    const bool flip, double* filters);
+
+int winograd_workspace_count(const int channels, const int out_channels,
+    const int output_h, const int output_w, const int tile) {
+  CheckTile(tile);
+  const int num_tiles =
+      ((output_h + tile - 1) / tile) * ((output_w + tile - 1) / tile);
+  return winograd_tile_size(tile) * (channels + out_channels) * num_tiles;
+}
+
+template <typename Dtype>
+void winograd_conv_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const Dtype* filters, const int out_channels, const int tile,
+    Dtype* workspace, Dtype* data_out) {
+  CheckTile(tile);
+  const int alpha = tile + 2;
+  const int size = alpha * alpha;
+  const int output_h = height + 2 * pad_h - 2;
+  const int output_w = width + 2 * pad_w - 2;
+  const int tiles_h = (output_h + tile - 1) / tile;
+  const int tiles_w = (output_w + tile - 1) / tile;
+  const int num_tiles = tiles_h * tiles_w;
+  const double* BT = tile == 2 ? kBT2 : kBT4;
+  const double* AT = tile == 2 ? kAT2 : kAT4;
+  // transformed input tiles, size x channels x num_tiles
+  Dtype* input = workspace;
+  // their products with the filters, size x out_channels x num_tiles
+  Dtype* product = workspace + size * channels * num_tiles;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* im = data_im + c * height * width;
+    Dtype d[kMaxAlpha * kMaxAlpha];
+    Dtype t[kMaxAlpha * kMaxAlpha];
+    Dtype v[kMaxAlpha * kMaxAlpha];
+    for (int ty = 0; ty < tiles_h; ++ty) {
+      for (int tx = 0; tx < tiles_w; ++tx) {
+        const int y0 = ty * tile - pad_h;
+        const int x0 = tx * tile - pad_w;
+        for (int y = 0; y < alpha; ++y) {
+          for (int x = 0; x < alpha; ++x) {
+            const int row = y0 + y;
+            const int col = x0 + x;
+            d[y * alpha + x] = (row >= 0 && row < height && col >= 0 &&
+                col < width) ? im[row * width + col] : Dtype(0);
+          }
+        }
+        small_gemm(alpha, alpha, alpha, BT, d, t);
+        small_gemm_nt(alpha, alpha, alpha, t, BT, v);
+        const int p = ty * tiles_w + tx;
+        for (int xi = 0; xi < size; ++xi) {
+          input[(xi * channels + c) * num_tiles + p] = v[xi];
+        }
+      }
+    }
+  }
+  for (int xi = 0; xi < size; ++xi) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_channels,
+        num_tiles, channels, (Dtype)1.,
+        filters + xi * out_channels * channels,
+        input + xi * channels * num_tiles,
+        (Dtype)0., product + xi * out_channels * num_tiles);
+  }
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int k = 0; k < out_channels; ++k) {
+    Dtype* out = data_out + k * output_h * output_w;
+    Dtype m[kMaxAlpha * kMaxAlpha];
+    Dtype t[4 * kMaxAlpha];
+    Dtype y[4 * 4];
+    for (int ty = 0; ty < tiles_h; ++ty) {
+      for (int tx = 0; tx < tiles_w; ++tx) {
+        const int p = ty * tiles_w + tx;
+        for (int xi = 0; xi < size; ++xi) {
+          m[xi] = product[(xi * out_channels + k) * num_tiles + p];
+        }
+        small_gemm(tile, alpha, alpha, AT, m, t);
+        small_gemm_nt(tile, tile, alpha, t, AT, y);
+        for (int i = 0; i < tile && ty * tile + i < output_h; ++i) {
+          for (int j = 0; j < tile && tx * tile + j < output_w; ++j) {
+            out[(ty * tile + i) * output_w + tx * tile + j] = y[i * tile + j];
+          }
+        }
+      }
+    }
+  }
+}
+
+template void winograd_conv_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const float* filters, const int out_channels,
+    const int tile, float* workspace, float* data_out);
+template void winograd_conv_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const double* filters, const int out_channels,
+    const int tile, double* workspace, double* data_out);
+
+}  // namespace caffe
@@ -0,0 +1,125 @@
+// Calibrates a net for int8 CPU inference: runs the TEST net over sample
+// batches to record the input range of every Convolution and InnerProduct
+// layer, then writes a model definition with their quantization_param set
+// and the weights with those layers' filters stored in int8.
+// Usage:
+//    calibrate_int8 --model=... --weights=... --output_model=...
+//        --output_weights=... [FLAGS]
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/int8.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+using std::string;
+
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file; its TEST phase data "
+    "layer reads the calibration samples, e.g. from an LMDB.");
+DEFINE_string(weights, "",
+    "The trained float weights.");
+DEFINE_int32(iterations, 100,
+    "The number of batches to record the input ranges over.");
+DEFINE_string(output_model, "",
+    "The model definition to write, with INT8 quantization parameters.");
+DEFINE_string(output_weights, "",
+    "The weights to write, with int8 filters.");
+
+static bool IsQuantizable(const string& type) {
+  return type == "Convolution" || type == "InnerProduct";
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Calibrate a net for int8 CPU inference.\n"
+      "Usage:\n"
+      "    calibrate_int8 --model=... --weights=... --output_model=... "
+      "--output_weights=... [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_model.empty() || FLAGS_weights.empty() ||
+      FLAGS_output_model.empty() || FLAGS_output_weights.empty()) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/calibrate_int8");
+    return 1;
+  }
+  CHECK_GT(FLAGS_iterations, 0);
+  Caffe::set_mode(Caffe::CPU);
+
+  Net<float> net(FLAGS_model, TEST);
+  net.CopyTrainedLayersFrom(FLAGS_weights);
+  const vector<shared_ptr<Layer<float> > >& layers = net.layers();
+  // Run the net layer by layer, so that every input is seen before a later
+  // in-place layer can overwrite it.
+  vector<float> absmax(layers.size(), 0);
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    for (int i = 0; i < layers.size(); ++i) {
+      if (IsQuantizable(layers[i]->type())) {
+        const Blob<float>* bottom = net.bottom_vecs()[i][0];
+        absmax[i] = std::max(absmax[i],
+            int8_absmax_cpu(bottom->count(), bottom->cpu_data()));
+      }
+      net.ForwardFromTo(i, i);
+    }
+  }
+
+  // The model definition, with the input scales.
+  NetParameter model;
+  ReadNetParamsFromTextFileOrDie(FLAGS_model, &model);
+  for (int l = 0; l < model.layer_size(); ++l) {
+    LayerParameter* layer_param = model.mutable_layer(l);
+    if (!IsQuantizable(layer_param->type()) ||
+        !net.has_layer(layer_param->name())) {
+      continue;
+    }
+    const int i = std::find(net.layer_names().begin(),
+        net.layer_names().end(), layer_param->name()) -
+        net.layer_names().begin();
+    QuantizationParameter* quantization_param =
+        layer_param->mutable_quantization_param();
+    quantization_param->set_precision(QuantizationParameter_Precision_INT8);
+    quantization_param->set_input_scale(int8_scale(absmax[i]));
+    // the int8 path is part of the CAFFE engine
+    if (layer_param->has_convolution_param() &&
+        (layer_param->convolution_param().engine() ==
+         ConvolutionParameter_Engine_WINOGRAD ||
+         layer_param->convolution_param().engine() ==
+         ConvolutionParameter_Engine_DIRECT)) {
+      layer_param->mutable_convolution_param()->clear_engine();
+    }
+    LOG(INFO) << layer_param->name() << ": input range " << absmax[i];
+  }
+  WriteProtoToTextFile(model, FLAGS_output_model);
+  LOG(INFO) << "Wrote " << FLAGS_output_model;
+
+  // The weights, with int8 filters.
+  NetParameter weights;
+  net.ToProto(&weights, false);
+  for (int l = 0; l < weights.layer_size(); ++l) {
+    LayerParameter* layer_param = weights.mutable_layer(l);
+    if (IsQuantizable(layer_param->type()) && layer_param->blobs_size() > 0) {
+      int8_blob_to_proto(*net.layer_by_name(layer_param->name())->blobs()[0],
+          layer_param->mutable_blobs(0));
+    }
+  }
+  WriteProtoToBinaryFile(weights, FLAGS_output_weights);
+  LOG(INFO) << "Wrote " << FLAGS_output_weights;
+  return 0;
+}
@@ -19,7 +19,7 @@ using std::pair;
 using boost::scoped_ptr;
 
 DEFINE_string(backend, "lmdb",
-        "The backend {leveldb, lmdb} containing the images");
+        "The backend {leveldb, lmdb, mmap} containing the images");
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -51,7 +51,7 @@ int main(int argc, char** argv) {
   int count = 0;
   // load first datum
   Datum datum;
-  datum.ParseFromString(cursor->value());
+  cursor->ReadDatum(&datum);
 
   if (DecodeDatumNative(&datum)) {
     LOG(INFO) << "Decoding Datum";
@@ -69,8 +69,8 @@ int main(int argc, char** argv) {
   }
   LOG(INFO) << "Starting iteration";
   while (cursor->valid()) {
-    Datum datum;
-    datum.ParseFromString(cursor->value());
+    // reuse the buffers of the datum across records
+    cursor->ReadDatum(&datum);
     DecodeDatumNative(&datum);
 
     const std::string& data = datum.data();
@@ -0,0 +1,87 @@
+// Converts the float weights of a trained net to 16-bit storage, halving the
+// size of the weights file and of the proto parsed when loading it. Blobs
+// are read back as float by CopyTrainedLayersFrom.
+// Usage:
+//    convert_weights_half [FLAGS] INPUT_WEIGHTS OUTPUT_WEIGHTS
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/half.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+using std::string;
+
+DEFINE_string(format, "fp16",
+    "The 16-bit format: fp16 (IEEE binary16) or bf16 (bfloat16).");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Convert trained weights to 16-bit storage.\n"
+      "Usage:\n"
+      "    convert_weights_half [FLAGS] INPUT_WEIGHTS OUTPUT_WEIGHTS\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0],
+        "tools/convert_weights_half");
+    return 1;
+  }
+  HalfFormat format;
+  if (FLAGS_format == "fp16") {
+    format = BlobProto_HalfFormat_FP16;
+  } else if (FLAGS_format == "bf16") {
+    format = BlobProto_HalfFormat_BF16;
+  } else {
+    LOG(FATAL) << "Unknown format: " << FLAGS_format;
+  }
+
+  NetParameter weights;
+  ReadNetParamsFromBinaryFileOrDie(argv[1], &weights);
+  int converted = 0, kept = 0;
+  for (int l = 0; l < weights.layer_size(); ++l) {
+    LayerParameter* layer_param = weights.mutable_layer(l);
+    for (int b = 0; b < layer_param->blobs_size(); ++b) {
+      BlobProto* proto = layer_param->mutable_blobs(b);
+      if (proto->has_int8_data()) {
+        continue;
+      }
+      Blob<float> blob;
+      blob.FromProto(*proto);
+      float absmax = 0;
+      for (int i = 0; i < blob.count(); ++i) {
+        absmax = std::max(absmax, std::abs(blob.cpu_data()[i]));
+      }
+      // e.g. BatchNorm variances can exceed the fp16 range
+      if (absmax > half_max(format)) {
+        LOG(WARNING) << layer_param->name() << " blob " << b
+            << " exceeds the " << FLAGS_format << " range (" << absmax
+            << "), kept as float";
+        ++kept;
+        continue;
+      }
+      half_blob_to_proto(blob, format, proto);
+      ++converted;
+    }
+  }
+  WriteProtoToBinaryFile(weights, argv[2]);
+  LOG(INFO) << "Wrote " << argv[2] << ": " << converted << " blobs in "
+      << FLAGS_format << ", " << kept << " kept as float";
+  return 0;
+}
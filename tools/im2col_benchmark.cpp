@@ -0,0 +1,98 @@
+// Times the specialized CPU im2col and col2im kernels against the generic
+// loops on the shapes they cover.
+// Usage:
+//    im2col_benchmark [FLAGS]
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/im2col.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(channels, 64,
+    "The number of input channels.");
+DEFINE_int32(size, 56,
+    "The height and width of the input.");
+DEFINE_int32(iterations, 50,
+    "The number of calls timed per kernel.");
+
+struct Shape {
+  const char* name;
+  int kernel, stride, pad;
+};
+
+typedef void (*Im2colFn)(const float*, const int, const int, const int,
+    const int, const int, const int, const int, const int, const int,
+    const int, const int, float*);
+
+// Returns the average milliseconds of one call.
+static float Time(Im2colFn fn, const Blob<float>& input, const Shape& shape,
+                  Blob<float>* output) {
+  const int size = FLAGS_size;
+  fn(input.cpu_data(), FLAGS_channels, size, size, shape.kernel,
+      shape.kernel, shape.pad, shape.pad, shape.stride, shape.stride, 1, 1,
+      output->mutable_cpu_data());
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    fn(input.cpu_data(), FLAGS_channels, size, size, shape.kernel,
+        shape.kernel, shape.pad, shape.pad, shape.stride, shape.stride, 1, 1,
+        output->mutable_cpu_data());
+  }
+  return timer.MilliSeconds() / FLAGS_iterations;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Times the specialized CPU im2col and col2im\n"
+      "kernels against the generic loops.\n"
+      "Usage:\n"
+      "    im2col_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_channels, 0);
+  CHECK_GT(FLAGS_size, 0);
+  CHECK_GT(FLAGS_iterations, 0);
+
+  const Shape shapes[] = {
+    {"3x3/s1/p1", 3, 1, 1},
+    {"3x3/s2/p1", 3, 2, 1},
+    {"1x1/s2/p0", 1, 2, 0},
+    {"7x7/s2/p3", 7, 2, 3},
+  };
+  const int size = FLAGS_size;
+  Blob<float> image(1, FLAGS_channels, size, size);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&image);
+  for (int s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+    const Shape& shape = shapes[s];
+    const int output = (size + 2 * shape.pad - shape.kernel) / shape.stride
+        + 1;
+    Blob<float> col(1, FLAGS_channels * shape.kernel * shape.kernel, output,
+        output);
+    filler.Fill(&col);
+    Blob<float> result(image.shape());
+    const float im2col_generic = Time(im2col_generic_cpu<float>, image,
+        shape, &col);
+    const float im2col = Time(im2col_cpu<float>, image, shape, &col);
+    const float col2im_generic = Time(col2im_generic_cpu<float>, col, shape,
+        &result);
+    const float col2im = Time(col2im_cpu<float>, col, shape, &result);
+    LOG(INFO) << shape.name << " im2col: " << im2col << " ms, generic "
+        << im2col_generic << " ms (" << im2col_generic / im2col << "x)";
+    LOG(INFO) << shape.name << " col2im: " << col2im << " ms, generic "
+        << col2im_generic << " ms (" << col2im_generic / col2im << "x)";
+  }
+  return 0;
+}
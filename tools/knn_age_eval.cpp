@@ -0,0 +1,187 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/knn.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+using boost::scoped_ptr;
+using std::string;
+
+DEFINE_string(gallery_model, "",
+    "The model definition protocol buffer text file producing the gallery "
+    "embeddings.");
+DEFINE_string(query_model, "",
+    "The model definition producing the query embeddings.");
+DEFINE_string(weights, "",
+    "The trained weights, shared by both models.");
+DEFINE_int32(gallery_iterations, 1,
+    "The number of gallery batches to index.");
+DEFINE_int32(query_iterations, 1,
+    "The number of query batches to evaluate.");
+DEFINE_string(blob, "feat",
+    "The embedding blob; every item is flattened to one vector.");
+DEFINE_string(label_blob, "label",
+    "The blob holding the age of every item.");
+DEFINE_int32(k, 5,
+    "The number of neighbors whose mean age is the prediction.");
+DEFINE_int32(cs, 10,
+    "Report the cumulative score CS@t for every t from 0 to this many years.");
+DEFINE_string(index, "flat",
+    "The index type: flat (exact) or ivfpq (approximate).");
+DEFINE_int32(nlist, 256,
+    "ivfpq: the number of coarse cells.");
+DEFINE_int32(m, 8,
+    "ivfpq: the number of one-byte codes per vector; must divide its size.");
+DEFINE_int32(nprobe, 8,
+    "ivfpq: the number of cells scanned per query.");
+DEFINE_int32(gpu, -1,
+    "Run the nets on this GPU; CPU when negative.");
+
+// Runs the net once and returns the embedding and label blobs.
+static void Forward(Net<float>* net, const Blob<float>** embedding,
+                    const Blob<float>** label) {
+  net->Forward();
+  CHECK(net->has_blob(FLAGS_blob)) << "Unknown blob " << FLAGS_blob;
+  CHECK(net->has_blob(FLAGS_label_blob)) << "Unknown blob "
+                                         << FLAGS_label_blob;
+  *embedding = net->blob_by_name(FLAGS_blob).get();
+  *label = net->blob_by_name(FLAGS_label_blob).get();
+  CHECK_EQ((*embedding)->shape(0), (*label)->count())
+      << "Expected one label per embedding.";
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Evaluate age estimation by k-nearest-neighbor "
+        "retrieval over net embeddings: the gallery is indexed in memory and "
+        "every query is predicted the mean age of its k nearest gallery "
+        "items, reporting MAE and CS@t.\n"
+        "Usage:\n"
+        "    knn_age_eval --gallery_model=... --query_model=... "
+        "--weights=... [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_gallery_model.empty() || FLAGS_query_model.empty()) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/knn_age_eval");
+    return 1;
+  }
+  CHECK_GT(FLAGS_k, 0);
+  CHECK_GE(FLAGS_cs, 0);
+  if (FLAGS_gpu >= 0) {
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+  }
+  CPUTimer timer;
+  timer.Start();
+
+  // Index the gallery, batch by batch as the net produces it.
+  Net<float> gallery_net(FLAGS_gallery_model, TEST);
+  if (!FLAGS_weights.empty()) {
+    gallery_net.CopyTrainedLayersFrom(FLAGS_weights);
+  }
+  scoped_ptr<KNNIndex> index;
+  vector<float> gallery_ages;
+  vector<float> pending;  // held back until an ivfpq index is trained
+  for (int i = 0; i < FLAGS_gallery_iterations; ++i) {
+    const Blob<float>* embedding;
+    const Blob<float>* label;
+    Forward(&gallery_net, &embedding, &label);
+    const int num = embedding->shape(0);
+    const int dim = embedding->count(1);
+    if (!index) {
+      if (FLAGS_index == "flat") {
+        index.reset(new FlatIndex(dim));
+      } else if (FLAGS_index == "ivfpq") {
+        IVFPQIndex* ivfpq = new IVFPQIndex(dim, FLAGS_nlist, FLAGS_m);
+        ivfpq->set_nprobe(FLAGS_nprobe);
+        index.reset(ivfpq);
+      } else {
+        LOG(FATAL) << "Unknown index " << FLAGS_index;
+      }
+    }
+    CHECK_EQ(dim, index->dim()) << "The embedding size changed.";
+    if (index->is_trained()) {
+      index->Add(num, embedding->cpu_data());
+    } else {
+      pending.insert(pending.end(), embedding->cpu_data(),
+                     embedding->cpu_data() + embedding->count());
+    }
+    gallery_ages.insert(gallery_ages.end(), label->cpu_data(),
+                        label->cpu_data() + num);
+  }
+  CHECK(index) << "The gallery is empty.";
+  if (!index->is_trained()) {
+    const int num = pending.size() / index->dim();
+    index->Train(num, &pending[0]);
+    index->Add(num, &pending[0]);
+  }
+  LOG(INFO) << "Indexed " << index->ntotal() << " gallery items of size "
+            << index->dim() << " in " << timer.Seconds() << " s.";
+
+  // Predict each query batch as soon as it is produced.
+  timer.Start();
+  Net<float> query_net(FLAGS_query_model, TEST);
+  if (!FLAGS_weights.empty()) {
+    query_net.CopyTrainedLayersFrom(FLAGS_weights);
+  }
+  vector<int> ids;
+  vector<float> dists;
+  vector<int> within(FLAGS_cs + 1, 0);
+  double total_error = 0;
+  int total = 0;
+  for (int i = 0; i < FLAGS_query_iterations; ++i) {
+    const Blob<float>* embedding;
+    const Blob<float>* label;
+    Forward(&query_net, &embedding, &label);
+    const int num = embedding->shape(0);
+    CHECK_EQ(embedding->count(1), index->dim())
+        << "Query and gallery embeddings differ in size.";
+    ids.resize(num * FLAGS_k);
+    dists.resize(num * FLAGS_k);
+    index->Search(num, embedding->cpu_data(), FLAGS_k, &ids[0], &dists[0]);
+    const float* ages = label->cpu_data();
+    for (int j = 0; j < num; ++j) {
+      float sum = 0;
+      int found = 0;
+      for (int n = 0; n < FLAGS_k; ++n) {
+        if (ids[j * FLAGS_k + n] >= 0) {
+          sum += gallery_ages[ids[j * FLAGS_k + n]];
+          ++found;
+        }
+      }
+      CHECK_GT(found, 0) << "No neighbor found for a query.";
+      const float error = std::fabs(sum / found - ages[j]);
+      total_error += error;
+      for (int t = 0; t <= FLAGS_cs; ++t) {
+        within[t] += error <= t;
+      }
+      ++total;
+    }
+  }
+  CHECK_GT(total, 0) << "No query was evaluated.";
+  LOG(INFO) << "Evaluated " << total << " queries in " << timer.Seconds()
+            << " s.";
+  LOG(INFO) << "MAE = " << total_error / total;
+  for (int t = 0; t <= FLAGS_cs; ++t) {
+    LOG(INFO) << "CS@" << t << " = " << 100.0 * within[t] / total << "%";
+  }
+  return 0;
+}
@@ -0,0 +1,71 @@
+// Optimizes a trained net for inference: folds BatchNorm, Scale and Bias
+// layers into the preceding convolutions, fuses their ReLUs and removes
+// Dropout and Split layers, then writes the optimized model definition and
+// weights.
+// Usage:
+//    optimize_net --model=... --weights=... --output_model=...
+//        --output_weights=...
+
+#include <string>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+#include "caffe/util/optimize_inference.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+using std::string;
+
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "The trained weights.");
+DEFINE_string(output_model, "",
+    "The optimized model definition to write.");
+DEFINE_string(output_weights, "",
+    "The weights of the optimized model to write.");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Optimize a trained net for inference.\n"
+      "Usage:\n"
+      "    optimize_net --model=... --weights=... --output_model=... "
+      "--output_weights=...\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_model.empty() || FLAGS_weights.empty() ||
+      FLAGS_output_model.empty() || FLAGS_output_weights.empty()) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/optimize_net");
+    return 1;
+  }
+  Caffe::set_mode(Caffe::CPU);
+
+  Net<float> net(FLAGS_model, TEST);
+  net.CopyTrainedLayersFrom(FLAGS_weights);
+  NetParameter trained;
+  net.ToProto(&trained, false);
+  NetParameter optimized;
+  OptimizeInference(trained, &optimized);
+  LOG(INFO) << net.layers().size() << " layers optimized to "
+      << optimized.layer_size();
+
+  WriteProtoToBinaryFile(optimized, FLAGS_output_weights);
+  LOG(INFO) << "Wrote " << FLAGS_output_weights;
+  for (int i = 0; i < optimized.layer_size(); ++i) {
+    optimized.mutable_layer(i)->clear_blobs();
+  }
+  WriteProtoToTextFile(optimized, FLAGS_output_model);
+  LOG(INFO) << "Wrote " << FLAGS_output_model;
+  return 0;
+}